@@ -0,0 +1,183 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Host benchmark harness for the metering path of slr.h: the APEX solve
+ *  of slr_apex.h the camera makes, against the whole stop table lookups it
+ *  replaced (kept as its cross-check, built here with SLR_TABLES). The
+ *  float getEV() the firmware had before the fixed point one is kept here,
+ *  as the reference the "getEV" case is measured against.
+ *  Every case runs ROUNDS x SAMPLES times over the same precomputed inputs
+ *  and reports ns/op and, when the kernel lets us open a perf counter,
+ *  user space instructions/op. The "baseline" case is the cost of the
+ *  harness itself (indirect call + loop), subtract it when comparing.
+ *
+ *      make bench
+ */
+#define SLR_TABLES /* the whole stop tables and their lookups, for the host only */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../slr.h"
+#include "../slr_apex.h"
+
+#define SAMPLES 4096 /* power of two */
+#define ROUNDS  1000
+
+typedef struct {
+	const char *name;
+	uint32_t  (*op)(uint32_t i);
+} bench_case_t;
+
+static float    lux_f[SAMPLES];
+static uint32_t lux_q8[SAMPLES];
+static uint8_t  in_iso[SAMPLES], in_idx[SAMPLES], in_ev[SAMPLES];
+static int16_t  in_ev8[SAMPLES], in_x24[SAMPLES];
+
+/* the float comparison cascade getEV() was, host only */
+static void getEV_float(float LUXvalue){
+	if(LUXvalue  < 3.5)                                    {SLR_EV = 0; return;}
+	if((LUXvalue > 3.4)     && (LUXvalue < 7))             {SLR_EV = 1; return;}
+	if((LUXvalue > 6.9)     && (LUXvalue < 14))            {SLR_EV = 2; return;}
+	if((LUXvalue > 13.9)    && (LUXvalue < 28))            {SLR_EV = 3; return;}
+	if((LUXvalue > 27.9)    && (LUXvalue < 56))            {SLR_EV = 4; return;}
+	if((LUXvalue > 55.9)    && (LUXvalue < 112))           {SLR_EV = 5; return;}
+	if((LUXvalue > 111.9)   && (LUXvalue < 225))           {SLR_EV = 6; return;}
+	if((LUXvalue > 224.9)   && (LUXvalue < 450))           {SLR_EV = 7; return;}
+	if((LUXvalue > 449.9)   && (LUXvalue < 900))           {SLR_EV = 8; return;}
+	if((LUXvalue > 899.9)   && (LUXvalue < 1800))          {SLR_EV = 9; return;}
+	if((LUXvalue > 1799.9)  && (LUXvalue < 3600))          {SLR_EV =10; return;}
+	if((LUXvalue > 3599.9)  && (LUXvalue < 7200))          {SLR_EV =11; return;}
+	if((LUXvalue > 7199.9)  && (LUXvalue < 14400))         {SLR_EV =12; return;}
+	if((LUXvalue > 14399.9) && (LUXvalue < 28900))         {SLR_EV =13; return;}
+	if((LUXvalue > 28899.9) && (LUXvalue < 57800))         {SLR_EV =14; return;}
+	if(LUXvalue  > 57799.9)                                {SLR_EV =15; return;}
+}
+
+/* -- the cases --------------------------------------------------------- */
+static uint32_t op_baseline(uint32_t i){ return i; }
+static uint32_t op_getEVfloat(uint32_t i){ getEV_float(lux_f[i]); return SLR_EV; }
+static uint32_t op_getEV(uint32_t i){ getEV(lux_q8[i]); return SLR_EV; }
+static uint32_t op_getEV8(uint32_t i){ return (uint32_t)getEV8(lux_q8[i]); }
+static uint32_t op_lookupTV(uint32_t i){ return lookupTVindex(in_iso[i], in_idx[i], in_ev[i]); }
+static uint32_t op_lookupAV(uint32_t i){ return lookupAVindex(in_iso[i], in_idx[i], in_ev[i]); }
+static uint32_t op_getTVindex(uint32_t i){
+	SLR_ISO = in_iso[i]; SLR_Av = APEX_AV(in_idx[i]); SLR_EV8 = in_ev8[i];
+	return getTVindex();
+}
+static uint32_t op_getAVindex(uint32_t i){
+	SLR_ISO = in_iso[i]; SLR_Tv = APEX_TV(in_idx[i]); SLR_EV8 = in_ev8[i];
+	return getAVindex();
+}
+static uint32_t op_getProgram(uint32_t i){
+	SLR_ISO = in_iso[i]; SLR_EV8 = in_ev8[i];
+	getProgram();
+	return (uint32_t)(SLR_Av ^ SLR_Tv);
+}
+
+/* solveExposure() of the exposure state, as the release and the display */
+static uint32_t solve(uint32_t i, cameramode_t mode){
+	apex_t x;
+	SLR_Mode = mode; SLR_ISO = in_iso[i]; SLR_EV8 = in_ev8[i];
+	if(mode == TV) SLR_Tv = in_x24[i];
+	else SLR_Av = in_x24[i];
+	x = solveExposure(&SLR_Exp);
+	return (uint32_t)(x.av ^ x.tv);
+}
+static uint32_t op_solveAV(uint32_t i){ return solve(i, AV); }
+static uint32_t op_solveTV(uint32_t i){ return solve(i, TV); }
+static uint32_t op_solvePR(uint32_t i){ return solve(i, PR); }
+static uint32_t op_apexTVus(uint32_t i){ return apex_tv_us(in_x24[i]); }
+
+static const bench_case_t cases[] = {
+	{"baseline",      op_baseline},
+	{"getEV float",   op_getEVfloat},
+	{"getEV",         op_getEV},
+	{"getEV8",        op_getEV8},
+	{"lookupTVindex", op_lookupTV},
+	{"lookupAVindex", op_lookupAV},
+	{"getTVindex",    op_getTVindex},
+	{"getAVindex",    op_getAVindex},
+	{"getProgram",    op_getProgram},
+	{"solve AV",      op_solveAV},
+	{"solve TV",      op_solveTV},
+	{"solve PR",      op_solvePR},
+	{"apex_tv_us",    op_apexTVus},
+};
+
+/* -- measurement ------------------------------------------------------- */
+static int perf_open(void){
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.type           = PERF_TYPE_HARDWARE;
+	attr.size           = sizeof(attr);
+	attr.config         = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled       = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv     = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void inputs_init(void){
+	uint32_t i, seed = 12345;
+	float l = 0.5f;
+	/* log spaced from 0.5 lux up to ~88000 lux (TSL2591 full scale) */
+	for(i = 0; i < SAMPLES; i++){
+		lux_f[i]  = l;
+		lux_q8[i] = (uint32_t)(l * 256.0f);
+		l *= 1.003f;
+		seed = seed * 1103515245u + 12345u;
+		in_iso[i] = (seed >> 8) % 8;
+		in_idx[i] = 1 + (seed >> 12) % 13;
+		in_ev[i]  = (seed >> 20) % 16;
+		/* the same exposures, in 1/24 stops and off the whole stops */
+		in_ev8[i]  = in_ev[i] * 8 + (seed >> 24) % 8;
+		in_x24[i]  = (in_idx[i] - 1) * APEX_UNIT + (seed >> 27) % 24;
+	}
+}
+
+int main(void){
+	uint32_t c, r, i;
+	volatile uint32_t sink = 0;
+	int fd;
+
+	inputs_init();
+	fd = perf_open();
+	printf("%-16s %10s %12s\n", "case", "ns/op", "instr/op");
+	for(c = 0; c < sizeof(cases) / sizeof(cases[0]); c++){
+		uint32_t (*op)(uint32_t) = cases[c].op;
+		uint64_t instr = 0;
+		double t0, ns;
+
+		for(i = 0; i < SAMPLES; i++) sink += op(i); /* warm up */
+		if(fd >= 0){
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+		t0 = now_ns();
+		for(r = 0; r < ROUNDS; r++)
+			for(i = 0; i < SAMPLES; i++) sink += op(i);
+		ns = (now_ns() - t0) / ((double)ROUNDS * SAMPLES);
+		if(fd >= 0){
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if(read(fd, &instr, sizeof(instr)) != sizeof(instr)) instr = 0;
+		}
+		if(fd >= 0 && instr)
+			printf("%-16s %10.2f %12.1f\n", cases[c].name, ns,
+				(double)instr / ((double)ROUNDS * SAMPLES));
+		else
+			printf("%-16s %10.2f %12s\n", cases[c].name, ns, "n/a");
+	}
+	if(fd >= 0) close(fd);
+	return 0;
+}
@@ -0,0 +1,114 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Throughput of the batch engine (host/slr_batch.h): SAMPLES readings of
+ *  a log, lux spread over the whole range of the meter, a random ISO and
+ *  Av in 1/24 stops for each, solved in AV mode - first one at a time through the
+ *  globals of slr.h, as the camera does, then with every kernel this CPU
+ *  runs, then shared out to a pool of 1, 2, 4... threads up to the cores
+ *  online. Millions of samples a second, the best of ROUNDS runs.
+ *
+ *      make bench
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "slr_batch.h"
+
+#define SAMPLES (4u << 20)
+#define ROUNDS  5
+
+static uint32_t lux[SAMPLES];
+static uint8_t  iso[SAMPLES], ev[SAMPLES];
+static int16_t  set[SAMPLES], ev8[SAMPLES];
+static apex_t   solved[SAMPLES];
+
+static double now_s(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the camera's way, one sample at a time */
+static void firmware(const batch_t *b){
+	size_t i;
+	for(i = 0; i < b->n; i++){
+		exposure_t x;
+		SLR_ISO = b->iso[i];
+		SLR_Av  = b->set[i];
+		getEV(b->lux[i]);
+		x = SLR_Exp;
+		b->ev8[i]    = SLR_EV8;
+		b->ev[i]     = SLR_EV;
+		b->solved[i] = solveExposure(&x);
+	}
+}
+
+static void report(const char *what, double s, double base){
+	printf("%-22s %9.1f %9.2f %8.1fx\n", what, SAMPLES / s / 1e6, s * 1e9 / SAMPLES, base / s);
+}
+
+int main(void){
+	batch_isa_t best = batch_isa_best(), k;
+	uint32_t i, r, seed = 12345;
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	double t, s, base = 0;
+	uint8_t threads;
+	batch_t b;
+	char name[32];
+
+	for(i = 0; i < SAMPLES; i++){
+		seed = seed * 1103515245u + 12345u;
+		/* 1/256 lux to the top of Q24.8, log spaced */
+		lux[i] = (uint32_t)(1u << (seed >> 27)) + ((seed >> 5) & ((1u << (seed >> 27)) - 1));
+		iso[i] = (seed >> 8) % 8;
+		set[i] = APEX_AV(1) + (seed >> 12) % (APEX_AV(14) + 1);
+	}
+	slr_init();
+	memset(&b, 0, sizeof(b));
+	b.n = SAMPLES;
+	b.lux = lux; b.iso = iso; b.set = set;
+	b.x = SLR_Exp;
+	b.x.mode = SLR_Mode = AV;
+	b.ev8 = ev8; b.ev = ev; b.solved = solved;
+
+	printf("%u samples, %ld cores online, kernels up to %s\n", SAMPLES, cores, Batch_isa_names[best]);
+	printf("%-22s %9s %9s %9s\n", "", "Msamples/s", "ns/sample", "speedup");
+	for(s = 1e9, r = 0; r < ROUNDS; r++){
+		t = now_s();
+		firmware(&b);
+		t = now_s() - t;
+		if(t < s) s = t;
+	}
+	base = s;
+	report("firmware, one by one", s, base);
+	for(k = BATCH_SCALAR; k <= best; k++){
+		for(s = 1e9, r = 0; r < ROUNDS; r++){
+			t = now_s();
+			batch_run(&b, k);
+			t = now_s() - t;
+			if(t < s) s = t;
+		}
+		snprintf(name, sizeof(name), "batch_run %s", Batch_isa_names[k]);
+		report(name, s, base);
+	}
+	for(threads = 1; ; threads *= 2){
+		batch_pool_t pool;
+		if(threads > cores) threads = (uint8_t)cores;
+		if(!batch_pool_init(&pool, threads, best)){ printf("can't start %u threads\n", threads); return 1; }
+		for(s = 1e9, r = 0; r < ROUNDS; r++){
+			t = now_s();
+			batch_pool_run(&pool, &b);
+			t = now_s() - t;
+			if(t < s) s = t;
+		}
+		batch_pool_free(&pool);
+		snprintf(name, sizeof(name), "pool %s, %u thread%s", Batch_isa_names[best], threads, (threads > 1) ? "s" : "");
+		report(name, s, base);
+		if(threads >= cores || threads >= BATCH_MAX_THREADS / 2) break;
+	}
+	return 0;
+}
@@ -0,0 +1,126 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Exhaustive check of the APEX solver (slr_apex.h), solveExposure() for
+ *  the manual lens and every eos_t lens, every ISO, EV -8..20 in 1/8 stops
+ *  and every Av or Tv in 1/24 stops:
+ *    - the result is within the lens and shutter limits, on the lens step
+ *      (in AV mode slower than 1 s too, a long exposure);
+ *    - err is av + tv - ev, and it is only off the rounding of the lens
+ *      step when a limit is hit;
+ *    - at whole stops it agrees with lookupTVindex() / lookupAVindex(),
+ *      apex_fault() where they have no answer, and the program with
+ *      lookupProgram() at every shift, for the lenses whose limits are
+ *      whole stops;
+ *    - Tv_speed[] holds apex_tv_us() of its stops, and apex_tv_us() is
+ *      within 0.5 us + 0.01% of 1000000 * 2^(-tv/24).
+ *
+ *      make check
+ */
+#define SLR_TABLES /* the whole stop tables and their lookups, for the host only */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../slr_apex.h"
+#include "../slr_lens.h"
+
+static unsigned long errors, checked;
+
+#define CHECK(cond, ...) do{ checked++; if(!(cond) && errors++ < 20){ printf("FAIL " __VA_ARGS__); printf("\n"); } }while(0)
+
+static void check_limits(const char *what, const apex_lens_t *l, apex_t x, int16_t ev, int16_t in){
+	int16_t fast = APEX_TV(Tv_max_speed);
+	uint8_t clamped = (x.av == l->av_min) || (x.av == l->av_max) || (x.tv == 0) || (x.tv == fast);
+	CHECK(x.av >= l->av_min && x.av <= l->av_max && (x.av - l->av_min) % l->step == 0,
+		"%s ev %d in %d: av %d out of the lens", what, ev, in, x.av);
+	CHECK((x.tv >= 0 || what[0] == 'A') && x.tv <= fast, "%s ev %d in %d: tv %d out of the shutter", what, ev, in, x.tv);
+	CHECK(x.err == x.av + x.tv - ev, "%s ev %d in %d: err %d", what, ev, in, x.err);
+	CHECK(clamped || (2 * abs(x.err) <= l->step), "%s ev %d in %d: err %d with no limit hit", what, ev, in, x.err);
+}
+
+/* solveExposure() of x in the mode, with the Av or Tv set */
+static apex_t solve(exposure_t *x, cameramode_t mode, int16_t set){
+	x->mode = mode;
+	if(mode == TV) x->tv = set;
+	else x->av = set;
+	return solveExposure(x);
+}
+
+int main(void){
+	int8_t lens, k;
+	uint8_t iso;
+	int16_t ev8, in, tv;
+
+	/* -1: the manual lens */
+	for(lens = -1; lens < (int8_t)EOS_MODELS; lens++){
+		apex_lens_t l;
+		exposure_t x = SLR_Exp;
+		uint8_t line = (lens < 0) ? SLR_P_LINES - 1 : (uint8_t)lens, lim = SLR_ProgramLimits[line];
+		x.lens = (lens < 0) ? MANUAL : EOS;
+		x.eos = (lens < 0) ? EOS50MM12 : (eos_t)lens;
+		x.shift = 0;
+		apex_lens(&x, &l);
+		for(iso = 0; iso < 8; iso++)
+			for(ev8 = -8 * 8; ev8 <= 20 * 8; ev8++){
+				int16_t ev = apex_ev24(ev8, iso);
+				x.iso = iso;
+				x.ev8 = ev8;
+				check_limits("P", &l, solve(&x, PR, 0), ev, 0);
+				for(in = -2 * APEX_UNIT; in <= 16 * APEX_UNIT; in++){
+					check_limits("AV", &l, solve(&x, AV, in), ev, in);
+					check_limits("TV", &l, solve(&x, TV, in), ev, in);
+				}
+				if((ev8 & 7) || ev8 < 0 || ev8 > 15 * 8) continue;
+				/* the program line, where its limits are the lens' */
+				if(l.av_min == APEX_AV(lim & 0x0F) && l.av_max == APEX_AV(lim >> 4))
+					for(k = -15; k <= 15; k++){
+						uint8_t p = lookupProgram(line, iso, ev8 >> 3, k);
+						apex_t s;
+						x.shift = k;
+						s = solve(&x, PR, 0);
+						x.shift = 0;
+						CHECK(s.av == APEX_AV(p & 0x0F) && s.tv == APEX_TV(p >> 4),
+							"PR lens %d ISO %u EV %d shift %d: av %d tv %d, line %u/%u",
+							lens, ISO_values[iso], ev8 >> 3, k, s.av, s.tv, p & 0x0F, p >> 4);
+					}
+				/* the tables (the manual lens only, they don't know the EF ones) */
+				if(lens < 0){
+					uint8_t e = ev8 >> 3, i, t;
+					for(i = 1; i <= 13; i++){
+						apex_t s = solve(&x, AV, APEX_AV(i));
+						t = lookupTVindex(iso, i, e);
+						if(t && t < 15){
+							CHECK(s.err == 0 && s.tv == APEX_TV(t),
+								"AV ISO %u Av %u EV %u: tv %d, table %u", ISO_values[iso], i, e, s.tv, t);
+						}else if(t == 15){
+							CHECK(s.err == 0 && s.tv < 0, "AV ISO %u Av %u EV %u: tv %d, table slower than 1 s",
+								ISO_values[iso], i, e, s.tv);
+						}else{
+							CHECK(apex_fault(AV, &s) == APEX_NO_SPEED, "AV ISO %u Av %u EV %u: solved, table can't",
+								ISO_values[iso], i, e);
+						}
+						if(i > 14 || i < Tv_max_speed) continue;
+						s = solve(&x, TV, APEX_TV(i));
+						t = lookupAVindex(iso, i, e);
+						if(t){
+							CHECK(s.err == 0 && s.av == APEX_AV(t),
+								"TV ISO %u Tv %u EV %u: av %d, table %u", ISO_values[iso], i, e, s.av, t);
+						}else{
+							CHECK(apex_fault(TV, &s) == APEX_NO_APERTURE, "TV ISO %u Tv %u EV %u: solved, table can't",
+								ISO_values[iso], i, e);
+						}
+					}
+				}
+			}
+	}
+	for(in = 1; in <= 14; in++)
+		CHECK(Tv_speed[in] == apex_tv_us(APEX_TV(in)), "Tv_speed[%d] = %u, apex_tv_us() %u", in, Tv_speed[in], apex_tv_us(APEX_TV(in)));
+	for(tv = -12 * APEX_UNIT; tv <= 14 * APEX_UNIT; tv++){
+		double want = 1e6 * pow(2.0, -tv / 24.0);
+		uint32_t got = apex_tv_us(tv);
+		CHECK(fabs(got - want) <= 0.5 + want * 1e-4, "apex_tv_us(%d) = %u, want %.1f", tv, got, want);
+	}
+	printf("APEX solver: %lu checks, %lu errors\n", checked, errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,217 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Check of the batch engine (host/slr_batch.h) against the firmware path,
+ *  getEV() on SLR_Exp then solveExposure(), with every kernel this CPU
+ *  runs:
+ *    - the EV of every lux up to 2^22/256, of the 32 around every 1/8 stop
+ *      step up to the top of Q24.8, and of 2^24 random ones - or of all
+ *      2^32 with "check_batch all";
+ *    - the solve of every mode with the manual lens, of AV, TV and the
+ *      program with every EF lens (the program at every shift), for every
+ *      ISO (and one past the table) and every Av or Tv in 1/24 stops, and
+ *      some way past the lens and the shutter, at EVs in 1/8 stops, from
+ *      arrays and from x;
+ *    - a pool of 1 to 4 threads giving what a single kernel gives, over
+ *      lengths that don't end on a chunk.
+ *
+ *      make check
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "slr_batch.h"
+
+#define BLOCK (1u << 20)
+
+static unsigned long errors, checked;
+
+#define CHECK(cond, ...) do{ checked++; if(!(cond) && errors++ < 20){ printf("FAIL " __VA_ARGS__); printf("\n"); } }while(0)
+
+static uint32_t lux[BLOCK];
+static int16_t  ev8[BLOCK];
+static uint8_t  ev[BLOCK], iso[BLOCK], out_ev[BLOCK];
+static int16_t  set[BLOCK], out_ev8[BLOCK];
+static apex_t   solved[BLOCK], out_solved[BLOCK];
+
+static uint32_t seed = 21;
+static uint32_t rnd(void){
+	uint32_t hi;
+	seed = seed * 1103515245u + 12345u;
+	hi = seed >> 16;
+	seed = seed * 1103515245u + 12345u;
+	return (hi << 16) | (seed >> 16);
+}
+
+static batch_t batch(size_t n, const exposure_t *x, uint8_t arrays){
+	batch_t b;
+	memset(&b, 0, sizeof(b));
+	b.n = n;
+	b.lux = lux;
+	b.iso = arrays ? iso : NULL;
+	b.set = arrays ? set : NULL;
+	b.x = *x;
+	b.ev8 = out_ev8;
+	b.ev = out_ev;
+	b.solved = out_solved;
+	return b;
+}
+
+/* the EV of n lux on every kernel */
+static void check_ev(size_t n, batch_isa_t best){
+	exposure_t x = SLR_Exp;
+	batch_t b = batch(n, &x, 0);
+	size_t i;
+	batch_isa_t k;
+	b.solved = NULL;
+	for(i = 0; i < n; i++){
+		getEV(lux[i]);
+		ev8[i] = SLR_EV8;
+		ev[i] = SLR_EV;
+	}
+	for(k = BATCH_SCALAR; k <= best; k++){
+		memset(out_ev8, 0x55, n * sizeof(int16_t));
+		memset(out_ev, 0x55, n);
+		batch_run(&b, k);
+		for(i = 0; i < n; i++)
+			CHECK((out_ev8[i] == ev8[i]) && (out_ev[i] == ev[i]), "%s: lux %u/256 EV8 %d EV %u, getEV() %d %u",
+				Batch_isa_names[k], lux[i], out_ev8[i], out_ev[i], ev8[i], ev[i]);
+	}
+}
+
+/* the solves of n samples on every kernel, with the arrays and without */
+static void check_solve(size_t n, const exposure_t *x, batch_isa_t best){
+	uint8_t arrays;
+	batch_isa_t k;
+	size_t i;
+	for(arrays = 0; arrays < 2; arrays++){
+		batch_t b = batch(n, x, arrays);
+		for(i = 0; i < n; i++){
+			exposure_t e;
+			SLR_Exp = *x;
+			if(arrays){
+				SLR_ISO = iso[i];
+				if(x->mode == TV) SLR_Tv = set[i];
+				else SLR_Av = set[i];
+			}
+			getEV(lux[i]);
+			e = SLR_Exp;
+			solved[i] = solveExposure(&e);
+		}
+		for(k = BATCH_SCALAR; k <= best; k++){
+			memset(out_solved, 0x55, n * sizeof(apex_t));
+			batch_run(&b, k);
+			for(i = 0; i < n; i++)
+				CHECK((out_solved[i].av == solved[i].av) && (out_solved[i].tv == solved[i].tv) && (out_solved[i].err == solved[i].err),
+					"%s: mode %u lens %u/%u shift %d ISO %u set %d EV8 %d: Av %d Tv %d err %d, firmware %d %d %d",
+					Batch_isa_names[k], x->mode, x->lens, x->eos, x->shift, b.iso ? iso[i] : x->iso,
+					b.set ? set[i] : ((x->mode == TV) ? x->tv : x->av), out_ev8[i],
+					out_solved[i].av, out_solved[i].tv, out_solved[i].err, solved[i].av, solved[i].tv, solved[i].err);
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	batch_isa_t best = batch_isa_best();
+	uint64_t l;
+	size_t n, i;
+	int16_t s;
+	uint8_t mode, lens, t;
+
+	printf("kernels up to %s\n", Batch_isa_names[best]);
+	slr_init();
+
+	/* -- EV ------------------------------------------------------------- */
+	if((argc > 1) && !strcmp(argv[1], "all")){
+		for(l = 0; l < ((uint64_t)1 << 32); l += n){
+			for(n = 0; n < BLOCK; n++) lux[n] = (uint32_t)(l + n);
+			check_ev(BLOCK, best);
+		}
+	}else{
+		for(l = 0; l < (1u << 22); l += BLOCK){
+			for(n = 0; n < BLOCK; n++) lux[n] = (uint32_t)(l + n);
+			check_ev(BLOCK, best);
+		}
+		/* the steps, at 448/256 lux 2^(ev8/8) */
+		for(n = 0, s = -71; s <= 23 * 8 + 1; s++){
+			double at = 448.0 * pow(2.0, s / 8.0);
+			for(i = 0; i < 32; i++){
+				double v = floor(at) - 15 + i;
+				if(v >= 0 && v <= UINT32_MAX) lux[n++] = (uint32_t)v;
+			}
+		}
+		lux[n++] = UINT32_MAX;
+		check_ev(n, best);
+		for(i = 0; i < 16; i++){
+			for(n = 0; n < BLOCK; n++) lux[n] = rnd() >> (rnd() & 31);
+			check_ev(BLOCK, best);
+		}
+	}
+
+	/* -- solves --------------------------------------------------------- */
+	/* every ISO and set, the lens and shutter range and past them, at EVs
+	 * from below the meter to above it */
+	for(n = 0, s = -41; s <= 390; s++)
+		for(i = 0; i < 10; i++)
+			for(t = 0; t < 6; t++){
+				set[n] = (s < -40) ? -2000 : (s > 389) ? 2000 : s;
+				iso[n] = (i < 9) ? i : 255;
+				lux[n++] = (uint32_t)(448.0 * pow(2.0, (rnd() % (24 * 8)) / 8.0 - 4.0) + (rnd() & 0xFF));
+			}
+	for(mode = IS; mode <= PR; mode++){
+		exposure_t x = SLR_Exp;
+		x.mode = (cameramode_t)mode;
+		x.lens = MANUAL;
+		x.iso = 3;
+		x.av = APEX_AV(5);
+		x.tv = APEX_TV(7);
+		check_solve(n, &x, best);
+		if(mode <= MA){
+			x.tv = APEX_BULB;
+			check_solve(n, &x, best);
+		}
+		if(mode < AV) continue;
+		for(lens = 0; lens <= EOS85MM18; lens++){
+			x.lens = EOS;
+			x.eos = (eos_t)lens;
+			for(s = (mode == PR) ? -15 : 0; s <= ((mode == PR) ? 15 : 0); s++){
+				x.shift = (int8_t)s;
+				check_solve(n, &x, best);
+			}
+		}
+	}
+
+	/* -- the pool -------------------------------------------------------- */
+	for(i = 0; i < BLOCK; i++){
+		lux[i] = rnd() >> (rnd() & 31);
+		iso[i] = rnd() % 8;
+		set[i] = APEX_AV(1) + rnd() % (APEX_AV(14) + 1);
+	}
+	for(t = 1; t <= 4; t++){
+		batch_pool_t pool;
+		exposure_t x = SLR_Exp;
+		static int16_t ev8s[BLOCK];
+		static uint8_t evs[BLOCK];
+		static apex_t solveds[BLOCK];
+		x.mode = AV;
+		if(!batch_pool_init(&pool, t, best)){ printf("FAIL can't start %u threads\n", t); return 1; }
+		for(n = BLOCK - 3; n > 1000; n = n / 3 + 5){
+			batch_t b = batch(n, &x, 1);
+			b.ev8 = ev8s; b.ev = evs; b.solved = solveds;
+			batch_run(&b, BATCH_SCALAR);
+			b.ev8 = out_ev8; b.ev = out_ev; b.solved = out_solved;
+			memset(out_ev8, 0x55, n * sizeof(int16_t));
+			memset(out_ev, 0x55, n);
+			memset(out_solved, 0x55, n * sizeof(apex_t));
+			batch_pool_run(&pool, &b);
+			CHECK(!memcmp(out_ev8, ev8s, n * sizeof(int16_t)) && !memcmp(out_ev, evs, n) && !memcmp(out_solved, solveds, n * sizeof(apex_t)),
+				"%u threads, %zu samples: not the kernel's results", t, n);
+		}
+		batch_pool_free(&pool);
+	}
+
+	printf("batch engine: %lu checks, %lu errors\n", checked, errors);
+	return errors ? 1 : 0;
+}
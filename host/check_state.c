@@ -0,0 +1,124 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Stress test of the exposure state publish (slr_publish / slr_snapshot
+ *  of slr.h). The main loop writes random states through the SLR_* names
+ *  and publishes each, as fast as it can; a timer signal every 10 us plays
+ *  the interrupt preempting it anywhere, and checks the lux field, written
+ *  last as a checksum of the others. Each signal also reads the working
+ *  copy field by field, as the plain globals used to be read, and reports
+ *  how often that tears. Then the same run with a broken publish, the
+ *  fields copied in place into the published buffer with no sequence
+ *  bump: the snapshot check must catch it tearing, or it proves nothing.
+ *  Fails on a torn snapshot of slr_publish(), or on none of the broken
+ *  one.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "../slr.h"
+
+#define SAMPLES 200000
+
+static volatile uint32_t samples, torn, plain_torn, moved;
+
+static uint32_t mix(uint8_t ev, int16_t ev8, uint8_t iso, int16_t av, int16_t tv,
+                    int8_t shift, uint8_t lens, uint8_t eos, uint8_t mode){
+	uint32_t h = 2166136261u;
+	h = (h ^ ev) * 16777619u;    h = (h ^ (uint16_t)ev8) * 16777619u;
+	h = (h ^ iso) * 16777619u;   h = (h ^ (uint16_t)av) * 16777619u;
+	h = (h ^ (uint16_t)tv) * 16777619u; h = (h ^ (uint8_t)shift) * 16777619u;
+	h = (h ^ lens) * 16777619u;  h = (h ^ eos) * 16777619u;
+	return (h ^ mode) * 16777619u;
+}
+
+/* the working copy, one field after the other */
+static uint8_t plain_read_torn(void){
+	return SLR_LUX != mix(SLR_EV, SLR_EV8, SLR_ISO, SLR_Av, SLR_Tv, SLR_Shift, SLR_LensType, SLR_EOSModel, SLR_Mode);
+}
+
+/* the interrupt */
+static void isr(int sig){
+	exposure_t x;
+	uint32_t seq = SLR_State.seq;
+	(void)sig;
+	slr_snapshot(&x);
+	if(x.lux != mix(x.ev, x.ev8, x.iso, x.av, x.tv, x.shift, x.lens, x.eos, x.mode)) torn++;
+	if(SLR_State.seq != seq) moved++;   /* the writer can't run in here */
+	if(plain_read_torn()) plain_torn++;
+	samples++;
+}
+
+/* the publish without its sequence: the fields copied one by one into
+ * the buffer the readers take */
+static void publish_in_place(void){
+	volatile exposure_t *b = &SLR_State.buf[SLR_State.seq & 1];
+	b->ev = SLR_EV;   b->ev8 = SLR_EV8; b->iso = SLR_ISO;
+	b->av = SLR_Av;   b->tv = SLR_Tv;   b->shift = SLR_Shift;
+	b->lens = SLR_LensType; b->eos = SLR_EOSModel; b->mode = SLR_Mode;
+	b->lux = SLR_LUX;
+}
+
+/* random states published with publish(), until SAMPLES interrupts or
+ * 10 s - returns the states */
+static uint32_t run(void (*publish)(void)){
+	struct itimerval it;
+	uint32_t writes = 0, r = 1;
+	time_t t0 = time(NULL);
+
+	slr_init();
+	SLR_LUX = mix(SLR_EV, SLR_EV8, SLR_ISO, SLR_Av, SLR_Tv, SLR_Shift, SLR_LensType, SLR_EOSModel, SLR_Mode);
+	slr_publish();
+	samples = torn = plain_torn = moved = 0;
+
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = 10;
+	it.it_value = it.it_interval;
+	setitimer(ITIMER_REAL, &it, NULL);
+
+	while(samples < SAMPLES && time(NULL) - t0 < 10){
+		r = r * 1103515245u + 12345u;
+		SLR_EV    = (r >> 8) & 15;
+		SLR_EV8   = (int16_t)(r >> 12) % 200;
+		SLR_ISO   = (r >> 16) & 7;
+		SLR_Av    = (int16_t)((r >> 19) % (APEX_AV(14) + 1));
+		SLR_Tv    = (int16_t)((r >> 23) % (APEX_TV(1) + 1));
+		SLR_Shift = (int8_t)((r >> 27) & 15) - 7;
+		SLR_LensType = (lens_t)((r >> 24) & 1);
+		SLR_EOSModel = (eos_t)((r >> 25) % 5);
+		SLR_Mode  = (cameramode_t)((r >> 28) % 6);
+		SLR_LUX   = mix(SLR_EV, SLR_EV8, SLR_ISO, SLR_Av, SLR_Tv, SLR_Shift, SLR_LensType, SLR_EOSModel, SLR_Mode);
+		publish();
+		writes++;
+	}
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_REAL, &it, NULL);
+	return writes;
+}
+
+int main(void){
+	struct sigaction sa;
+	uint32_t writes;
+	int fails = 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = isr;
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &sa, NULL);
+
+	writes = run(slr_publish);
+	printf("%u states published, %u interrupts: %u torn snapshots, %u publishes under an interrupt; "
+		"%u torn field by field reads\n", writes, samples, torn, moved, plain_torn);
+	if(samples < SAMPLES / 10){ printf("FAIL too few interrupts\n"); fails++; }
+	if(torn || moved){ printf("FAIL torn snapshot\n"); fails++; }
+	if(!plain_torn) printf("warning: no interrupt landed in the middle of a write\n");
+
+	writes = run(publish_in_place);
+	printf("broken publish, in place: %u states, %u interrupts, %u torn snapshots\n", writes, samples, torn);
+	if(!torn){ printf("FAIL the snapshot check missed a broken publish, it proves nothing\n"); fails++; }
+	return fails ? 1 : 0;
+}
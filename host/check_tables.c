@@ -0,0 +1,151 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Exhaustive check of the exposure tables against the APEX equation
+ *  Av + Tv = Ev + Sv, computed independently from Av_values[] (f-numbers),
+ *  Tv_markings[] (1/x seconds) and ISO_values[]:
+ *
+ *      Av = 2 log2(N)   Tv = -log2(t)   Sv = log2(ISO / 3.125)
+ *
+ *  The metered EV of the tables is referred to ISO 100 (Sv = 5).
+ *  Every ISO x Av x EV and ISO x Tv x EV entry of SLR_ExpTable is checked,
+ *  then lookupTVindex() / lookupAVindex() against the clamping rules.
+ *  Then every program line against the EOSEF* array of its lens: inside
+ *  the lens and shutter range, the exposure right unless clamped at an
+ *  end, wide open below the handheld speed and at the handheld speed until
+ *  the aperture runs out - and the program shift along the line.
+ *  Then getEV8() on both sides of every 1/8 stop step of the 32 bit lux
+ *  range, floor(8 log2(LUX / 448)), and never going down between them.
+ *
+ *      make check
+ */
+#define SLR_TABLES /* the whole stop tables and their lookups, for the host only */
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "../slr.h"
+
+static int errors;
+
+static int apex_av(uint8_t av){ return (int)lround(2.0 * log2(Av_values[av] / 10.0)); }
+static int apex_sv(uint8_t iso){ return (int)lround(log2(ISO_values[iso] / 3.125)); }
+static int apex_tv(uint8_t tv){
+	/* indices 1..13 are fractions of a second, 14 is one second */
+	double t = (tv == 14) ? 1.0 : 1.0 / Tv_markings[tv];
+	return (int)lround(-log2(t));
+}
+
+/* the Tv_speed[] index for an APEX Tv, 0 if faster than 1/8000, 15 if slower than 1s */
+static uint8_t tv_index(int tv){
+	uint8_t i;
+	if(tv > apex_tv(1))  return 0;
+	if(tv < apex_tv(14)) return 15;
+	for(i = 1; i <= 14; i++) if(apex_tv(i) == tv) return i;
+	return 0xFF;
+}
+
+/* the Av_values[] index for an APEX Av, 0 if not between f/1 and f/64 */
+static uint8_t av_index(int av){
+	uint8_t i;
+	for(i = 1; i <= 13; i++) if(apex_av(i) == av) return i;
+	return 0;
+}
+
+static uint8_t raw(uint16_t row, uint8_t ev){
+	return (SLR_ExpTable[row * SLR_ROW_BYTES + (ev >> 1)] >> ((ev & 1) << 2)) & 0x0F;
+}
+
+static void fail(const char *what, uint8_t iso, uint8_t idx, uint8_t ev, uint8_t got, uint8_t want){
+	if(errors++ < 20)
+		printf("FAIL %s ISO %u idx %u EV %u: got %u, want %u\n",
+			what, ISO_values[iso], idx, ev, got, want);
+}
+
+int main(void){
+	uint8_t iso, i, ev, got, want;
+	uint32_t checked = 0;
+
+	for(iso = 0; iso < SLR_ISO_ROWS; iso++)
+		for(ev = 0; ev <= 15; ev++){
+			int ev_iso = ev + apex_sv(iso) - 5;
+			/* aperture priority: the speed for each aperture */
+			for(i = 1; i <= SLR_AV_ROWS; i++){
+				want = tv_index(ev_iso - apex_av(i));
+				got  = raw(iso * SLR_AV_ROWS + i - 1, ev);
+				if(got != want) fail("Av table", iso, i, ev, got, want);
+				if(want && want < Tv_max_speed) want = 0;
+				if(i <= Av_min_aperture && (got = lookupTVindex(iso, i, ev)) != want)
+					fail("lookupTVindex", iso, i, ev, got, want);
+				checked++;
+			}
+			/* shutter priority: the aperture for each speed */
+			for(i = 1; i <= SLR_TV_ROWS; i++){
+				want = av_index(ev_iso - apex_tv(i));
+				got  = raw(SLR_TV_BASE / SLR_ROW_BYTES + iso * SLR_TV_ROWS + i - 1, ev);
+				if(got != want) fail("Tv table", iso, i, ev, got, want);
+				if(want > Av_min_aperture) want = 0;
+				if(i >= Tv_max_speed && (got = lookupAVindex(iso, i, ev)) != want)
+					fail("lookupAVindex", iso, i, ev, got, want);
+				checked++;
+			}
+		}
+
+	/* program lines */
+	for(i = 0; i < SLR_P_LINES; i++){
+		const int8_t *ap[SLR_P_LINES - 1] = {EOSEF50mm12, EOSEF50mm14, EOSEF50mm18, EOSEF85mm12, EOSEF85mm18};
+		uint8_t w = 1, c = Av_min_aperture, a, t;
+		int8_t shift;
+		if(i < SLR_P_LINES - 1){
+			while(ap[i][w] <= 0) w++;
+			c = ap[i][0];
+		}
+		if(SLR_ProgramLimits[i] != (w | (c << 4))) fail("program limits", 0, i, 0, SLR_ProgramLimits[i], w | (c << 4));
+		for(iso = 0; iso < SLR_ISO_ROWS; iso++)
+			for(ev = 0; ev <= 15; ev++){
+				got = lookupProgram(i, iso, ev, 0);
+				a = got & 0x0F;
+				t = got >> 4;
+				if(a < w || a > c || t < Tv_max_speed || t > 14
+				|| (t != a + 15 - ev - iso && !(a == c && t == Tv_max_speed) && !(a == w && t == 14))
+				|| (t > SLR_P_HAND && a != w) || (a > w && a < c && t != SLR_P_HAND))
+					fail("program line", iso, i, ev, got, 0);
+				for(shift = -15; shift <= 15; shift++){
+					uint8_t s = lookupProgram(i, iso, ev, shift), sa = s & 0x0F, st = s >> 4;
+					if(sa < w || sa > c || st < Tv_max_speed || st > 14 || sa - st != a - t
+					|| (shift > 0 && (a - sa > shift || (a - sa < shift && sa != w && st != Tv_max_speed)))
+					|| (shift < 0 && (sa - a > -shift || (sa - a < -shift && sa != c && st != 14))))
+						fail("program shift", iso, i, ev, s, got);
+				}
+				checked++;
+			}
+	}
+
+	/* getEV8(): the first LUX of every step at it, the one before under
+	 * it - with no step down anywhere, that is the exact floor for every
+	 * LUX. The first LUX from long double: none of the irrational
+	 * thresholds is near enough to an integer to fool it. */
+	{
+		int16_t s, last = getEV8(0);
+		uint64_t l;
+		if(last != -71) fail("getEV8 of 0", 0, 0, 0, (uint8_t)last, (uint8_t)-71);
+		for(s = -70; s <= 185; s++){
+			long double v = 448.0L * exp2l(s / 8.0L);
+			uint32_t c = (uint32_t)ceill(v);
+			if((ceill(v) - v > 0 && ceill(v) - v < 1e-6L) || (v - floorl(v) > 0 && v - floorl(v) < 1e-6L))
+				fail("getEV8 threshold too near an integer", 0, 0, 0, 0, 0);
+			if(getEV8(c) < s || getEV8(c - 1) >= s){
+				if(errors++ < 20) printf("FAIL getEV8 step %d: %u/256 lux gives %d, %u gives %d\n", s, c, getEV8(c), c - 1, getEV8(c - 1));
+			}
+			checked++;
+		}
+		if(getEV8(0xFFFFFFFFu) != 185) fail("getEV8 of 2^32 - 1", 0, 0, 0, (uint8_t)getEV8(0xFFFFFFFFu), 185);
+		for(l = 1; l <= 0xFFFFFFFFu; l += 4093){
+			int16_t g = getEV8((uint32_t)l);
+			if(g < last && errors++ < 20) printf("FAIL getEV8 down from %d to %d at %u/256 lux\n", last, g, (uint32_t)l);
+			last = g;
+		}
+	}
+
+	printf("exposure tables: %u entries checked, %d errors\n", checked, errors);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,597 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Mock HAL for the host build.
+ */
+#include <string.h>
+#include <math.h>
+#include "hal_mock.h"
+
+static uint32_t mock_us;
+static uint32_t mock_seed = 1;
+
+static uint32_t mock_rand(void){
+	mock_seed = mock_seed * 1103515245u + 12345u;
+	return mock_seed >> 8;
+}
+
+uint32_t hal_micros(void){
+	return mock_us;
+}
+
+void mock_set_us(uint32_t us){
+	mock_us = us;
+}
+
+void mock_advance_us(uint32_t us){
+	mock_us += us;
+}
+
+/* mock_us without its wraps */
+static uint64_t mock_us64;
+static uint32_t mock_us_seen;
+
+uint64_t mock_time_us(void){
+	mock_us64 += (uint32_t)(mock_us - mock_us_seen);
+	mock_us_seen = mock_us;
+	return mock_us64;
+}
+
+/* -- shutter timer ------------------------------------------------------ */
+void   (*mock_tim_isr)(uint8_t ch);
+uint32_t mock_isr_latency_us;
+uint32_t mock_curtain_us[2];
+uint32_t (*mock_curtain_delay)(uint8_t curtain, uint32_t gap);
+void   (*mock_light_isr)(uint8_t light, uint16_t capture);
+uint32_t mock_gate_us[2];
+uint64_t mock_curtain_at[2];
+
+static struct {
+	uint8_t  armed, pin;
+	uint32_t match; /* absolute time of the next match */
+} tim_ch[2];
+
+/* the phototransistor edges on their way: captured at, served at */
+static struct {
+	uint8_t  pending;
+	uint32_t at, serve;
+} gate[2];
+
+/* a curtain magnet lets go at t; the light edge at the gate follows */
+static void curtain(uint8_t c, uint32_t t){
+	mock_curtain_us[c] = t;
+	mock_curtain_at[c] = mock_time_us() - (uint32_t)(mock_us - t);
+	if(!mock_curtain_delay) return;
+	gate[c].at      = t + mock_curtain_delay(c, c ? t - mock_curtain_us[0] : 0);
+	gate[c].serve   = gate[c].at + (mock_isr_latency_us ? mock_rand() % (mock_isr_latency_us + 1) : 0);
+	gate[c].pending = 1;
+	mock_gate_us[c] = gate[c].at;
+}
+
+uint16_t hal_tim_now(void){
+	return (uint16_t)mock_us;
+}
+
+void hal_tim_arm(uint8_t ch, uint16_t at, uint8_t pin){
+	uint32_t delta = (uint16_t)(at - (uint16_t)mock_us);
+	if(delta == 0) delta = 0x10000; /* the counter has to come around */
+	tim_ch[ch].armed = 1;
+	tim_ch[ch].pin   = pin;
+	tim_ch[ch].match = mock_us + delta;
+}
+
+void hal_tim_disarm(uint8_t ch){
+	tim_ch[ch].armed = 0;
+}
+
+void hal_curtain_release(uint8_t c){
+	curtain(c, mock_us);
+}
+
+/* -- light sensor ------------------------------------------------------- */
+double (*mock_scene_lux)(uint32_t us);
+void   (*mock_sensor_isr)(void);
+void   (*mock_i2c_isr)(uint16_t ch0, uint16_t ch1);
+uint32_t mock_i2c_us = 120; /* 6 bytes at 400 kHz, with the address phase */
+uint32_t mock_sensor_samples;
+
+static const double mock_again[4] = {1.0, 25.0, 428.0, 9876.0};
+
+static struct {
+	uint8_t  on, gain, it;
+	uint32_t start, end;    /* current integration  */
+	uint16_t ch0, ch1;      /* data registers       */
+} sensor;
+
+static struct {
+	uint8_t  busy;
+	uint32_t done;
+	uint16_t ch0, ch1;
+} i2c;
+
+uint32_t mock_sensor_on_us;
+static uint32_t sensor_on_at;
+
+void hal_tsl2591_config(uint8_t gain, uint8_t it){
+	if(!sensor.on) sensor_on_at = mock_us;
+	sensor.on    = 1;
+	sensor.gain  = gain & 3;
+	sensor.it    = (it > 5) ? 5 : it;
+	sensor.start = mock_us;
+	sensor.end   = mock_us + (sensor.it + 1) * 100000u;
+}
+
+void hal_tsl2591_read(void){
+	i2c.busy = 1;
+	i2c.done = mock_us + mock_i2c_us;
+	i2c.ch0  = sensor.ch0;
+	i2c.ch1  = sensor.ch1;
+}
+
+void hal_tsl2591_off(void){
+	if(sensor.on) mock_sensor_on_us += mock_us - sensor_on_at;
+	sensor.on = 0;
+}
+
+uint8_t mock_sensor_powered(void){
+	return sensor.on;
+}
+
+/* counts of the integration just ended, from the mean scene lux over it */
+static void sensor_integrate(void){
+	double lux = 0, cpl, ch0;
+	uint32_t k, max = (sensor.it == 0) ? 37888 : 65535;
+	for(k = 0; k < 64; k++)
+		lux += mock_scene_lux ? mock_scene_lux(sensor.start + (sensor.end - sensor.start) * k / 64) : 0;
+	lux /= 64;
+	cpl = (sensor.it + 1) * 100.0 * mock_again[sensor.gain] / 408.0;
+	/* lux = ch0 (1 - r)^2 / cpl, with ch1 = r ch0 and r = 1/4 */
+	ch0 = lux * cpl / 0.5625;
+	ch0 *= 1.0 + ((double)(mock_rand() % 1001) - 500.0) / 100000.0;
+	sensor.ch0 = (ch0 >= max) ? (uint16_t)max : (uint16_t)(ch0 + 0.5);
+	sensor.ch1 = (ch0 / 4 >= max) ? (uint16_t)max : (uint16_t)(ch0 / 4 + 0.5);
+	mock_sensor_samples++;
+}
+
+/* -- flicker photodiode ------------------------------------------------ */
+void   (*mock_flicker_isr)(void);
+double   mock_photodiode_gain = 4.0;
+
+static struct {
+	uint8_t   busy;
+	uint16_t *buf, n, period;
+	uint32_t  start, done;
+} adc;
+
+void hal_flicker_burst(uint16_t *buf, uint16_t n, uint16_t period_us){
+	adc.busy   = 1;
+	adc.buf    = buf;
+	adc.n      = n;
+	adc.period = period_us;
+	adc.start  = mock_us;
+	adc.done   = mock_us + (uint32_t)n * period_us;
+}
+
+/* the conversions, at their times */
+static void adc_burst(void){
+	uint16_t i;
+	for(i = 0; i < adc.n; i++){
+		double c = mock_scene_lux ? mock_scene_lux(adc.start + (uint32_t)(i + 1) * adc.period) * mock_photodiode_gain : 0;
+		c *= 1.0 + ((double)(mock_rand() % 1001) - 500.0) / 100000.0;
+		c += (double)(mock_rand() % 5) - 2.0;
+		adc.buf[i] = (c <= 0) ? 0 : (c >= 4095) ? 4095 : (uint16_t)(c + 0.5);
+	}
+}
+
+/* -- EF lens ------------------------------------------------------------ */
+void   (*mock_lens_isr)(void);
+uint32_t mock_lens_byte_us   = 100;  /* 8 bits at 80 kHz, plus the gap   */
+uint32_t mock_lens_step_us   = 500;  /* f/1.4 to f/22 in about 30 ms     */
+uint32_t mock_lens_settle_us = 2000;
+uint16_t mock_lens_focal     = 50;
+uint8_t  mock_lens_wide      = 16;
+uint8_t  mock_lens_closed    = 80;
+int16_t  mock_lens_pos       = 16;
+uint32_t mock_lens_xfers, mock_lens_moves;
+
+static struct {
+	uint8_t  busy;
+	uint32_t done;
+} spi;
+
+void hal_lens_xfer(const uint8_t *tx, uint8_t *rx, uint8_t len){
+	uint32_t t = len * mock_lens_byte_us;
+	uint8_t i;
+	int16_t to;
+	for(i = 0; i < len; i++) rx[i] = 0;
+	switch(tx[0]){
+	case 0xA0:
+		if(len > 2){ rx[1] = mock_lens_focal >> 8; rx[2] = mock_lens_focal & 0xFF; }
+		break;
+	case 0xB0:
+		if(len > 2){ rx[1] = mock_lens_wide; rx[2] = mock_lens_closed; }
+		break;
+	case 0x13:
+		to = mock_lens_pos + (int8_t)tx[1];
+		if(to < mock_lens_wide) to = mock_lens_wide;
+		if(to > mock_lens_closed) to = mock_lens_closed;
+		t += ((to > mock_lens_pos) ? to - mock_lens_pos : mock_lens_pos - to) * mock_lens_step_us + mock_lens_settle_us;
+		mock_lens_pos = to;
+		mock_lens_moves++;
+		break;
+	}
+	mock_lens_xfers++;
+	spi.busy = 1;
+	spi.done = mock_us + t;
+}
+
+/* -- mirror ------------------------------------------------------------- */
+void   (*mock_mirror_isr)(uint8_t up);
+uint32_t mock_mirror_up_us   = 40000; /* 25 ms travel, 15 ms of bounce */
+uint32_t mock_mirror_down_us = 30000;
+
+static struct {
+	uint8_t  moving, up;
+	uint32_t done;
+} mirror;
+
+void hal_mirror(uint8_t up){
+	mirror.moving = 1;
+	mirror.up     = up;
+	mirror.done   = mock_us + (up ? mock_mirror_up_us : mock_mirror_down_us);
+}
+
+uint8_t mock_led_green;
+
+void hal_led_green(uint8_t on){
+	mock_led_green = on;
+}
+
+/* -- dials and buttons ------------------------------------------------- */
+const mock_edge_t *mock_input_trace;
+uint32_t mock_input_edges;
+uint32_t mock_input_latency_us;
+void   (*mock_input_isr)(uint8_t src, uint8_t pins, uint16_t capture);
+
+static struct {
+	uint32_t next;                  /* trace edge to come               */
+	uint8_t  pins[MOCK_INPUTS];
+	uint8_t  pending[MOCK_INPUTS];  /* capture flag set, isr not run    */
+	uint16_t capture[MOCK_INPUTS];
+	uint32_t serve[MOCK_INPUTS];    /* when the pending isr runs        */
+	uint8_t  src;                   /* the next one to run              */
+} input;
+
+void mock_input_start(const mock_edge_t *trace, uint32_t edges){
+	memset(&input, 0, sizeof(input));
+	mock_input_trace = trace;
+	mock_input_edges = edges;
+}
+
+/* the pins change; the first edge latches the capture and the flag */
+static void input_edge(void){
+	const mock_edge_t *e = &mock_input_trace[input.next++];
+	input.pins[e->src] = e->pins;
+	if(input.pending[e->src]) return;
+	input.pending[e->src] = 1;
+	input.capture[e->src] = (uint16_t)e->us;
+	input.serve[e->src]   = e->us + (mock_input_latency_us ? mock_rand() % (mock_input_latency_us + 1) : 0);
+}
+
+static uint32_t input_serve_time(uint8_t *pending){
+	uint8_t s;
+	*pending = 0;
+	for(s = 0; s < MOCK_INPUTS; s++){
+		if(!input.pending[s]) continue;
+		if(!*pending || (int32_t)(input.serve[s] - input.serve[input.src]) < 0) input.src = s;
+		*pending = 1;
+	}
+	return *pending ? input.serve[input.src] : 0;
+}
+
+/* -- UART --------------------------------------------------------------- */
+FILE *mock_uart;
+uint32_t mock_uart_overruns;
+static const uint8_t *uart_buf;   /* the write in flight */
+static uint16_t uart_len;
+
+/* the DMA reads the buffer as it sends it: here all of it when the
+ * write is over, the first time anyone asks */
+static void uart_done(void){
+	if(uart_buf) fwrite(uart_buf, 1, uart_len, mock_uart ? mock_uart : stdout);
+	uart_buf = NULL;
+}
+
+void hal_uart_write(const uint8_t *buf, uint16_t len){
+	if(uart_buf){ mock_uart_overruns++; uart_done(); }
+	uart_buf = buf;
+	uart_len = len;
+}
+
+uint8_t hal_uart_busy(void){
+	uart_done();
+	return 0;
+}
+
+/* -- display ------------------------------------------------------------ */
+void   (*mock_display_isr)(void);
+uint32_t mock_display_byte_us = 1;  /* 8 MHz SPI */
+uint32_t mock_display_bytes, mock_display_xfers;
+uint8_t  mock_display_ram[4][128];
+
+static struct {
+	uint8_t  busy;
+	uint32_t done;
+	uint8_t  x0, x1, p0, p1, x, p;  /* window and address of the data writes */
+	uint8_t  op, args;              /* command waiting for its arguments     */
+	uint8_t  arg[2];
+} oled;
+
+/* SSD1306 commands: the ones with arguments, and the addressing window */
+static void oled_cmd(uint8_t b){
+	if(oled.args){
+		oled.arg[oled.op == 0x21 || oled.op == 0x22 ? 2 - oled.args : 0] = b;
+		if(--oled.args) return;
+		if(oled.op == 0x21){ oled.x0 = oled.x = oled.arg[0] & 127; oled.x1 = oled.arg[1] & 127; }
+		if(oled.op == 0x22){ oled.p0 = oled.p = oled.arg[0] & 3;   oled.p1 = oled.arg[1] & 3; }
+		return;
+	}
+	oled.op = b;
+	if(b == 0x21 || b == 0x22) oled.args = 2;
+	else if(b == 0x20 || b == 0x81 || b == 0x8D || b == 0xA8 || b == 0xD3 || b == 0xD5 || b == 0xD9 || b == 0xDA || b == 0xDB) oled.args = 1;
+}
+
+/* horizontal addressing: along the window, then the next page of it */
+static void oled_data(uint8_t b){
+	mock_display_ram[oled.p][oled.x] = b;
+	if(oled.x < oled.x1){ oled.x++; return; }
+	oled.x = oled.x0;
+	oled.p = (oled.p < oled.p1) ? oled.p + 1 : oled.p0;
+}
+
+void hal_display_xfer(uint8_t data, const uint8_t *buf, uint16_t len){
+	uint16_t i;
+	for(i = 0; i < len; i++){
+		if(data) oled_data(buf[i]);
+		else     oled_cmd(buf[i]);
+	}
+	mock_display_bytes += len;
+	mock_display_xfers++;
+	oled.busy = 1;
+	oled.done = mock_us + len * mock_display_byte_us;
+}
+
+void mock_display_reset(void){
+	uint8_t p, x;
+	memset(&oled, 0, sizeof(oled));
+	oled.x1 = 127;
+	oled.p1 = 3;
+	/* the memory of a display just powered is anything */
+	for(p = 0; p < 4; p++)
+		for(x = 0; x < 128; x++) mock_display_ram[p][x] = (uint8_t)mock_rand();
+}
+
+int mock_display_save(const char *path, uint8_t scale){
+	FILE *f = fopen(path, "w");
+	uint16_t x, y;
+	if(!f) return -1;
+	fprintf(f, "P1\n# SSD1306 128x32, x%u\n%u %u\n", scale, 128 * scale, 32 * scale);
+	for(y = 0; y < 32 * scale; y++){
+		for(x = 0; x < 128 * scale; x++){
+			uint8_t r = y / scale;
+			fputc((mock_display_ram[r >> 3][x / scale] >> (r & 7)) & 1 ? '1' : '0', f);
+		}
+		fputc('\n', f);
+	}
+	return fclose(f);
+}
+
+/* -- data EEPROM -------------------------------------------------------- */
+void   (*mock_eeprom_isr)(void);
+uint32_t mock_eeprom_write_us = 3300;
+uint32_t mock_eeprom[MOCK_EEPROM_WORDS];
+uint32_t mock_eeprom_wear[MOCK_EEPROM_WORDS];
+uint32_t mock_eeprom_writes, mock_eeprom_errors;
+
+static struct {
+	uint8_t  busy;
+	uint16_t word;
+	uint32_t data, done;
+} nvm;
+
+uint32_t hal_eeprom_read(uint16_t word){
+	return (word < MOCK_EEPROM_WORDS) ? mock_eeprom[word] : 0;
+}
+
+void hal_eeprom_write(uint16_t word, uint32_t data){
+	if(nvm.busy || (word >= MOCK_EEPROM_WORDS)){ mock_eeprom_errors++; return; }
+	nvm.busy = 1;
+	nvm.word = word;
+	nvm.data = data;
+	nvm.done = mock_us + mock_eeprom_write_us;
+	mock_eeprom_writes++;
+}
+
+void mock_eeprom_cut(void){
+	nvm.busy = 0;
+}
+
+/* -- RTC ---------------------------------------------------------------- */
+void   (*mock_rtc_isr)(void);
+double   mock_rtc_ppm;
+
+static struct {
+	uint8_t  armed;
+	uint32_t at;   /* when the count reaches the alarm, mock_us */
+} rtc;
+
+/* ticks a microsecond */
+static double rtc_rate(void){
+	return 32768e-6 * (1.0 + mock_rtc_ppm * 1e-6);
+}
+
+uint32_t hal_rtc_ticks(void){
+	return (uint32_t)(uint64_t)floor(mock_time_us() * rtc_rate());
+}
+
+void hal_rtc_alarm(uint32_t tick){
+	uint64_t now = (uint64_t)floor(mock_time_us() * rtc_rate());
+	/* the next time the 32 bit count matches, up to 36 h ahead */
+	uint64_t at = now + (uint32_t)(tick - (uint32_t)now);
+	if(at == now) at += 1ull << 32;
+	rtc.at    = (uint32_t)(uint64_t)ceil(at / rtc_rate());
+	rtc.armed = 1;
+}
+
+void hal_rtc_alarm_off(void){
+	rtc.armed = 0;
+}
+
+/* -- event loop --------------------------------------------------------- */
+/* Serves the events of the simulated peripherals in time order up to
+ * mock_us + us. An interrupt runs after its latency, or after the one in
+ * progress; the hardware side (compare outputs, sensor registers) happens
+ * exactly at the event time.
+ */
+enum { EV_TIM0 = 0, EV_TIM1, EV_SENSOR, EV_I2C, EV_LENS, EV_MIRROR, EV_EDGE, EV_INPUT, EV_DISPLAY, EV_EEPROM, EV_GATE0, EV_GATE1, EV_RTC, EV_ADC, EV_NONE};
+
+static uint32_t event_time(uint8_t e, uint8_t *pending){
+	switch(e){
+	case EV_TIM0:
+	case EV_TIM1:   *pending = tim_ch[e].armed; return tim_ch[e].match;
+	case EV_SENSOR: *pending = sensor.on;       return sensor.end;
+	case EV_I2C:    *pending = i2c.busy;        return i2c.done;
+	case EV_LENS:   *pending = spi.busy;        return spi.done;
+	case EV_MIRROR: *pending = mirror.moving;   return mirror.done;
+	case EV_EDGE:
+		*pending = input.next < mock_input_edges;
+		return *pending ? mock_input_trace[input.next].us : 0;
+	case EV_DISPLAY:*pending = oled.busy;       return oled.done;
+	case EV_EEPROM: *pending = nvm.busy;        return nvm.done;
+	case EV_GATE0:
+	case EV_GATE1:  *pending = gate[e - EV_GATE0].pending; return gate[e - EV_GATE0].serve;
+	case EV_RTC:    *pending = rtc.armed;       return rtc.at;
+	case EV_ADC:    *pending = adc.busy;        return adc.done;
+	default:        return input_serve_time(pending);
+	}
+}
+
+/* the next pending event and its time, EV_NONE if there is none */
+static uint8_t next_event(uint32_t *t){
+	uint8_t e, next = EV_NONE, pending;
+	uint32_t te;
+	*t = 0;
+	for(e = 0; e < EV_NONE; e++){
+		te = event_time(e, &pending);
+		if(pending && (next == EV_NONE || (int32_t)(te - *t) < 0)){ next = e; *t = te; }
+	}
+	return next;
+}
+
+static void serve(uint8_t e, uint32_t t){
+	if((int32_t)(t - mock_us) > 0) mock_us = t;
+	mock_time_us();
+	switch(e){
+	case EV_TIM0:
+	case EV_TIM1:
+		if(tim_ch[e].pin) curtain(e, t);
+		/* a compare channel matches again one counter period later */
+		tim_ch[e].match += 0x10000;
+		if(mock_isr_latency_us) mock_us += mock_rand() % (mock_isr_latency_us + 1);
+		if(mock_tim_isr) mock_tim_isr(e);
+		break;
+	case EV_SENSOR:
+		sensor_integrate();
+		sensor.start = sensor.end;
+		sensor.end  += (sensor.it + 1) * 100000u;
+		if(mock_sensor_isr) mock_sensor_isr();
+		break;
+	case EV_I2C:
+		i2c.busy = 0;
+		if(mock_i2c_isr) mock_i2c_isr(i2c.ch0, i2c.ch1);
+		break;
+	case EV_LENS:
+		spi.busy = 0;
+		if(mock_lens_isr) mock_lens_isr();
+		break;
+	case EV_MIRROR:
+		mirror.moving = 0;
+		if(mock_mirror_isr) mock_mirror_isr(mirror.up);
+		break;
+	case EV_EDGE:
+		input_edge();
+		break;
+	case EV_INPUT:
+		input.pending[input.src] = 0;
+		if(mock_input_isr) mock_input_isr(input.src, input.pins[input.src], input.capture[input.src]);
+		break;
+	case EV_DISPLAY:
+		oled.busy = 0;
+		if(mock_display_isr) mock_display_isr();
+		break;
+	case EV_EEPROM:
+		nvm.busy = 0;
+		mock_eeprom[nvm.word] = nvm.data;
+		mock_eeprom_wear[nvm.word]++;
+		if(mock_eeprom_isr) mock_eeprom_isr();
+		break;
+	case EV_GATE0:
+	case EV_GATE1:
+		gate[e - EV_GATE0].pending = 0;
+		if(mock_light_isr) mock_light_isr(e == EV_GATE0, (uint16_t)gate[e - EV_GATE0].at);
+		break;
+	case EV_RTC:
+		rtc.armed = 0;
+		if(mock_rtc_isr) mock_rtc_isr();
+		break;
+	case EV_ADC:
+		adc.busy = 0;
+		adc_burst();
+		if(mock_flicker_isr) mock_flicker_isr();
+		break;
+	}
+}
+
+void mock_run_us(uint32_t us){
+	uint32_t end = mock_us + us, t;
+	for(;;){
+		uint8_t next = next_event(&t);
+		if(next == EV_NONE || (int32_t)(t - end) > 0) break;
+		serve(next, t);
+	}
+	if((int32_t)(end - mock_us) > 0) mock_us = end;
+}
+
+/* -- power -------------------------------------------------------------- */
+uint32_t mock_sleep_us[2];
+uint32_t mock_stop_wake_us = 10;
+uint32_t mock_stop_errors;
+uint32_t mock_sleeps[2];
+
+void hal_irq_disable(void){}
+void hal_irq_enable(void){}
+
+/* Sleeps up to the next interrupt and serves it; pin edges alone don't
+ * wake. In Stop mode only the EXTI lines of the dials and buttons and the
+ * RTC alarm may wake it: anything else coming is a firmware bug (a timer or a DMA with
+ * its clock off, a sensor read started on the wake clock), counted in
+ * mock_stop_errors. The interrupt runs mock_stop_wake_us late, the time
+ * the regulator and the clock take to come back.
+ */
+void hal_sleep(uint8_t deep){
+	uint32_t t0 = mock_us, t;
+	uint8_t e;
+	deep = deep ? 1 : 0;
+	mock_sleeps[deep]++;
+	for(;;){
+		e = next_event(&t);
+		if(e != EV_EDGE) break;
+		serve(e, t);
+	}
+	if(e == EV_NONE) return;
+	if(deep && (e != EV_INPUT) && (e != EV_RTC)) mock_stop_errors++;
+	if((int32_t)(t - mock_us) > 0) mock_us = t;
+	mock_sleep_us[deep] += mock_us - t0;
+	if(deep) mock_us += mock_stop_wake_us;
+	serve(e, mock_us);
+}
@@ -0,0 +1,155 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Mock HAL for the host build - the simulated hardware behind slr_hal.h
+ *  and the knobs the host programs use to drive it.
+ */
+#ifndef HAL_MOCK_H
+#define HAL_MOCK_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "../slr_hal.h"
+
+/* simulated clock, in microseconds */
+void     mock_set_us(uint32_t us);
+void     mock_advance_us(uint32_t us);
+
+/* Shutter timer - runs on the simulated clock (1 tick = 1 us). Set the ISR
+ * to call on compare matches, and the worst interrupt latency in us (each
+ * interrupt gets a pseudo-random latency up to it). mock_run_us() advances
+ * the clock, serving the matches in time order. The curtain release times
+ * are recorded in mock_curtain_us[], whether hardware or software edges.
+ */
+extern void   (*mock_tim_isr)(uint8_t ch);
+extern uint32_t mock_isr_latency_us;
+extern uint32_t mock_curtain_us[2];
+void     mock_run_us(uint32_t us);
+
+/* Curtains at the film gate - with mock_curtain_delay set, the light in
+ * the middle of the gate comes mock_curtain_delay(0, 0) us after the first
+ * magnet lets go and goes mock_curtain_delay(1, gap) us after the second,
+ * gap us after the first: the travel of the curtains. The phototransistor
+ * edges, in mock_gate_us[], are captured on the shutter timer and
+ * mock_light_isr(light, capture) runs up to mock_isr_latency_us later.
+ */
+extern uint32_t (*mock_curtain_delay)(uint8_t curtain, uint32_t gap);
+extern void   (*mock_light_isr)(uint8_t light, uint16_t capture);
+extern uint32_t mock_gate_us[2];
+
+/* TSL2591 - integrates the scene continuously, at mock_scene_lux(us) lux
+ * with an infrared share of the counts of 1/4 (daylight) and +-0.5% noise,
+ * saturating like the real ADC. At the end of every integration it calls
+ * mock_sensor_isr (the INT pin); a hal_tsl2591_read() calls mock_i2c_isr
+ * with the counts mock_i2c_us later (the DMA read).
+ */
+extern double (*mock_scene_lux)(uint32_t us);
+extern void   (*mock_sensor_isr)(void);
+extern void   (*mock_i2c_isr)(uint16_t ch0, uint16_t ch1);
+extern uint32_t mock_i2c_us;
+extern uint32_t mock_sensor_samples;
+extern uint32_t mock_sensor_on_us;  /* powered, up to the last hal_tsl2591_off() */
+uint8_t mock_sensor_powered(void);  /* the sensor is on now                      */
+
+/* Flicker photodiode - a burst samples mock_scene_lux at its times, at
+ * mock_photodiode_gain ADC counts a lux (12 bits, +-0.5% and +-2 counts
+ * of noise), then calls mock_flicker_isr (the DMA complete interrupt).
+ */
+extern void   (*mock_flicker_isr)(void);
+extern double   mock_photodiode_gain;
+
+/* Canon EF lens - answers the bus with the focal length and the aperture
+ * codes set below, and moves its aperture mock_lens_step_us per 1/8 stop
+ * plus mock_lens_settle_us, holding the bus meanwhile. mock_lens_isr is
+ * called when a transfer is over (the DMA complete interrupt).
+ */
+extern void   (*mock_lens_isr)(void);
+extern uint32_t mock_lens_byte_us;
+extern uint32_t mock_lens_step_us;
+extern uint32_t mock_lens_settle_us;
+extern uint16_t mock_lens_focal;
+extern uint8_t  mock_lens_wide, mock_lens_closed;
+extern int16_t  mock_lens_pos;    /* aperture code the blades are at */
+extern uint32_t mock_lens_xfers, mock_lens_moves;
+
+/* Mirror - reaches the top (damped) mock_mirror_up_us after hal_mirror(1)
+ * and the bottom mock_mirror_down_us after hal_mirror(0), then calls
+ * mock_mirror_isr (the position switch).
+ */
+extern void   (*mock_mirror_isr)(uint8_t up);
+extern uint32_t mock_mirror_up_us, mock_mirror_down_us;
+
+extern uint8_t  mock_led_green;
+
+/* Dials and buttons - replays a trace of pin edges, in time order: at
+ * every edge the pins of its source take the value given and, unless the
+ * capture flag of the source is already set, the edge time is captured and
+ * mock_input_isr(src, pins, capture) runs after up to mock_input_latency_us.
+ * The interrupt reads the pins as they are when it runs, so edges landing
+ * before it are only seen through their result.
+ */
+#define MOCK_INPUTS 8
+typedef struct {
+	uint32_t us;
+	uint8_t  src, pins;
+} mock_edge_t;
+extern void   (*mock_input_isr)(uint8_t src, uint8_t pins, uint16_t capture);
+extern uint32_t mock_input_latency_us;
+extern const mock_edge_t *mock_input_trace;
+extern uint32_t mock_input_edges;
+void     mock_input_start(const mock_edge_t *trace, uint32_t edges);
+
+/* Display - an SSD1306 128x32: takes the commands of its addressing
+ * window and writes the data in its memory, mock_display_ram[page][x],
+ * taking mock_display_byte_us per byte, then calls mock_display_isr.
+ * mock_display_reset() fills the memory with noise, like a display just
+ * powered; mock_display_save() writes it as a PBM image, scaled.
+ */
+extern void   (*mock_display_isr)(void);
+extern uint32_t mock_display_byte_us;
+extern uint32_t mock_display_bytes, mock_display_xfers;
+extern uint8_t  mock_display_ram[4][128];
+void     mock_display_reset(void);
+int      mock_display_save(const char *path, uint8_t scale);
+
+/* Data EEPROM - 8 KB, mock_eeprom[word], erased (0) at the start. A write
+ * lands in it mock_eeprom_write_us after hal_eeprom_write(), then calls
+ * mock_eeprom_isr; mock_eeprom_wear[] counts the writes of every word.
+ * A write started on a busy EEPROM is counted in mock_eeprom_errors.
+ * mock_eeprom_cut() is the power going in the middle of a write: the word
+ * keeps its old value.
+ */
+#define MOCK_EEPROM_WORDS 2048
+extern void   (*mock_eeprom_isr)(void);
+extern uint32_t mock_eeprom_write_us;
+extern uint32_t mock_eeprom[MOCK_EEPROM_WORDS];
+extern uint32_t mock_eeprom_wear[MOCK_EEPROM_WORDS];
+extern uint32_t mock_eeprom_writes, mock_eeprom_errors;
+void     mock_eeprom_cut(void);
+
+/* RTC - counts the ticks of a 32768 Hz crystal mock_rtc_ppm off, from 0
+ * at time 0, on the 64 bit simulated clock of mock_time_us() (which has to
+ * be read, or an event served, at least once an hour). The alarm calls
+ * mock_rtc_isr when the count reaches it; it may wake Stop mode. The
+ * curtain release times are also in mock_curtain_at[], on that clock.
+ */
+extern void   (*mock_rtc_isr)(void);
+extern double   mock_rtc_ppm;
+extern uint64_t mock_curtain_at[2];
+uint64_t mock_time_us(void);
+
+/* Power - hal_sleep() runs the clock to the next interrupt and serves it,
+ * counting the sleeps and the time slept, [0] in Sleep and [1] in Stop
+ * mode; whatever is left of the simulated time was run time.
+ */
+extern uint32_t mock_sleep_us[2], mock_sleeps[2];
+extern uint32_t mock_stop_wake_us;
+extern uint32_t mock_stop_errors;
+
+/* UART - hal_uart_write() goes to this file, stdout if not set, when
+ * hal_uart_busy() is next called: a buffer changed before that goes out
+ * changed. A write while one is in flight is an overrun. */
+extern FILE    *mock_uart;
+extern uint32_t mock_uart_overruns;
+
+#endif /* HAL_MOCK_H */
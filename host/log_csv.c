@@ -0,0 +1,55 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Decodes a frame log export (see slr_log.h) to CSV: reads the UART
+ *  capture from the file given, or stdin, checks its Fletcher-16 and
+ *  prints a line per frame, oldest first, with the settings as they are
+ *  marked on the camera. The "SLRL" exports of the firmware before the
+ *  thirds read the same, their records upgraded (log_upgrade()). Exits
+ *  non-zero on a stream cut short or corrupt.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "../slr_log.h"
+#include "../slr_display.h"
+
+static const char *mode_name[8] = {"IS", "MA", "MT", "AV", "TV", "PR", "?", "?"};
+static const char *lens_name[8] = {"manual", "EF 50mm f/1.2", "EF 50mm f/1.4", "EF 50mm f/1.8",
+	"EF 85mm f/1.2", "EF 85mm f/1.8", "?", "?"};
+
+int main(int argc, char **argv){
+	FILE *f = stdin;
+	uint8_t h[6], b[4], s1 = 0, s2 = 0, k;
+	uint32_t n, i;
+	char tv[8], av[8];
+
+	if(argc > 1 && !(f = fopen(argv[1], "rb"))){ perror(argv[1]); return 2; }
+	if(fread(h, 1, 6, f) != 6 || (memcmp(h, LOG_MAGIC, 4) && memcmp(h, "SLRL", 4))){ fprintf(stderr, "log_csv: no frame log\n"); return 1; }
+	n = h[4] | (h[5] << 8);
+	printf("frame,iso,aperture,shutter,ev,mode,lens\n");
+	for(i = 0; i < n; i++){
+		uint32_t r = 0;
+		if(fread(b, 1, 4, f) != 4){ fprintf(stderr, "log_csv: cut after %u of %u frames\n", i, n); return 1; }
+		for(k = 0; k < 4; k++){
+			r |= (uint32_t)b[k] << (8 * k);
+			s1 = (s1 + b[k]) % 255;
+			s2 = (s2 + s1) % 255;
+		}
+		r = log_upgrade(r);
+		if(LOG_TV(r) == APEX_BULB) strcpy(tv, "bulb");
+		else{
+			/* 0"3 on the camera, 0.3 in the CSV */
+			char *q;
+			display_tv(LOG_TV(r), APEX_THIRD, tv);
+			if((q = strchr(tv, '"'))) *q = q[1] ? '.' : 0;
+		}
+		display_av(LOG_AV(r), APEX_THIRD, av);
+		printf("%u,%u,%s,%s,%.3f,%s,%s\n", i + 1, ISO_values[LOG_ISO(r)],
+			av + 2, tv, LOG_EV8(r) / 8.0,
+			mode_name[LOG_MODE(r)], lens_name[LOG_LENS(r)]);
+	}
+	if(fread(b, 1, 2, f) != 2 || b[0] != s1 || b[1] != s2){ fprintf(stderr, "log_csv: bad checksum\n"); return 1; }
+	fprintf(stderr, "log_csv: %u frames\n", n);
+	return 0;
+}
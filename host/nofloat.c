@@ -0,0 +1,20 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  The firmware logic alone, compiled with SLR_NO_FLOAT - see the "nofloat"
+ *  target of the Makefile. Nothing to run, the object file is the proof.
+ */
+#include "../slr.h"
+#include "../tsl2591.h"
+#include "../slr_shutter.h"
+#include "../slr_meter.h"
+#include "../slr_lens.h"
+#include "../slr_release.h"
+#include "../slr_apex.h"
+#include "../slr_input.h"
+#include "../slr_power.h"
+#include "../slr_display.h"
+#include "../slr_log.h"
+#include "../slr_calib.h"
+#include "../slr_long.h"
+#include "../slr_flicker.h"
@@ -0,0 +1,117 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Gain and integration time controller on the simulated TSL2591.
+ *  Range: steady scenes from EV -18 to EV 18 in half stops, metered from
+ *  power-up for 3 s, with the adaptive controller and with the two fixed
+ *  settings the meter could be left at. A scene is in range when the
+ *  reading is within 1/8 stop of the true EV; the report gives the widest
+ *  run of scenes in range for each. Time to valid: random jumps between
+ *  EV -8 and EV 15 every 3 s, timed from the jump to the first reading
+ *  within 1/8 stop. Fails if the adaptive range doesn't cover EV -8..15 or
+ *  if a reading takes longer than 1.5 s to become valid.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../slr_meter.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define EV_LO (-18 * 2)     /* half stops */
+#define EV_HI ( 18 * 2)
+#define JUMPS 200
+#define JUMP_MS 3000u
+
+static double scene_lux;
+static double steady(uint32_t us){ (void)us; return scene_lux; }
+
+static double jump_lux[JUMPS];
+static double jumps(uint32_t us){
+	uint32_t i = us / (JUMP_MS * MS);
+	return jump_lux[(i < JUMPS) ? i : JUMPS - 1];
+}
+
+/* EV 0 = 1.75 lux, the calibration of getEV8() */
+static double ev_lux(double ev){ return 1.75 * pow(2.0, ev); }
+static int16_t true_ev8(double lux){ return getEV8wide((uint64_t)(lux * 1099511627776.0)); }
+
+typedef struct {
+	const char *name;
+	uint8_t gain, it, adaptive;
+} setting_t;
+
+static const setting_t settings[] = {
+	{"adaptive",       TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1},
+	{"fixed 1x 100ms", TSL2591_GAIN_LOW, TSL2591_IT_100MS, 0},
+	{"fixed 25x 100ms",TSL2591_GAIN_MED, TSL2591_IT_100MS, 0},
+};
+#define SETTINGS (sizeof(settings) / sizeof(settings[0]))
+
+int main(void){
+	uint32_t i, ms, fails = 0;
+	int lo_adaptive = 0, hi_adaptive = 0;
+
+	mock_sensor_isr = meter_ready_isr;
+	mock_i2c_isr    = meter_sample_isr;
+
+	printf("%-16s %20s %12s\n", "setting", "EV range (1/8 stop)", "switches");
+	for(i = 0; i < SETTINGS; i++){
+		int ev2, run = 0, lo = 0, hi = -1, best = 0;
+		uint32_t switches = 0;
+		for(ev2 = EV_LO; ev2 <= EV_HI; ev2++){
+			int32_t err;
+			scene_lux = ev_lux(ev2 / 2.0);
+			mock_scene_lux = steady;
+			mock_set_us(0);
+			meter_init(settings[i].gain, settings[i].it, settings[i].adaptive);
+			for(ms = 0; ms < 3000; ms++){
+				mock_run_us(MS);
+				meter_poll();
+			}
+			switches += SLR_Meter.switches;
+			err = SLR_Meter.ev8 - true_ev8(scene_lux);
+			if(SLR_Meter.valid && err <= 1 && err >= -1){
+				if(++run > best){ best = run; hi = ev2; lo = ev2 - run + 1; }
+			}else run = 0;
+		}
+		if(best) printf("%-16s %9.1f .. %5.1f EV %12u\n", settings[i].name, lo / 2.0, hi / 2.0, switches);
+		else     printf("%-16s %20s %12u\n", settings[i].name, "none", switches);
+		if(settings[i].adaptive){ lo_adaptive = lo; hi_adaptive = hi; }
+	}
+	if(lo_adaptive > -8 * 2 || hi_adaptive < 15 * 2){
+		printf("FAIL adaptive range doesn't cover EV -8..15\n");
+		fails++;
+	}
+
+	{
+		uint32_t sum = 0, worst = 0, never = 0;
+		srand(2591);
+		for(i = 0; i < JUMPS; i++) jump_lux[i] = ev_lux(-8 + 23.0 * rand() / RAND_MAX);
+		mock_scene_lux = jumps;
+		mock_set_us(0);
+		meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+		for(i = 0; i < JUMPS; i++){
+			int16_t truth = true_ev8(jump_lux[i]);
+			int32_t valid = -1;
+			for(ms = 0; ms < JUMP_MS; ms++){
+				int32_t err;
+				mock_run_us(MS);
+				meter_poll();
+				err = SLR_Meter.ev8 - truth;
+				if(valid < 0 && SLR_Meter.valid && err <= 1 && err >= -1) valid = ms + 1;
+			}
+			if(valid < 0){ never++; continue; }
+			sum += valid;
+			if((uint32_t)valid > worst) worst = valid;
+		}
+		printf("time to valid over %u jumps in EV -8..15: average %u ms, worst %u ms, never %u\n",
+			JUMPS, sum / (JUMPS - never ? JUMPS - never : 1), worst, never);
+		printf("samples: %u, dropped %u, saturated %u, setting changes %u\n",
+			mock_sensor_samples, SLR_Meter.dropped, SLR_Meter.overflows, SLR_Meter.switches);
+		if(never || worst > 1500){ printf("FAIL reading slower than 1.5 s to become valid\n"); fails++; }
+		if(SLR_Meter.dropped){ printf("FAIL dropped samples\n"); fails++; }
+	}
+	return fails ? 1 : 0;
+}
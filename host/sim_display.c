@@ -0,0 +1,171 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  The readout (slr_display.h) on the simulated SSD1306: 3000 random dial
+ *  detents and meter readings, some coming faster than the display bus,
+ *  with the main loop updating the display every millisecond. Reports the
+ *  bytes sent per change of every kind against a full redraw, and the
+ *  refresh rate the bus would allow either way; writes the last readout
+ *  to build/host/display.pbm (or the file given). Fails when what the
+ *  display shows differs from the frame buffer once the bus is idle, or
+ *  when an update is left unsent. Before that, the marks of every click
+ *  of the dials, in thirds and in halves, against the exact speed and
+ *  f-number, and the dials set to half stops.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../slr_display.h"
+#include "../slr_lens.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define CHANGES 3000
+#define FULL_BYTES (6 + DISPLAY_PAGES * DISPLAY_W)
+
+enum { K_TV = 0, K_AV, K_ISO, K_MODE, K_EV, KINDS };
+static const char *kind_name[KINDS] = {"Tv dial", "Av dial", "ISO dial", "mode", "meter EV"};
+
+static uint32_t mismatches;
+
+static void check_glass(void){
+	if(memcmp(mock_display_ram, SLR_Display.fb, sizeof(mock_display_ram))) mismatches++;
+}
+
+/* the main loop, until the display is idle and up to date */
+static void settle(void){
+	uint32_t ms;
+	for(ms = 0; ms < 100; ms++){
+		mock_run_us(MS);
+		if(!display_update() && !display_busy() && !SLR_Display.stale) break;
+	}
+}
+
+/* the value of a mark: 1/x, s"t and f/x.y */
+static double mark_value(const char *p){
+	double v = 0, d = 1;
+	if(p[0] == '1' && p[1] == '/') return 1.0 / atof(p + 2);
+	if(p[0] == 'f') return atof(p + 2);
+	for(; *p >= '0' && *p <= '9'; p++) v = v * 10 + (*p - '0');
+	if(*p == '"') for(p++; *p >= '0' && *p <= '9'; p++) v += (*p - '0') * (d /= 10);
+	return v;
+}
+
+/* every click of the dials shows a mark of its own, a quarter stop at
+ * most from the exact value - the nominal marks are rounded that much
+ * (0"3 for 0.35 s)
+ */
+static uint32_t check_marks(uint8_t step){
+	char buf[8], last[8] = "";
+	int16_t n;
+	uint32_t fails = 0;
+	double exact, err;
+	for(n = -5 * APEX_UNIT / step; n <= 13 * APEX_UNIT / step; n++){
+		display_tv(n * step, step, buf);
+		exact = pow(2.0, -(double)n * step / APEX_UNIT);
+		err = fabs(log2(mark_value(buf) / exact));
+		if(err > 0.25 || !strcmp(buf, last)){ printf("FAIL step %u: Tv %d shows %s\n", step, n * step, buf); fails++; }
+		strcpy(last, buf);
+	}
+	for(n = 0; n <= 12 * APEX_UNIT / step; n++){
+		display_av(n * step, step, buf);
+		exact = pow(2.0, (double)n * step / (2 * APEX_UNIT));
+		err = fabs(log2(mark_value(buf) / exact));
+		if(err > 0.25 || !strcmp(buf, last)){ printf("FAIL step %u: Av %d shows %s\n", step, n * step, buf); fails++; }
+		strcpy(last, buf);
+	}
+	return fails;
+}
+
+/* half stop dials: the settings go to the halves and stay on them */
+static uint32_t check_halves(void){
+	uint32_t fails = 0;
+	uint8_t i;
+	slr_init();
+	SLR_Mode = MA;
+	SLR_Av = APEX_AV(6) + APEX_THIRD;
+	SLR_Tv = APEX_TV(7) - APEX_THIRD;
+	setDialStep(0);
+	for(i = 0; i < 60; i++){
+		if((SLR_Dial != APEX_HALF) || (SLR_Av % APEX_HALF) || ((SLR_Tv != APEX_BULB) && (SLR_Tv % APEX_HALF))){
+			printf("FAIL half stops: Av %d Tv %d after %u clicks\n", SLR_Av, SLR_Tv, i);
+			fails++;
+			break;
+		}
+		setAVindex(i < 30);
+		setTVindex(i < 30);
+	}
+	setDialStep(1);
+	if((SLR_Dial != APEX_THIRD) || (SLR_Av % APEX_THIRD) || ((SLR_Tv != APEX_BULB) && (SLR_Tv % APEX_THIRD))){
+		printf("FAIL back to thirds: Av %d Tv %d\n", SLR_Av, SLR_Tv);
+		fails++;
+	}
+	return fails;
+}
+
+int main(int argc, char **argv){
+	uint32_t n, fails = 0, sent[KINDS] = {0}, count[KINDS] = {0}, worst = 0, total;
+	const char *path = (argc > 1) ? argv[1] : "build/host/display.pbm";
+
+	fails += check_marks(APEX_THIRD) + check_marks(APEX_HALF) + check_halves();
+
+	mock_display_isr = display_xfer_isr;
+	mock_display_reset();
+	slr_init();
+	display_init();
+	settle();
+	check_glass();
+	printf("first update: %u bytes, with the %u of the init\n", mock_display_bytes, (unsigned)sizeof(Display_init));
+
+	srand(16);
+	for(n = 0; n < CHANGES; n++){
+		uint8_t k = rand() % KINDS, dir = rand() & 1;
+		uint32_t before = mock_display_bytes, b;
+		switch(k){
+		case K_TV:   setTVindex(dir);  break;
+		case K_AV:   setAVindex(dir);  break;
+		case K_ISO:  setISOindex(dir); break;
+		case K_MODE: setSLRmode(dir);  break;
+		default:
+			SLR_EV8 += rand() % 7 - 3;
+			if(SLR_EV8 < -12 * 8) SLR_EV8 = -12 * 8;
+			if(SLR_EV8 > 15 * 8) SLR_EV8 = 15 * 8;
+			SLR_EV = (SLR_EV8 < 0) ? 0 : (SLR_EV8 >> 3);
+			break;
+		}
+		slr_publish();
+		if(rand() % 4){
+			settle();
+			check_glass();
+		}else{
+			/* the next change comes while this one is on the bus */
+			display_update();
+			mock_run_us(20);
+		}
+		b = mock_display_bytes - before;
+		sent[k] += b;
+		count[k]++;
+		if(b > worst) worst = b;
+	}
+	settle();
+	check_glass();
+	if(display_update() || display_busy()){ printf("FAIL the display is behind the exposure state\n"); fails++; }
+	if(mismatches){ printf("FAIL the display differs from the frame buffer %u times\n", mismatches); fails++; }
+
+	total = 0;
+	printf("%-10s %8s %12s\n", "change", "count", "bytes mean");
+	for(n = 0; n < KINDS; n++){
+		printf("%-10s %8u %12.1f\n", kind_name[n], count[n], count[n] ? (double)sent[n] / count[n] : 0.0);
+		total += sent[n];
+	}
+	printf("%u updates, %u bytes in %u transfers: %.1f bytes a change, worst %u (full redraw %u)\n",
+		SLR_Display.updates, total, mock_display_xfers, (double)total / CHANGES, worst, FULL_BYTES);
+	printf("bus time a change at 8 MHz: %.1f us, %.0f updates/s (full redraws: %u us, %.0f/s)\n",
+		(double)total / CHANGES * mock_display_byte_us, 1e6 / ((double)total / CHANGES * mock_display_byte_us),
+		FULL_BYTES * mock_display_byte_us, 1e6 / (FULL_BYTES * mock_display_byte_us));
+	if(mock_display_save(path, 4) == 0) printf("readout saved to %s\n", path);
+	else printf("could not write %s\n", path);
+	return fails ? 1 : 0;
+}
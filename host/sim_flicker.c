@@ -0,0 +1,203 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  The flicker mode (slr_flicker.h) under synthetic lamps of 400 lux mean:
+ *  steady light, tubes on 50 and 60 Hz mains (a 100 / 120 Hz sine), a
+ *  cheap LED driver on mains 0.4% fast (100.4 Hz, 80% deep), a PWM LED
+ *  (120 Hz square, 50% duty) and a half-wave LED (60 Hz).
+ *
+ *  First the detection, burst by burst at random phases: the frequency
+ *  and depth found, and the EV of the meter against the one of steady
+ *  light of the same mean. Then the consistency that matters: FRAMES
+ *  releases at each speed, MA mode, with the flicker mode off and on,
+ *  and the light each frame got in the middle of the gate (curtains 6 ms
+ *  to there, +-4 us) over the time it was open there, as the spread of
+ *  the frames in stops, and as the mean in 1/8 stops over the mean light
+ *  against the peak EV the release worked the exposure out for; and the
+ *  shutter lag, the burst in it.
+ *
+ *  Fails on a lamp found at the wrong frequency, or its depth 5% off; a
+ *  steady lamp found flickering; a meter EV 1/8 stop off the mean; a
+ *  flickering lamp with the flicker mode on spreading the frames of a
+ *  speed over more than MAX_SPREAD stop; or the light of the frames more
+ *  than 1/8 stop off the peak EV.
+ */
+#define SLR_TV_MAX_SPEED 1
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../slr_release.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define LOOP_US 20
+#define FRAMES 40
+#define BURSTS 20
+#define MAX_SPREAD 0.1
+#define LUX 400.0
+
+typedef struct {
+	const char *name;
+	double hz;      /* of the light */
+	double depth;   /* sine: amplitude over the mean; square: duty */
+	uint8_t square;
+	uint8_t want_hz;
+	uint16_t want_depth;
+} lamp_t;
+
+static const lamp_t lamps[] = {
+	{"steady",               0.0, 0.0,  0,   0,    0},
+	{"tube, 50 Hz mains",  100.0, 0.35, 0, 100,  350},
+	{"tube, 60 Hz mains",  120.0, 0.25, 0, 120,  250},
+	{"LED, mains +0.4%",   100.4, 0.80, 0, 100,  800},
+	{"LED PWM 120 Hz",     120.0, 0.50, 1, 120, 1273},
+	{"LED half-wave 60 Hz", 60.0, 0.90, 0,  60,  900},
+};
+#define LAMPS (sizeof(lamps) / sizeof(lamps[0]))
+
+static const uint8_t speeds[] = {1, 3, 5, 7};
+#define SPEEDS (sizeof(speeds) / sizeof(speeds[0]))
+
+static const lamp_t *lamp;
+static double phase;   /* of the lamp, periods */
+
+static double light(double us){
+	double p;
+	if(!lamp || lamp->hz == 0) return LUX;
+	p = lamp->hz * us * 1e-6 + phase;
+	if(lamp->square) return (p - floor(p) < lamp->depth) ? LUX / lamp->depth : 0.0;
+	return LUX * (1.0 + lamp->depth * cos(2 * M_PI * p));
+}
+
+static double scene(uint32_t us){ return light(us); }
+
+/* the mean light between the gate edges, over LUX - the curtains' own
+ * jitter taken out - a dark frame as 10 stops under */
+static double exposure(void){
+	double t, h = 0, dt;
+	double t0 = (double)mock_curtain_at[0] + (uint32_t)(mock_gate_us[0] - mock_curtain_us[0]);
+	double t1 = (double)mock_curtain_at[1] + (uint32_t)(mock_gate_us[1] - mock_curtain_us[1]);
+	dt = (t1 - t0) / 200;
+	for(t = t0 + dt / 2; t < t1; t += dt) h += light(t) * dt;
+	h /= LUX * (t1 - t0);
+	return (h < 1.0 / 1024) ? -10 : log2(h);
+}
+
+static uint32_t travel(uint8_t c, uint32_t gap){
+	(void)c; (void)gap;
+	return 6000 + (rand() % 9) - 4;
+}
+
+static void run_us(uint32_t us){
+	uint32_t t;
+	for(t = 0; t < us; t += LOOP_US){
+		mock_run_us(LOOP_US);
+		meter_poll();
+		release_poll();
+	}
+}
+
+/* the meter settled on this lamp, its EV8 */
+static int16_t meter_ev8(void){
+	run_us(1000 * MS);
+	read_exposure();
+	return SLR_EV8;
+}
+
+int main(void){
+	uint32_t fails = 0, l, n, s;
+	int16_t steady;
+
+	srand(20);
+	mock_scene_lux     = scene;
+	mock_sensor_isr    = meter_ready_isr;
+	mock_i2c_isr       = meter_sample_isr;
+	mock_mirror_isr    = release_mirror_isr;
+	mock_tim_isr       = shutter_timer_isr;
+	mock_flicker_isr   = flicker_burst_isr;
+	mock_curtain_delay = travel;
+	slr_init();
+	shutter_init(Shutter_hw_edges);
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+
+	/* -- detection ------------------------------------------------------ */
+	lamp = &lamps[0];
+	steady = meter_ev8();
+	printf("%-20s | %5s %6s %6s | %5s  (%u bursts: found, depth permille min/max; meter EV - steady, 1/8 stop)\n",
+		"lamp", "Hz", "min", "max", "EV8", BURSTS);
+	for(l = 0; l < LAMPS; l++){
+		uint16_t dmin = UINT16_MAX, dmax = 0;
+		uint8_t hz = 0, wrong = 0;
+		int16_t ev;
+		lamp = &lamps[l];
+		for(n = 0; n < BURSTS; n++){
+			phase = rand() / (double)RAND_MAX;
+			flicker_start();
+			mock_run_us(FLICKER_CYCLE_US + FLICKER_SAMPLE_US);
+			flicker_done();
+			if(SLR_Flicker.hz != lamp->want_hz) wrong++;
+			hz = SLR_Flicker.hz;
+			if(SLR_Flicker.k){
+				if(SLR_Flicker.depth < dmin) dmin = SLR_Flicker.depth;
+				if(SLR_Flicker.depth > dmax) dmax = SLR_Flicker.depth;
+			}
+		}
+		ev = meter_ev8() - steady;
+		printf("%-20s | %5u %6u %6u | %+5d\n", lamp->name, hz, dmax ? dmin : 0, dmax, ev);
+		if(wrong){ printf("FAIL %s: %u bursts found the wrong flicker\n", lamp->name, wrong); fails++; }
+		if(lamp->want_hz && ((dmin < lamp->want_depth * 0.95) || (dmax > lamp->want_depth * 1.05))){
+			printf("FAIL %s: depth %u..%u, not %u\n", lamp->name, dmin, dmax, lamp->want_depth);
+			fails++;
+		}
+		if(abs(ev) > 1){ printf("FAIL %s: the meter is %d/8 stop off the mean\n", lamp->name, ev); fails++; }
+	}
+
+	/* -- consistency ---------------------------------------------------- */
+	printf("\n%-20s %6s | %23s | %30s  (%u frames: spread, stops; light over the mean, peak EV, 1/8 stop)\n",
+		"", "", "flicker mode off", "flicker mode on", FRAMES);
+	printf("%-20s %6s | %7s %8s %6s | %7s %8s %6s %6s\n", "lamp", "Tv", "spread", "mean", "lag ms", "spread", "mean", "peak", "lag ms");
+	SLR_Mode = MA;
+	SLR_Av = APEX_AV(6);
+	for(l = 1; l < LAMPS; l++){
+		lamp = &lamps[l];
+		for(s = 0; s < SPEEDS; s++){
+			double lo[2] = {1e9, 1e9}, hi[2] = {-1e9, -1e9}, sum[2] = {0, 0}, lag[2] = {0, 0};
+			int8_t peak = 0;
+			uint8_t on;
+			SLR_Tv = APEX_TV(speeds[s]);
+			for(on = 0; on < 2; on++){
+				SLR_Flicker.on = on;
+				for(n = 0; n < FRAMES; n++){
+					double st;
+					phase = rand() / (double)RAND_MAX;
+					run_us(rand() % (50 * MS));
+					release_press();
+					while(SLR_Release.state != RELEASE_IDLE) run_us(MS);
+					if(SLR_Release.error || !(SLR_Release.done & (1u << REL_CLOSED))){
+						printf("FAIL %s: release made no exposure (error %u)\n", lamp->name, SLR_Release.error);
+						return 1;
+					}
+					st = exposure();
+					if(st < lo[on]) lo[on] = st;
+					if(st > hi[on]) hi[on] = st;
+					sum[on] += st;
+					lag[on] += release_lag();
+					if(on) peak = SLR_Release.flicker ? flicker_peak_ev8(Tv_speed[speeds[s]]) : 0;
+				}
+			}
+			printf("%-20s 1/%-4u | %7.3f %+8.2f %6.1f | %7.3f %+8.2f %+6d %6.1f\n", lamp->name, Tv_markings[speeds[s]],
+				hi[0] - lo[0], 8 * sum[0] / FRAMES, lag[0] / FRAMES / 1000,
+				hi[1] - lo[1], 8 * sum[1] / FRAMES, peak, lag[1] / FRAMES / 1000);
+			if(hi[1] - lo[1] > MAX_SPREAD){
+				printf("FAIL %s at 1/%u: the frames spread over %.3f stop\n", lamp->name, Tv_markings[speeds[s]], hi[1] - lo[1]);
+				fails++;
+			}
+			if(fabs(8 * sum[1] / FRAMES - peak) > 1){
+				printf("FAIL %s at 1/%u: %.2f/8 stop of light, peak EV +%d/8\n", lamp->name, Tv_markings[speeds[s]], 8 * sum[1] / FRAMES, peak);
+				fails++;
+			}
+		}
+	}
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,165 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Dials and buttons (slr_input.h) on a replayed pin trace: bursts of
+ *  detents on the three dials, up to 1000 detents a second, and presses of
+ *  the two buttons, with contact bounce on every edge, up to 10 us of
+ *  interrupt latency (edges landing meanwhile are only seen in the pins)
+ *  and the main loop taking the events every 2..20 ms. Reports the events,
+ *  the batches and the action calls they came to, and the ring high water
+ *  mark. Fails on a detent or a press lost, on a full ring, or on a dial
+ *  called more than once a batch. Before that, the dial setters with a
+ *  net count against as many single detents, from random settings.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../slr_input.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define BURSTS 2000
+
+static const char *src_name[INPUT_SOURCES] = {"AV dial", "TV dial", "ISO dial", "MODE", "LENS"};
+
+static mock_edge_t *trace;
+static uint32_t edges, cap;
+static uint8_t pins[INPUT_SOURCES];
+static int32_t truth[INPUT_SOURCES];
+
+static void edge(uint32_t us, uint8_t src, uint8_t p){
+	if(edges == cap){
+		cap = cap ? 2 * cap : 4096;
+		trace = realloc(trace, cap * sizeof(mock_edge_t));
+		if(!trace){ perror("sim_input"); exit(2); }
+	}
+	pins[src] = p;
+	trace[edges].us   = us;
+	trace[edges].src  = src;
+	trace[edges].pins = p;
+	edges++;
+}
+
+/* the pins go to p, the changing ones bouncing for up to max us first */
+static uint32_t bouncy(uint32_t t, uint8_t src, uint8_t p, uint32_t max){
+	uint8_t from = pins[src], n = (rand() % 3) ? 0 : 2 * (rand() % 3);
+	uint32_t step = max / (n + 1);
+	if(!step) n = 0;
+	while(n--){
+		edge(t, src, (n & 1) ? p : from);
+		t += 1 + rand() % step;
+	}
+	edge(t, src, p);
+	return t;
+}
+
+/* n detents of a dial at rate detents/s, one way: the pins go round the
+ * Gray code 3 2 0 1 (up) or 3 1 0 2 (down), back to 3 at the detent
+ */
+static uint32_t turn(uint32_t t, uint8_t dial, uint8_t dir, uint32_t n, uint32_t rate){
+	static const uint8_t up[4] = {2, 0, 1, 3}, down[4] = {1, 0, 2, 3};
+	uint32_t quarter = 250000 / rate, k, q;
+	for(k = 0; k < n; k++){
+		for(q = 0; q < 4; q++){
+			/* +-25% speed wobble, bounce within a third of the quarter step */
+			t += quarter - quarter / 4 + rand() % (quarter / 2 + 1);
+			t = bouncy(t, dial, dir ? up[q] : down[q], quarter / 3);
+		}
+		truth[dial] += dir ? 1 : -1;
+	}
+	return t;
+}
+
+static uint32_t press(uint32_t t, uint8_t btn){
+	t = bouncy(t, btn, 0, 1000);
+	t = bouncy(t + 30 * MS + rand() % (200 * MS), btn, 1, 2000);
+	truth[btn]++;
+	return t;
+}
+
+static void input_isr(uint8_t src, uint8_t p, uint16_t capture){
+	if(src < INPUT_DIALS) input_encoder_isr(src, p);
+	else                  input_button_isr(src, p, capture);
+}
+
+/* setX(n) ends where n calls of setX(+-1) do, in every mode and with
+ * either click of the dials, from on and off the clicks
+ */
+static uint32_t check_net(void){
+	static void (*const one[INPUT_DIALS])(uint8_t dir) = {setAVindex, setTVindex, setISOindex};
+	uint32_t i, fails = 0;
+	srand(12);
+	for(i = 0; i < 200000; i++){
+		uint8_t d = rand() % INPUT_DIALS;
+		int8_t n = (int8_t)(rand() % 33 - 16), k;
+		exposure_t a, b;
+		SLR_Mode  = (cameramode_t)(rand() % 6);
+		SLR_Dial  = (rand() & 1) ? APEX_THIRD : APEX_HALF;
+		SLR_ISO   = rand() % SLR_ISO_ROWS;
+		SLR_Av    = rand() % (APEX_AV(Av_min_aperture) + 1);
+		SLR_Tv    = (SLR_Mode <= MA && !(rand() % 8)) ? APEX_BULB : rand() % (APEX_TV(Tv_max_speed) + 1);
+		SLR_Shift = (int8_t)(rand() % 31 - 15);
+		a = SLR_Exp;
+		Input_dial[d](n);
+		b = SLR_Exp;
+		SLR_Exp = a;
+		for(k = n; k > 0; k--) one[d](1);
+		for(k = n; k < 0; k++) one[d](0);
+		if((b.iso != SLR_ISO) || (b.av != SLR_Av) || (b.tv != SLR_Tv) || (b.shift != SLR_Shift)){
+			if(fails++ < 10)
+				printf("FAIL %s %+d in mode %u from ISO %u Av %d Tv %d shift %d: ISO %u Av %d Tv %d shift %d, detents %u %d %d %d\n",
+					src_name[d], n, a.mode, a.iso, a.av, a.tv, a.shift,
+					b.iso, b.av, b.tv, b.shift, SLR_ISO, SLR_Av, SLR_Tv, SLR_Shift);
+		}
+	}
+	SLR_Dial = SLR_DIAL_STEP;
+	return fails;
+}
+
+int main(void){
+	uint32_t b, t = 10 * MS, end, fails = 0, polls = 0, high = 0, multi = 0;
+	uint8_t s, rest[INPUT_DIALS] = {3, 3, 3};
+
+	fails += check_net();
+	srand(13);
+	for(s = 0; s < INPUT_SOURCES; s++) pins[s] = (s < INPUT_DIALS) ? 3 : 1;
+	for(b = 0; b < BURSTS; b++){
+		s = rand() % 8;
+		if(s < INPUT_DIALS * 2) t = turn(t, s >> 1, rand() & 1, 1 + rand() % 40, 20 + rand() % 981);
+		else                    t = press(t, INPUT_DIALS + (s & 1));
+		t += 10 * MS + rand() % (300 * MS);
+	}
+	end = t + 100 * MS;
+
+	mock_input_isr = input_isr;
+	mock_input_latency_us = 10;
+	slr_init();
+	input_init(rest);
+	mock_input_start(trace, edges);
+	while((int32_t)(hal_micros() - end) < 0){
+		uint8_t depth;
+		int32_t before[INPUT_SOURCES];
+		uint32_t calls = SLR_Input.steps;
+		mock_run_us(2 * MS + rand() % (18 * MS + 1));
+		depth = SLR_Input.head - SLR_Input.tail;
+		if(depth > high) high = depth;
+		for(s = 0; s < INPUT_SOURCES; s++) before[s] = SLR_Input.net[s];
+		input_poll();
+		/* one call a dial that moved, one a press */
+		for(s = 0; s < INPUT_SOURCES; s++)
+			calls += (s < INPUT_DIALS) ? (SLR_Input.net[s] != before[s]) : (uint32_t)(SLR_Input.net[s] - before[s]);
+		if(SLR_Input.steps != calls) multi++;
+		polls++;
+	}
+
+	printf("%u edges in %.1f s, %u polls: %u events in %u batches, %u action calls, ring high water %u/%u\n",
+		edges, end / 1e6, polls, SLR_Input.events, SLR_Input.batches, SLR_Input.steps, high, INPUT_RING);
+	for(s = 0; s < INPUT_SOURCES; s++){
+		printf("%-9s %6d delivered, %6d in the trace\n", src_name[s], SLR_Input.net[s], truth[s]);
+		if(SLR_Input.net[s] != truth[s]){ printf("FAIL %s\n", src_name[s]); fails++; }
+	}
+	if(SLR_Input.dropped){ printf("FAIL %u events dropped\n", SLR_Input.dropped); fails++; }
+	if(multi){ printf("FAIL %u batches called a dial more than once\n", multi); fails++; }
+	free(trace);
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  EF lens driver on the simulated lens. Identifies every eos_t lens from
+ *  its answers, then spins the aperture dial in bursts (a detent every
+ *  1..3 ms, up and down - faster than the lens moves a third of a stop)
+ *  with the 50mm f/1.4 mounted. Reports the queued to done latency of
+ *  every kind of command, the lens moves made for the dial turns, and the
+ *  bus time a blocking driver would have cost. Fails on a wrong
+ *  identification, on the blades not ending at the aperture of the dial,
+ *  on a command lost to a full queue, or when no dial turn was coalesced
+ *  into a queued move.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../slr_lens.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+
+static const char *cmd_name[LENS_CMDS] = {"identify", "range", "aperture"};
+static uint32_t lat_n[LENS_CMDS], lat_sum[LENS_CMDS], lat_max[LENS_CMDS], lat_min[LENS_CMDS];
+
+/* the DMA interrupt, with the latency of the command it completes */
+static void lens_isr(void){
+	uint8_t cmd = SLR_Lens.cur.cmd;
+	uint32_t l;
+	lens_xfer_isr();
+	l = SLR_Lens.latency_us[cmd];
+	if(!lat_n[cmd] || l < lat_min[cmd]) lat_min[cmd] = l;
+	if(l > lat_max[cmd]) lat_max[cmd] = l;
+	lat_sum[cmd] += l;
+	lat_n[cmd]++;
+}
+
+static void run_idle(void){
+	uint32_t ms;
+	for(ms = 0; ms < 1000 && lens_busy(); ms++) mock_run_us(MS);
+	mock_run_us(MS);
+	lens_poll();
+}
+
+static const char *model_name[] = {"EF 50mm f/1.2", "EF 50mm f/1.4", "EF 50mm f/1.8", "EF 85mm f/1.2", "EF 85mm f/1.8"};
+
+int main(void){
+	uint32_t m, fails = 0, turns = 0, bursts = 0, blocking_us = 0, worst_settle = 0;
+
+	mock_lens_isr = lens_isr;
+	slr_init();
+
+	/* every lens identified from its focal length and aperture range */
+	for(m = 0; m < EOS_MODELS; m++){
+		const int8_t *ap = EOS_apertures[m];
+		mock_lens_focal  = EOS_focal[m];
+		mock_lens_wide   = ap[eos_wide_av(ap)];
+		mock_lens_closed = ap[ap[0]];
+		mock_lens_pos    = mock_lens_wide;
+		SLR_LensType = MANUAL;
+		lens_init();
+		run_idle();
+		printf("%-14s -> %s\n", model_name[m],
+			(SLR_Lens.valid && SLR_LensType == EOS) ? model_name[SLR_EOSModel] : "not identified");
+		if(!SLR_Lens.valid || SLR_EOSModel != m){ printf("FAIL identification\n"); fails++; }
+	}
+
+	/* the 50mm f/1.4 on, dial bursts */
+	mock_lens_focal = 50; mock_lens_wide = 16; mock_lens_closed = 80; mock_lens_pos = 16;
+	lens_init();
+	run_idle();
+	SLR_Av = APEX_AV(2);
+	srand(50);
+	for(bursts = 0; bursts < 40; bursts++){
+		uint8_t dir = rand() & 1, n = 1 + rand() % 8, k;
+		uint32_t gap = 1 + rand() % 3, t0, ms;
+		for(k = 0; k < n; k++){
+			int16_t before = SLR_Av;
+			setAVindex(dir);
+			if(SLR_Av != before){
+				/* what a blocking driver would hold the main loop for */
+				int16_t d = apex_av_code(SLR_Av) - apex_av_code(before);
+				blocking_us += LENS_FRAME * mock_lens_byte_us + (d < 0 ? -d : d) * mock_lens_step_us + mock_lens_settle_us;
+				turns++;
+			}
+			if(k + 1 < n) mock_run_us(gap * MS);
+		}
+		/* blades in place after the last detent */
+		t0 = hal_micros();
+		for(ms = 0; ms < 1000 && lens_busy(); ms++) mock_run_us(100);
+		if(hal_micros() - t0 > worst_settle) worst_settle = hal_micros() - t0;
+		if(mock_lens_pos != apex_av_code(SLR_Av)){
+			printf("FAIL burst %u: blades at %d, dial at Av %d/24 (%d)\n", bursts, mock_lens_pos,
+				SLR_Av, apex_av_code(SLR_Av));
+			fails++;
+		}
+		mock_run_us(200 * MS);
+	}
+
+	printf("\n%-10s %8s %10s %10s %10s\n", "command", "count", "min us", "mean us", "max us");
+	for(m = 0; m < LENS_CMDS; m++)
+		if(lat_n[m]) printf("%-10s %8u %10u %10u %10u\n", cmd_name[m], lat_n[m], lat_min[m], lat_sum[m] / lat_n[m], lat_max[m]);
+	printf("\n%u dial turns in %u bursts: %u lens moves, %u requests coalesced, %u lost\n",
+		turns, bursts, mock_lens_moves, SLR_Lens.coalesced, SLR_Lens.overruns);
+	printf("blades in place at most %u us after the last detent\n", worst_settle);
+	printf("main loop blocked: 0 us (a blocking driver: %u us)\n", blocking_us);
+	if(SLR_Lens.overruns){ printf("FAIL commands lost\n"); fails++; }
+	if(!SLR_Lens.coalesced){ printf("FAIL no aperture request coalesced\n"); fails++; }
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  The frame log (slr_log.h) on the simulated camera of sim_release.c,
+ *  with a 256 word log to go round it a few times: 1200 frames at random
+ *  settings, in bursts of up to 8 shot as fast as the camera goes, and
+ *  the power cut every 100 frames or so, at any point - in the middle of
+ *  an EEPROM write too. After every cut log_init() must find the head
+ *  again; at the end the log must hold the last frames shot, in order,
+ *  read back and through the export stream. Reports the wear of the words
+ *  against a log that rewrites a fixed header, the deepest queue and the
+ *  shutter lag. Fails on a frame lost other than by a cut, a head not
+ *  found, a write started during a release or on a busy EEPROM, or a bad
+ *  export. The export goes to the file given, for log_csv ("make log").
+ *  First, a log of the old layout (Tv and Av indices) must read back
+ *  upgraded.
+ */
+#define LOG_WORDS 256
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../slr_release.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define LOOP_US 20
+#define FRAMES 1200
+#define ENDURANCE 300000u  /* writes a data EEPROM word stands, minimum */
+
+static double scene(uint32_t us){ return 7168.0 * (1.0 + 0.5 * ((us / 700000) % 3)); }
+
+static void lens_isr(void){ lens_xfer_isr(); }
+
+static uint32_t truth[FRAMES], shot, fails, overlaps;
+static uint8_t  deepest;
+
+static void run_us(uint32_t us){
+	uint32_t t;
+	for(t = 0; t < us; t += LOOP_US){
+		uint32_t written = SLR_Log.written;
+		mock_run_us(LOOP_US);
+		meter_poll();
+		lens_poll();
+		release_poll();
+		log_poll(SLR_Release.state == RELEASE_IDLE);
+		if((SLR_Log.written != written) && (SLR_Release.state != RELEASE_IDLE)) overlaps++;
+		if((uint8_t)(SLR_Log.head - SLR_Log.tail) > deepest) deepest = SLR_Log.head - SLR_Log.tail;
+	}
+}
+
+/* the power goes and comes back: the queue is lost, and the word being
+ * written keeps what it had */
+static void power_cut(void){
+	uint32_t lost = (uint8_t)(SLR_Log.head - SLR_Log.tail) + SLR_Log.busy;
+	uint16_t next;
+	shot -= lost;
+	mock_eeprom_cut();
+	log_init();
+	next = shot % LOG_WORDS;
+	if((SLR_Log.next != next) || (log_count() != (shot < LOG_WORDS ? shot : LOG_WORDS))){
+		printf("FAIL after %u frames: head found at %u, %u records, expected %u\n", shot, SLR_Log.next, log_count(), next);
+		fails++;
+	}
+}
+
+/* a log of the firmware before the thirds, n records: read back in the
+ * new layout, with the same settings */
+static void check_old(uint16_t n){
+	uint16_t i;
+	memset(mock_eeprom, 0, sizeof(mock_eeprom));
+	for(i = 0; i < n; i++){
+		uint8_t av = 1 + i % 13, tv = 1 + i % 15;
+		mock_eeprom[LOG_BASE + i] = (i % 8) | (av << 3) | (tv << 7) | ((uint32_t)(i * 5 % 256) << 11)
+			| ((uint32_t)(i % 6) << 19) | ((uint32_t)(i % 6) << 22) | (1u << 30);
+	}
+	log_init();
+	if(log_count() != n){ printf("FAIL old log: %u records, not %u\n", log_count(), n); fails++; }
+	for(i = 0; i < n; i++){
+		uint32_t r = log_read(i);
+		uint8_t av = 1 + i % 13, tv = 1 + i % 15;
+		if((LOG_ISO(r) != i % 8) || (LOG_AV(r) != APEX_AV(av)) || (LOG_TV(r) != ((tv < 15) ? APEX_TV(tv) : APEX_BULB))
+		|| (LOG_EV8(r) != (int16_t)(i * 5 % 256) - 128) || (LOG_MODE(r) != i % 6) || (LOG_LENS(r) != i % 6) || (LOG_LAP(r) != 1)){
+			printf("FAIL old log record %u: %08x read as %08x\n", i, mock_eeprom[LOG_BASE + i], r);
+			fails++;
+		}
+	}
+	memset(mock_eeprom, 0, sizeof(mock_eeprom));
+}
+
+/* reads the export stream back and checks it against the frames shot */
+static uint32_t check_export(FILE *f){
+	uint8_t h[6], b[4], s1 = 0, s2 = 0, k;
+	uint32_t n, i, bad = 0, first;
+	rewind(f);
+	if(fread(h, 1, 6, f) != 6 || memcmp(h, LOG_MAGIC, 4)) return 1;
+	n = h[4] | (h[5] << 8);
+	if(n != (shot < LOG_WORDS ? shot : LOG_WORDS)) return 1;
+	first = shot - n;
+	for(i = 0; i < n; i++){
+		uint32_t r = 0;
+		if(fread(b, 1, 4, f) != 4) return 1;
+		for(k = 0; k < 4; k++){
+			r |= (uint32_t)b[k] << (8 * k);
+			s1 = (s1 + b[k]) % 255;
+			s2 = (s2 + s1) % 255;
+		}
+		if((r & 0x3FFFFFFFu) != truth[first + i]) bad++;
+	}
+	if(fread(b, 1, 2, f) != 2 || b[0] != s1 || b[1] != s2) return 1;
+	return bad;
+}
+
+int main(int argc, char **argv){
+	uint32_t n, cuts = 0, lag_sum = 0, lag_max = 0, i, wear_max = 0, wear_min = ~0u, bad = 0;
+	FILE *f;
+
+	mock_scene_lux  = scene;
+	mock_sensor_isr = meter_ready_isr;
+	mock_i2c_isr    = meter_sample_isr;
+	mock_lens_isr   = lens_isr;
+	mock_mirror_isr = release_mirror_isr;
+	mock_tim_isr    = shutter_timer_isr;
+	mock_eeprom_isr = log_eeprom_isr;
+	slr_init();
+	shutter_init(Shutter_hw_edges);
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+	lens_init();
+	check_old(40);
+	log_init();
+	run_us(1000 * MS);
+	if(!SLR_Lens.valid){ printf("FAIL lens not identified\n"); return 1; }
+
+	srand(17);
+	for(n = 0; shot < FRAMES; ){
+		uint32_t burst = 1 + rand() % 8, ms;
+		while(burst-- && shot < FRAMES){
+			SLR_Mode = (cameramode_t)(rand() % 6);
+			SLR_ISO = rand() % 4;
+			SLR_Av = APEX_AV(3 + rand() % 8);
+			SLR_Tv = APEX_TV(4 + rand() % 8);
+			SLR_Shift = rand() % 5 - 2;
+			slr_publish();
+			release_press();
+			for(ms = 0; ms < 3000 && SLR_Release.state != RELEASE_IDLE; ms++) run_us(MS);
+			if(SLR_Release.error || !(SLR_Release.done & (1u << REL_CLOSED))) continue;
+			truth[shot++] = SLR_Release.frame;
+			n++;
+			lag_sum += release_lag();
+			if(release_lag() > lag_max) lag_max = release_lag();
+			/* the power cut, now and then, anywhere in the next 5 ms */
+			if(rand() % 100 == 0){
+				run_us(LOOP_US * (rand() % 250));
+				power_cut();
+				cuts++;
+			}
+		}
+		run_us(rand() % (300 * MS));
+	}
+	/* all written */
+	for(i = 0; i < 100 && (log_pending() || log_busy()); i++) run_us(MS);
+
+	for(i = 0; i < log_count(); i++)
+		if((log_read(i) & 0x3FFFFFFFu) != truth[shot - log_count() + i]) bad++;
+	if(bad){ printf("FAIL %u records differ from the frames shot\n", bad); fails++; }
+	if(SLR_Log.dropped){ printf("FAIL %u frames dropped by a full queue\n", SLR_Log.dropped); fails++; }
+	if(overlaps){ printf("FAIL %u EEPROM writes started during a release\n", overlaps); fails++; }
+	if(mock_eeprom_errors){ printf("FAIL %u writes on a busy EEPROM\n", mock_eeprom_errors); fails++; }
+	power_cut();
+
+	f = (argc > 1) ? fopen(argv[1], "w+b") : tmpfile();
+	if(!f){ perror("sim_log"); return 2; }
+	mock_uart = f;
+	log_export();
+	fflush(f);
+	mock_uart = NULL;
+	if(check_export(f)){ printf("FAIL bad export stream\n"); fails++; }
+	if(mock_uart_overruns){ printf("FAIL %u UART writes over one in flight\n", mock_uart_overruns); fails++; }
+	fclose(f);
+
+	for(i = 0; i < LOG_WORDS; i++){
+		if(mock_eeprom_wear[LOG_BASE + i] > wear_max) wear_max = mock_eeprom_wear[LOG_BASE + i];
+		if(mock_eeprom_wear[LOG_BASE + i] < wear_min) wear_min = mock_eeprom_wear[LOG_BASE + i];
+	}
+	printf("%u frames logged, %u power cuts (%u frames shot before them lost), %u EEPROM writes\n",
+		shot, cuts, n - shot, mock_eeprom_writes);
+	printf("log of %u words: %u laps, %u records in it; wear per word min %u max %u\n",
+		LOG_WORDS, shot / LOG_WORDS, log_count(), wear_min, wear_max);
+	printf("a fixed header rewritten every frame: %u writes on one word\n", shot);
+	printf("life at %u writes a word: %u frames here, %u with the %u words of the firmware\n",
+		ENDURANCE, ENDURANCE * LOG_WORDS, ENDURANCE * (HAL_EEPROM_WORDS - LOG_BASE - LOG_KEEP), HAL_EEPROM_WORDS - LOG_BASE - LOG_KEEP);
+	printf("queue: deepest %u of %u; shutter lag mean %.1f ms, worst %.1f ms\n",
+		deepest, LOG_QUEUE, lag_sum / 1000.0 / n, lag_max / 1000.0);
+	if(argc > 1) printf("export saved to %s\n", argv[1]);
+	return fails ? 1 : 0;
+}
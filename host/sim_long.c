@@ -0,0 +1,214 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Long exposures (slr_long.h) on a simulated RTC crystal 23.7 ppm fast at
+ *  25 C, measured as 23.7 (SLR_RTC_PPM10), and going off by -0.034 ppm/C^2
+ *  away from it. Times exposures from 1 s to 4 h at the curtains, started
+ *  at random, at 25 C with and without the correction, and at 5 C with
+ *  the one of 25 C. Then the reciprocity of every film against
+ *  Schwarzschild's law in floating point, and, through the main loop, a
+ *  metered AV exposure of a dark scene on HP5, bulb, the bulb timer, and
+ *  bulb let go before the first curtain.
+ *
+ *  Fails on a corrected exposure drifting 1 ms a minute or more (plus one
+ *  crystal tick), a film time off by more than 1/24 stop (the metered one
+ *  by more than 1/48, half its step), an interrupt that can't wake the MCU
+ *  from Stop mode coming in it, a long exposure spending less than 99% of
+ *  its time in Stop mode or with the meter powered, or a bulb timer off by
+ *  more than a millisecond, or a bulb let go in the mirror time leaving
+ *  the shutter open.
+ */
+#define SLR_RTC_PPM10 237
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../slr_power.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define S  1000000u
+#define LOOP_US 20
+#define PPM_25C 23.7
+
+static const uint32_t times_ms[] = {1000, 2000, 4000, 8000, 15000, 30000, 60000, 120000, 300000,
+	600000, 1800000, 3600000, 4 * 3600000u};
+#define TIMES (sizeof(times_ms) / sizeof(times_ms[0]))
+
+static const char *film_name[FILMS] = {"none", "Tri-X 400", "HP5+", "FP4+", "Delta 100",
+	"Acros II", "Portra 400", "Velvia 50"};
+
+static double lux = 7.0;   /* EV 2 */
+static double scene(uint32_t us){ (void)us; return lux; }
+static void lens_isr(void){ lens_xfer_isr(); }
+
+/* an exposure of ms at the curtains, us off - the MCU in Stop mode */
+static double expose(uint32_t ms){
+	mock_run_us(rand() % S);
+	long_start(ms);
+	while(long_busy()) hal_sleep(1);
+	return (double)(mock_curtain_at[1] - mock_curtain_at[0]) - ms * 1000.0;
+}
+
+/* the drift of every time, us a minute; the worst over the budget */
+static uint32_t drift(const char *what, double ppm, int16_t ppm10, double *err, uint8_t check){
+	uint32_t k, fails = 0;
+	mock_rtc_ppm = ppm;
+	SLR_Long.ppm10 = ppm10;
+	for(k = 0; k < TIMES; k++){
+		double e = expose(times_ms[k]);
+		err[k] = e / (times_ms[k] / 60000.0);
+		if(check && (fabs(e) > times_ms[k] / 60.0 + 1e6 / LONG_HZ)){
+			printf("FAIL %s, %u ms: %.0f us off\n", what, times_ms[k], e);
+			fails++;
+		}
+	}
+	return fails;
+}
+
+/* the main loop until the release is over, or for us */
+static void loop_us(uint32_t us){
+	uint32_t t0 = hal_micros();
+	while(hal_micros() - t0 < us){
+		mock_run_us(LOOP_US);
+		power_loop();
+	}
+}
+
+static void loop_release(void){
+	while(SLR_Release.state != RELEASE_IDLE){
+		mock_run_us(LOOP_US);
+		power_loop();
+	}
+}
+
+int main(void){
+	double warm[TIMES], raw[TIMES], cold[TIMES];
+	uint32_t fails = 0, k, stop0, t0, sensor0;
+	uint8_t f, rest[INPUT_DIALS] = {3, 3, 3};
+	double want, got, e;
+	int16_t s;
+
+	srand(19);
+	mock_rtc_isr = long_rtc_isr;
+	long_init();
+
+	/* -- drift ---------------------------------------------------------- */
+	fails += drift("25 C", PPM_25C, SLR_RTC_PPM10, warm, 1);
+	drift("25 C, no correction", PPM_25C, 0, raw, 0);
+	fails += drift("5 C", PPM_25C - 0.034 * 20 * 20, SLR_RTC_PPM10, cold, 1);
+	printf("drift, ms a minute (LSE %.1f ppm at 25 C, corrected %.1f; a 1%% HSI delay loop: 600)\n",
+		PPM_25C, SLR_RTC_PPM10 / 10.0);
+	printf("%9s | %8s %8s %8s\n", "time", "25 C", "no corr", "5 C");
+	for(k = 0; k < TIMES; k++)
+		printf("%7.0f s | %8.3f %8.3f %8.3f\n", times_ms[k] / 1000.0, warm[k] / 1000, raw[k] / 1000, cold[k] / 1000);
+	printf("4 h in %u RTC wakes\n", SLR_Long.wakes);
+	if(mock_stop_errors){ printf("FAIL %u interrupts that can't wake from Stop mode came in it\n", mock_stop_errors); fails++; }
+
+	/* -- reciprocity ---------------------------------------------------- */
+	printf("\nreciprocity, metered -> film time, s (Schwarzschild in floating point)\n");
+	for(f = 0; f < FILMS; f++){
+		printf("%-10s", film_name[f]);
+		for(s = 0; s >= -10 * APEX_UNIT; s -= 80){
+			double tm = pow(2.0, -s / 24.0), t0s = (Film_t0[f] == INT16_MAX) ? 1e9 : pow(2.0, Film_t0[f] / 24.0);
+			want = (tm <= t0s) ? tm : t0s * pow(tm / t0s, Film_p[f] / 256.0);
+			got  = long_tv_ms(long_reciprocity(s, f)) / 1000.0;
+			printf(" | %6.1f %7.1f", tm, got);
+			if(want < LONG_MAX_MS / 1000.0 && fabs(log2(got / want)) > 1.0 / 24){
+				printf("\nFAIL %s, %.1f s: %.1f, not %.1f\n", film_name[f], tm, got, want);
+				fails++;
+			}
+		}
+		printf("\n");
+	}
+
+	/* -- through the release -------------------------------------------- */
+	mock_rtc_ppm       = PPM_25C;
+	SLR_Long.ppm10     = SLR_RTC_PPM10;
+	SLR_Long.film      = FILM_HP5;
+	mock_scene_lux     = scene;
+	mock_sensor_isr    = meter_ready_isr;
+	mock_i2c_isr       = meter_sample_isr;
+	mock_lens_isr      = lens_isr;
+	mock_mirror_isr    = release_mirror_isr;
+	mock_tim_isr       = shutter_timer_isr;
+	mock_display_isr   = display_xfer_isr;
+	mock_eeprom_isr    = log_eeprom_isr;
+	slr_init();
+	shutter_init(Shutter_hw_edges);
+	display_init();
+	input_init(rest);
+	log_init();
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+	lens_init();
+	power_init();
+	loop_us(2 * S);
+	if(!SLR_Lens.valid){ printf("FAIL lens not identified\n"); return 1; }
+
+	/* AV at f/5.6, EV 2 at ISO 100: 8 s metered */
+	SLR_Mode = AV;
+	SLR_Av   = APEX_AV(6);
+	SLR_ISO  = 2;
+	power_halfpress_isr(0);
+	power_halfpress_isr(1);
+	loop_us(500 * MS);
+	release_press();
+	while(SLR_Long.state != LONG_OPEN && SLR_Release.state != RELEASE_IDLE){ mock_run_us(LOOP_US); power_loop(); }
+	stop0 = mock_sleep_us[1]; t0 = hal_micros(); sensor0 = mock_sensor_on_us;
+	loop_release();
+	if(SLR_Release.error || SLR_Release.tv >= 0){ printf("FAIL AV: error %u, Tv %d\n", SLR_Release.error, SLR_Release.tv); return 1; }
+	s = apex_ev24(LOG_EV8(SLR_Release.frame), SLR_ISO) - SLR_Av;
+	want = 1000.0 * pow(pow(2.0, -s / 24.0), Film_p[FILM_HP5] / 256.0);
+	e = (double)(mock_curtain_at[1] - mock_curtain_at[0]) - SLR_Release.long_ms * 1000.0;
+	k = SLR_Long.close_us - t0;
+	printf("\nAV f/%.1f EV %.2f on HP5+: metered %.1f s, exposed %.3f s (%.3f s wanted), %.0f us off\n",
+		pow(2.0, SLR_Av / 48.0), LOG_EV8(SLR_Release.frame) / 8.0, pow(2.0, -s / 24.0),
+		SLR_Release.long_ms / 1000.0, want / 1000, e);
+	printf("  open to closed: %.2f%% in Stop mode, %u RTC wakes\n", 100.0 * (mock_sleep_us[1] - stop0) / k, SLR_Long.wakes);
+	/* the film time is worked out to 1/24 stop */
+	if(fabs(log2(SLR_Release.long_ms / want)) > 1.0 / 48 + 1e-4){ printf("FAIL AV: %u ms, not %.0f\n", SLR_Release.long_ms, want); fails++; }
+	if(fabs(e) > SLR_Release.long_ms / 60.0 + 1e6 / LONG_HZ){ printf("FAIL AV: %.0f us off\n", e); fails++; }
+	if(mock_sleep_us[1] - stop0 < 0.99 * k){ printf("FAIL AV: not in Stop mode\n"); fails++; }
+	if(mock_sensor_on_us != sensor0 || SLR_Meter.on){ printf("FAIL AV: meter powered through the exposure\n"); fails++; }
+
+	/* bulb, held 37.3 s, then the bulb timer at 30 s */
+	for(k = 0; k < 2; k++){
+		uint32_t hold = 37300 * MS;
+		SLR_Mode = MA;
+		SLR_Tv   = APEX_BULB;
+		SLR_Long.preset_ms = k ? 30000 : 0;
+		power_halfpress_isr(0);
+		power_halfpress_isr(1);
+		loop_us(500 * MS);
+		release_press();
+		while(SLR_Long.state != LONG_OPEN && SLR_Release.state != RELEASE_IDLE){ mock_run_us(LOOP_US); power_loop(); }
+		loop_us(hold);
+		release_let_go();
+		loop_release();
+		got = (double)(mock_curtain_at[1] - mock_curtain_at[0]);
+		want = k ? 30000 * 1000.0 : got;
+		printf("%s: open %.6f s, bulb timer %.3f s\n", k ? "bulb timer 30 s" : "bulb", got / 1e6, long_elapsed_ms() / 1000.0);
+		if(SLR_Release.error || fabs(long_elapsed_ms() * 1000.0 - got) > 1000 || fabs(got - want) > want / 60e6 * 1000 + 1e6 / LONG_HZ){
+			printf("FAIL %s: error %u, timer %u ms for %.0f us\n", k ? "bulb timer" : "bulb", SLR_Release.error, long_elapsed_ms(), got);
+			fails++;
+		}
+	}
+	/* bulb let go before the first curtain, with the mirror going up:
+	 * a tick open, and the release over */
+	SLR_Long.preset_ms = 0;
+	power_halfpress_isr(0);
+	power_halfpress_isr(1);
+	loop_us(500 * MS);
+	release_press();
+	while(SLR_Release.state != RELEASE_PREPARING && SLR_Release.state != RELEASE_IDLE){ mock_run_us(LOOP_US); power_loop(); }
+	release_let_go();
+	loop_us(2 * S);
+	got = (double)(mock_curtain_at[1] - mock_curtain_at[0]);
+	printf("bulb let go in the mirror time: open %.0f us, release %s\n", got, SLR_Release.state ? "still running" : "over");
+	if(SLR_Release.state != RELEASE_IDLE || SLR_Release.error || SLR_Long.state != LONG_DONE || got > 2e6 / LONG_HZ){
+		printf("FAIL early let go: state %u, error %u, open %.0f us\n", SLR_Release.state, SLR_Release.error, got);
+		fails++;
+	}
+	if(mock_stop_errors){ printf("FAIL %u interrupts that can't wake from Stop mode came in it\n", mock_stop_errors); fails++; }
+	return fails ? 1 : 0;
+}
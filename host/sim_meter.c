@@ -0,0 +1,93 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Metering pipeline on the simulated TSL2591: replays a lux trace (steps,
+ *  a ramp and a flicker of +-0.1 stop across a stop boundary), runs the
+ *  main loop every millisecond and "half-presses" every 37 ms. Reports per
+ *  segment the time to the first reading within 1/8 stop, the reading error
+ *  and the SLR_EV changes once settled (400 ms into the segment), and the
+ *  half-press to reading latency. Fails on dropped samples, on a settled
+ *  reading off by more than 1/8 stop, or if the hysteresis lets SLR_EV flip
+ *  on the boundary.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include "../slr_meter.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+
+typedef struct {
+	const char *name;
+	uint32_t from, to;  /* ms */
+	double   lux0, lux1;/* log ramp from lux0 to lux1, or a flicker around lux0 if lux1 < 0 */
+} segment_t;
+
+static const segment_t trace[] = {
+	{"room, 60 lux",          0, 1000,    60,    60},
+	{"step up to 1200 lux", 1000, 2000,  1200,  1200},
+	{"ramp to 30000 lux",   2000, 4000,  1200, 30000},
+	{"EV 10 +-0.1 stop",    4000, 6000,  1792,    -1},
+	{"step down to 150 lux",6000, 7000,   150,   150},
+};
+#define SEGMENTS (sizeof(trace) / sizeof(trace[0]))
+
+static double scene(uint32_t us){
+	uint32_t i, ms = us / MS;
+	for(i = 0; i < SEGMENTS; i++)
+		if(ms < trace[i].to){
+			double f = (double)(us - trace[i].from * MS) / ((trace[i].to - trace[i].from) * MS);
+			if(trace[i].lux1 < 0) return trace[i].lux0 * pow(2.0, 0.1 * sin(2 * M_PI * us / 700000.0));
+			return trace[i].lux0 * pow(trace[i].lux1 / trace[i].lux0, f);
+		}
+	return trace[SEGMENTS - 1].lux1;
+}
+
+int main(void){
+	uint32_t seg, ms, fails = 0, presses = 0, misses = 0;
+
+	mock_scene_lux  = scene;
+	mock_sensor_isr = meter_ready_isr;
+	mock_i2c_isr    = meter_sample_isr;
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 0);
+
+	printf("%-22s %10s %10s %10s %8s\n", "segment", "settle ms", "max err", "EV flips", "EV");
+	for(seg = 0; seg < SEGMENTS; seg++){
+		const segment_t *s = &trace[seg];
+		int32_t settle = -1, max_err = 0;
+		uint32_t flips = 0;
+		uint8_t last_ev = SLR_Meter.ev;
+		for(ms = s->from; ms < s->to; ms++){
+			mock_run_us(MS);
+			meter_poll();
+			if(SLR_Meter.ev != last_ev){
+				if(ms - s->from >= 400) flips++;
+				last_ev = SLR_Meter.ev;
+			}
+			if((ms % 37) == 0){
+				uint32_t t0 = hal_micros();
+				int32_t truth, err;
+				presses++;
+				if(!read_exposure()){ misses++; continue; }
+				if(hal_micros() != t0) fails++;   /* it never waits */
+				truth = getEV8((uint32_t)(scene(t0) * 256.0));
+				err = SLR_EV8 - truth;
+				if(err < 0) err = -err;
+				if(settle < 0 && err <= 1) settle = ms - s->from;
+				/* steady scenes: settled readings within 1/8 stop */
+				if(s->lux1 == s->lux0 && ms - s->from >= 400 && ms + 1 < s->to && err > max_err)
+					max_err = err;
+			}
+		}
+		printf("%-22s %10d %7d/8 %10u %8u\n", s->name, settle, max_err, flips, SLR_Meter.ev);
+		if(max_err > 1){ printf("FAIL %s: reading off by %d/8 stop\n", s->name, max_err); fails++; }
+		if(s->lux1 < 0 && flips){ printf("FAIL %s: SLR_EV flipped %u times\n", s->name, flips); fails++; }
+	}
+	printf("half-press to reading: 0 us (blocking read: %u us), %u/%u presses before the first reading\n",
+		100000 + mock_i2c_us, misses, presses);
+	printf("samples: %u, dropped %u, saturated %u\n",
+		mock_sensor_samples, SLR_Meter.dropped, SLR_Meter.overflows);
+	if(SLR_Meter.dropped){ printf("FAIL dropped samples\n"); fails++; }
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,183 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  The tickless main loop (slr_power.h) over half an hour of use: a pin
+ *  trace of half-presses (held 0.2..3 s, bouncing) and dial bursts, 2 s to
+ *  2 minutes apart, in a room of about 400 lux. Every pass of the main
+ *  loop costs 20 us of run time; the rest is spent in Sleep or Stop mode,
+ *  as the loop chooses. Reports the duty cycle, the time the sensor was
+ *  powered, the mean current it all comes to (typical datasheet figures,
+ *  see below) against a loop that never sleeps, and the half-press to
+ *  first valid EV latency from Stop. Fails on an interrupt that can't wake
+ *  the MCU from Stop mode coming while in it, on a half-press left without
+ *  its EV, on a cold start slower than two integrations, on a detent
+ *  lost, or on a sensor interrupt left over from before the meter was
+ *  stopped reading or powering the sensor up again.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../slr_power.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define S  1000000u
+#define LOOP_US 20
+#define SESSION (30 * 60 * S)
+#define SRC_HALFPRESS 5
+#define SRC_END       7
+
+/* typical supply currents, uA: STM32L151 at 32 MHz running, in Sleep mode
+ * with the timers and DMA clocked, in Stop mode with the RTC; the TSL2591
+ * powered and down
+ */
+#define UA_RUN     7000.0
+#define UA_SLEEP   1500.0
+#define UA_STOP       1.3
+#define UA_SENSOR   275.0
+#define UA_SENSOR_OFF 2.3
+
+static mock_edge_t *trace;
+static uint32_t edges, cap;
+static uint8_t pins[MOCK_INPUTS];
+static int32_t truth[INPUT_DIALS];
+
+static void edge(uint32_t us, uint8_t src, uint8_t p){
+	if(edges == cap){
+		cap = cap ? 2 * cap : 4096;
+		trace = realloc(trace, cap * sizeof(mock_edge_t));
+		if(!trace){ perror("sim_power"); exit(2); }
+	}
+	pins[src] = p;
+	trace[edges].us   = us;
+	trace[edges].src  = src;
+	trace[edges].pins = p;
+	edges++;
+}
+
+/* a contact closing or opening, with a few bounces */
+static uint32_t bouncy(uint32_t t, uint8_t src, uint8_t p){
+	uint8_t from = pins[src], n = 2 * (rand() % 3);
+	while(n--){
+		edge(t, src, (n & 1) ? p : from);
+		t += 20 + rand() % 200;
+	}
+	edge(t, src, p);
+	return t;
+}
+
+/* n detents at 5..50 a second */
+static uint32_t turn(uint32_t t, uint8_t dial, uint8_t dir, uint32_t n){
+	static const uint8_t up[4] = {2, 0, 1, 3}, down[4] = {1, 0, 2, 3};
+	uint32_t quarter = 250000 / (5 + rand() % 46), k, q;
+	for(k = 0; k < n; k++){
+		for(q = 0; q < 4; q++){
+			t += quarter;
+			edge(t, dial, dir ? up[q] : down[q]);
+		}
+		truth[dial] += dir ? 1 : -1;
+	}
+	return t;
+}
+
+static uint32_t halfpress(uint32_t t){
+	t = bouncy(t, SRC_HALFPRESS, 0);
+	return bouncy(t + 200 * MS + rand() % (2800 * MS), SRC_HALFPRESS, 1);
+}
+
+static void input_isr(uint8_t src, uint8_t p, uint16_t capture){
+	if(src < INPUT_DIALS)          input_encoder_isr(src, p);
+	else if(src < INPUT_SOURCES)   input_button_isr(src, p, capture);
+	else if(src == SRC_HALFPRESS)  power_halfpress_isr(p);
+}
+
+static double scene(uint32_t us){ return 400.0 * (1.0 + 0.2 * sin(us / 60e6)); }
+
+/* the sensor interrupts of an integration that ended as the meter was
+ * stopped, run after it: no read, and no config powering it up again
+ */
+static uint32_t check_stop(void){
+	uint32_t fails = 0;
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+	meter_stop();
+	meter_ready_isr();
+	if(SLR_Meter.reading){ printf("FAIL a read started on the stopped sensor\n"); fails++; }
+	meter_sample_isr(10, 2);   /* dark: the controller wants more gain */
+	if(mock_sensor_powered()){ printf("FAIL the stopped sensor powered up again\n"); fails++; }
+	return fails;
+}
+
+int main(void){
+	uint32_t t = S, run, presses = 0, detents = 0, fails = 0, sensor_us;
+	uint8_t s, rest[INPUT_DIALS] = {3, 3, 3};
+	double ua, ua_on;
+
+	fails += check_stop();
+
+	srand(15);
+	for(s = 0; s < MOCK_INPUTS; s++) pins[s] = (s < INPUT_DIALS) ? 3 : 1;
+	while(t < SESSION - 10 * S){
+		uint32_t r = rand() % 10;
+		if(r < 5){
+			t = halfpress(t);
+			presses++;
+		}else if(r < 8){
+			uint32_t n = 1 + rand() % 8;
+			t = turn(t, rand() % INPUT_DIALS, rand() & 1, n);
+			detents += n;
+		}else{
+			uint32_t n = 1 + rand() % 8;
+			t = halfpress(t);
+			t = turn(t + 300 * MS, rand() % INPUT_DIALS, rand() & 1, n);
+			presses++;
+			detents += n;
+		}
+		t += 2 * S + rand() % (118 * S);
+	}
+	/* nothing wakes the MCU after the trace: the end of the session does */
+	edge(SESSION, SRC_END, 1);
+
+	mock_scene_lux  = scene;
+	mock_sensor_isr = meter_ready_isr;
+	mock_i2c_isr    = meter_sample_isr;
+	mock_input_isr  = input_isr;
+	mock_display_isr = display_xfer_isr;
+	slr_init();
+	display_init();
+	input_init(rest);
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+	power_init();
+	mock_input_start(trace, edges);
+	while(hal_micros() < SESSION){
+		mock_run_us(LOOP_US);   /* the pass itself */
+		power_loop();
+	}
+	if(SLR_Meter.on) meter_stop();
+	sensor_us = mock_sensor_on_us;
+
+	run = SESSION - mock_sleep_us[0] - mock_sleep_us[1];
+	ua = (UA_RUN * run + UA_SLEEP * mock_sleep_us[0] + UA_STOP * mock_sleep_us[1]) / SESSION
+	   + (UA_SENSOR * sensor_us + UA_SENSOR_OFF * (SESSION - sensor_us)) / SESSION;
+	ua_on = UA_RUN + UA_SENSOR;
+
+	printf("%u s of use: %u half-presses, %u detents, %u edges\n", SESSION / S, presses, detents, edges);
+	printf("time: run %.3f%%, Sleep %.2f%%, Stop %.2f%%; %u sleeps, %u stops\n",
+		100.0 * run / SESSION, 100.0 * mock_sleep_us[0] / SESSION, 100.0 * mock_sleep_us[1] / SESSION,
+		mock_sleeps[0], mock_sleeps[1]);
+	printf("display: %u updates, %u bytes\n", SLR_Display.updates, mock_display_bytes);
+	printf("sensor powered %.1f%% of the time\n", 100.0 * sensor_us / SESSION);
+	printf("mean current %.1f uA (never sleeping, sensor always on: %.0f uA)\n", ua, ua_on);
+	printf("half-press to first valid EV from Stop: %u cold starts, mean %.1f ms, max %.1f ms\n",
+		SLR_Power.colds, SLR_Power.colds ? SLR_Power.latency_sum_us / 1000.0 / SLR_Power.colds : 0.0,
+		SLR_Power.latency_max_us / 1000.0);
+
+	if(mock_stop_errors){ printf("FAIL %u interrupts that can't wake from Stop mode came in it\n", mock_stop_errors); fails++; }
+	if(SLR_Power.waiting){ printf("FAIL a half-press without its EV\n"); fails++; }
+	if(!SLR_Power.colds){ printf("FAIL no cold start\n"); fails++; }
+	if(SLR_Power.latency_max_us > 2 * 100 * MS + LOOP_US * 10){ printf("FAIL cold start slower than two integrations\n"); fails++; }
+	for(s = 0; s < INPUT_DIALS; s++)
+		if(SLR_Input.net[s] != truth[s]){ printf("FAIL dial %u: %d detents, %d turned\n", s, SLR_Input.net[s], truth[s]); fails++; }
+	free(trace);
+	return fails ? 1 : 0;
+}
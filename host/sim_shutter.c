@@ -0,0 +1,84 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Shutter scheduler on the mock clock, for a shutter that goes to 1/8000
+ *  (SLR_TV_MAX_SPEED 1 - the microsecond speeds 1/8000..1/2000 are the
+ *  ones the timer must get right to the tick): every Tv index from
+ *  Tv_max_speed to 1 s is fired TRIALS times at random timer phases, with random interrupt
+ *  latency, once with the curtains on the timer outputs and once released
+ *  from the interrupt. Reports the achieved-vs-requested exposure error and
+ *  fails if the hardware edges are off by even one tick, or an exposure
+ *  doesn't complete. Then every third stop from 1 s up, the times the APEX
+ *  solver gives, with the longest delay shutter_fire_us() takes, which
+ *  must not change the exposure.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#define SLR_TV_MAX_SPEED 1
+#include "../slr_shutter.h"
+#include "../slr_apex.h"
+#include "hal_mock.h"
+
+#define TRIALS     200
+#define LATENCY_US 12   /* worst interrupt latency, other ISRs included */
+
+typedef struct { int32_t min, max; int64_t sum; uint32_t lost; } stat_t;
+
+static void run(uint8_t tv, uint8_t hw_edges, stat_t *st){
+	uint32_t n;
+	st->min = INT32_MAX; st->max = INT32_MIN; st->sum = 0; st->lost = 0;
+	shutter_init(hw_edges);
+	for(n = 0; n < TRIALS; n++){
+		int32_t err;
+		mock_run_us(1 + rand() % 70000);        /* random timer phase */
+		mock_curtain_us[0] = mock_curtain_us[1] = 0;
+		if(!shutter_fire(tv)){ st->lost++; continue; }
+		mock_run_us(Shutter_lead + Tv_speed[tv] + 1000);
+		if(SLR_Shutter.state != SHUTTER_DONE){ st->lost++; continue; }
+		err = (int32_t)(mock_curtain_us[1] - mock_curtain_us[0]) - (int32_t)Tv_speed[tv];
+		if(err < st->min) st->min = err;
+		if(err > st->max) st->max = err;
+		st->sum += err;
+	}
+}
+
+int main(void){
+	uint8_t tv;
+	int16_t t;
+	int fails = 0;
+
+	srand(1);
+	mock_tim_isr = shutter_timer_isr;
+	mock_isr_latency_us = LATENCY_US;
+	printf("Tv   1/x   requested |  timer edges: mean  min  max |   ISR edges: mean  min  max  (us)\n");
+	for(tv = Tv_max_speed; tv <= 14; tv++){
+		stat_t hw, sw;
+		run(tv, 1, &hw);
+		run(tv, 0, &sw);
+		printf("%2u %5u %10u us | %17.1f %4d %4d | %15.1f %4d %4d\n",
+			tv, Tv_markings[tv], Tv_speed[tv],
+			(double)hw.sum / TRIALS, hw.min, hw.max,
+			(double)sw.sum / TRIALS, sw.min, sw.max);
+		if(hw.lost || sw.lost || hw.min != 0 || hw.max != 0){
+			printf("FAIL Tv %u: %u/%u exposures lost, timer edge error %d..%d\n",
+				tv, hw.lost, sw.lost, hw.min, hw.max);
+			fails++;
+		}
+	}
+	/* the longest delay: the second curtain still after the first */
+	shutter_init(1);
+	for(t = 0; t <= APEX_TV(Tv_max_speed); t += APEX_THIRD){
+		uint32_t us = apex_tv_us(t);
+		int32_t err;
+		mock_run_us(1 + rand() % 70000);
+		if(!shutter_fire_us(us, 0xFFFF)){ printf("FAIL %u us, delayed: not fired\n", us); fails++; continue; }
+		mock_run_us(0x10000 + us + 1000);
+		err = (int32_t)(mock_curtain_us[1] - mock_curtain_us[0]) - (int32_t)us;
+		if(SLR_Shutter.state != SHUTTER_DONE || err){
+			printf("FAIL %u us, delayed 0xFFFF: %d us off\n", us, err);
+			fails++;
+		}
+	}
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  The camera logic built with its tracepoints on, on the simulated camera
+ *  of sim_release.c: 200 releases in AV and TV mode, with a half-press
+ *  (read_exposure() and getEV()) every 37 ms in between. The trace is
+ *  dumped through the mock UART after every release, to stdout - pipe it
+ *  into trace_hist ("make trace"). The timestamps are the host clock, so
+ *  they measure the logic on the PC, not the simulated time. Exits 1 if
+ *  events were lost or a UART write overran the one before.
+ */
+#define SLR_TRACE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../slr_release.h"
+#include "hal_mock.h"
+
+#define MS 1000u
+#define LOOP_US 20
+#define RELEASES 200
+
+static double scene(uint32_t us){ return 7168.0 * (1.0 + 0.2 * ((us / 100000) & 1)); }
+
+static void lens_isr(void){ lens_xfer_isr(); }
+
+static void run_us(uint32_t us){
+	uint32_t t;
+	for(t = 0; t < us; t += LOOP_US){
+		mock_run_us(LOOP_US);
+		meter_poll();
+		lens_poll();
+		release_poll();
+		if((hal_micros() % (37 * MS)) < LOOP_US && read_exposure()) getEV(SLR_LUX);
+	}
+}
+
+int main(void){
+	uint32_t n;
+
+	mock_scene_lux  = scene;
+	mock_sensor_isr = meter_ready_isr;
+	mock_i2c_isr    = meter_sample_isr;
+	mock_lens_isr   = lens_isr;
+	mock_mirror_isr = release_mirror_isr;
+	mock_tim_isr    = shutter_timer_isr;
+	TRACE_INIT();
+	slr_init();
+	shutter_init(Shutter_hw_edges);
+	meter_init(TSL2591_GAIN_LOW, TSL2591_IT_100MS, 1);
+	lens_init();
+	run_us(1000 * MS);
+	trace_dump();
+
+	srand(10);
+	for(n = 0; n < RELEASES; n++){
+		uint32_t ms;
+		SLR_Mode = (n & 1) ? TV : AV;
+		SLR_Av = APEX_AV(3 + rand() % 8);
+		SLR_Tv = APEX_TV(4 + rand() % 8);
+		release_press();
+		for(ms = 0; ms < 3000 && SLR_Release.state != RELEASE_IDLE; ms++) run_us(MS);
+		run_us(rand() % (200 * MS));
+		trace_dump();
+	}
+	return (SLR_Trace.lost || mock_uart_overruns) ? 1 : 0;
+}
@@ -0,0 +1,379 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    B A T C H   E X P O S U R E S
+ *    -----------------------------
+ *    The metering path of the camera, getEV() then solveExposure(), for
+ *    arrays of readings on the PC: a season of frame logs, planning film
+ *    and ISO. The camera works on one reading at a time, in the globals of
+ *    slr.h; here nothing is global - a batch_t says where the readings are
+ *    and where the results go, and any number of them can run at once.
+ *
+ *    Bit for bit the camera's answer:
+ *      - the EV is getEV8(), four or eight readings at a time with SSE2 or
+ *        AVX2. The leading one and the mantissa come out of the conversion
+ *        to double, which is exact for 32 bits; then the 1/8 stop
+ *        thresholds of EV8_threshold[], counted;
+ *      - the solve is solveExposure()'s own adds, compares and clamps, on
+ *        eight 16 bit lanes; the rounding to the step of the lens is a
+ *        multiply by its reciprocal in the batch_plan_t, exact over the
+ *        Av range of any lens.
+ *    The scalar kernel is the firmware code, and host/check_batch.c holds
+ *    the other two to it.
+ *
+ *    A batch_pool_t shares a batch out among threads, in BATCH_CHUNK
+ *    samples at a time - one batch at a time per pool.
+ */
+#ifndef SLR_BATCH_H
+#define SLR_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "../slr.h"
+#include "../slr_apex.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define BATCH_CHUNK       16384   /* samples a thread takes at a time, a multiple of 8 */
+#define BATCH_MAX_THREADS 64
+
+typedef enum { BATCH_SCALAR = 0, BATCH_SSE2, BATCH_AVX2, BATCH_ISAS} batch_isa_t;
+const char *Batch_isa_names[BATCH_ISAS] = {"scalar", "SSE2", "AVX2"};
+
+/** a batch of n readings, the exposure of x for all of them: its mode,
+ *  lens, program shift, and its ISO and Av or Tv where there is no array
+ */
+typedef struct {
+	size_t n;
+	const uint32_t *lux;  /* 1/256 lux, what getEV() takes                  */
+	const uint8_t  *iso;  /* ISO_values[] index, NULL: x.iso for all        */
+	const int16_t  *set;  /* APEX Tv in TV mode, Av in the others (PR
+	                         ignores it), NULL: x.tv / x.av                 */
+	exposure_t x;
+	/* results, any of them NULL if not wanted */
+	int16_t *ev8;         /* SLR_EV8 after getEV()                          */
+	uint8_t *ev;          /* SLR_EV                                         */
+	apex_t  *solved;      /* solveExposure()                                */
+} batch_t;
+
+/* what the kernels take from x, once per batch */
+typedef struct {
+	exposure_t  x;
+	apex_lens_t lens;
+	int16_t     fast;     /* APEX_TV(Tv_max_speed)                  */
+	uint16_t    av_div;   /* 65536 / lens.step, rounded up          */
+} batch_plan_t;
+
+typedef struct {
+	pthread_t       th[BATCH_MAX_THREADS];
+	uint8_t         threads;      /* workers; the caller works too        */
+	batch_isa_t     isa;
+	pthread_mutex_t lock;
+	pthread_cond_t  go, done;
+	uint32_t        gen;          /* batches given, wakes the workers     */
+	uint8_t         busy;         /* workers still on the batch           */
+	uint8_t         quit;
+	const batch_t      *job;
+	const batch_plan_t *plan;
+	size_t          next;         /* first sample nobody took yet         */
+} batch_pool_t;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* x with the ISO, the Av or Tv and the EV of a sample */
+static void batch_exposure(exposure_t *x, uint8_t iso, int16_t set, int16_t ev8, uint8_t ev){
+	x->iso = iso;
+	if(x->mode == TV) x->tv = set;
+	else x->av = set;
+	x->ev8 = ev8;
+	x->ev = ev;
+}
+
+/* The constants of a batch with the exposure x. */
+void batch_plan(batch_plan_t *p, const exposure_t *x){
+	p->x = *x;
+	apex_lens(x, &p->lens);
+	p->fast = APEX_TV(Tv_max_speed);
+	p->av_div = (uint16_t)((65536u + p->lens.step - 1) / p->lens.step);
+}
+
+/* getEV() without SLR_Exp */
+static inline uint8_t batch_ev(int16_t ev8){
+	if(ev8 < 0) ev8 = 0;
+	if(ev8 > 15 * 8) ev8 = 15 * 8;
+	return (uint8_t)(ev8 >> 3);
+}
+
+/* samples i to end, the firmware code one at a time */
+static void batch_scalar(const batch_plan_t *p, const batch_t *b, size_t i, size_t end){
+	for(; i < end; i++){
+		int16_t ev8 = getEV8(b->lux[i]);
+		uint8_t ev = batch_ev(ev8);
+		if(b->ev8) b->ev8[i] = ev8;
+		if(b->ev)  b->ev[i]  = ev;
+		if(b->solved){
+			exposure_t e = p->x;
+			batch_exposure(&e, b->iso ? b->iso[i] : p->x.iso,
+				b->set ? b->set[i] : ((p->x.mode == TV) ? p->x.tv : p->x.av), ev8, ev);
+			b->solved[i] = solveExposure(&e);
+		}
+	}
+}
+
+#if defined(__x86_64__)
+
+/* the Av or Tv of the batch, without an array */
+#define BATCH_SET(p) (((p)->x.mode == TV) ? (p)->x.tv : (p)->x.av)
+
+/* getEV8() of the two lux in the low half of v (offset by 2^31, as the
+ * conversion is signed), in the 64 bit lanes
+ */
+static inline __m128i batch_ev8_sse2(__m128i v){
+	__m128i bits, e, x, f;
+	uint8_t j;
+	bits = _mm_castpd_si128(_mm_add_pd(_mm_cvtepi32_pd(v), _mm_set1_pd(2147483648.0)));
+	e = _mm_srli_epi64(bits, 52);                         /* 31 - clz + 1023 */
+	x = _mm_and_si128(_mm_srli_epi64(bits, 21), _mm_set1_epi64x(0x7FFFFFFF)); /* the mantissa */
+	/* threshold 1 is under any mantissa, 10 over it; the others signed */
+	f = _mm_set1_epi64x(1);
+	for(j = 2; j < 10; j++) f = _mm_sub_epi64(f, _mm_cmpgt_epi32(x, _mm_set1_epi64x(EV8_threshold[j] - 0x80000000u)));
+	e = _mm_sub_epi64(e, _mm_set1_epi64x(1023 + 9));
+	return _mm_add_epi64(_mm_slli_epi64(e, 3), f);
+}
+
+/* apex_av_clamp() of the lens of the batch */
+static inline __m128i batch_av_clamp(const batch_plan_t *p, __m128i a){
+	const __m128i min = _mm_set1_epi16(p->lens.av_min);
+	a = _mm_min_epi16(_mm_max_epi16(a, min), _mm_set1_epi16(p->lens.av_max));
+	a = _mm_mulhi_epu16(_mm_add_epi16(_mm_sub_epi16(a, min), _mm_set1_epi16(p->lens.step >> 1)), _mm_set1_epi16((short)p->av_div));
+	return _mm_add_epi16(min, _mm_mullo_epi16(a, _mm_set1_epi16(p->lens.step)));
+}
+
+/* apex_tv_clamp() */
+static inline __m128i batch_tv_clamp(const batch_plan_t *p, __m128i t){
+	return _mm_min_epi16(_mm_max_epi16(t, _mm_setzero_si128()), _mm_set1_epi16(p->fast));
+}
+
+/* solveExposure() of the samples i to i + 7, their EV8 in ev8 - the same
+ * steps, eight at a time. Always inlined: called from the AVX2 kernel it
+ * must be VEX code too, a legacy SSE call there costs a state switch.
+ */
+static inline __attribute__((always_inline)) void batch_solve_sse2(const batch_plan_t *p, const batch_t *b, size_t i, __m128i ev8){
+	__m128i iso, set, e, av, tv, s;
+	int16_t a[8], t[8], r[8];
+	uint8_t j;
+	iso = b->iso ? _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(b->iso + i)), _mm_setzero_si128())
+	             : _mm_set1_epi16(p->x.iso);
+	set = b->set ? _mm_loadu_si128((const __m128i *)(b->set + i)) : _mm_set1_epi16(BATCH_SET(p));
+	/* apex_ev24() */
+	e = _mm_add_epi16(_mm_mullo_epi16(ev8, _mm_set1_epi16(3)),
+	                  _mm_mullo_epi16(_mm_sub_epi16(iso, _mm_set1_epi16(2)), _mm_set1_epi16(APEX_UNIT)));
+	switch(p->x.mode){
+	case MT:
+	case AV:
+		av = batch_av_clamp(p, set);
+		tv = _mm_min_epi16(_mm_sub_epi16(e, av), _mm_set1_epi16(p->fast));
+		break;
+	case TV:
+		tv = batch_tv_clamp(p, set);
+		av = batch_av_clamp(p, _mm_sub_epi16(e, tv));
+		break;
+	case PR:
+		av = _mm_sub_epi16(e, _mm_set1_epi16(APEX_TV_HAND));
+		av = batch_av_clamp(p, av);
+		tv = batch_tv_clamp(p, _mm_sub_epi16(e, av));
+		s  = _mm_set1_epi16(p->x.shift * APEX_UNIT);
+		s  = _mm_min_epi16(s, _mm_sub_epi16(av, _mm_set1_epi16(p->lens.av_min)));
+		s  = _mm_min_epi16(s, _mm_sub_epi16(_mm_set1_epi16(p->fast), tv));
+		s  = _mm_max_epi16(s, _mm_sub_epi16(av, _mm_set1_epi16(p->lens.av_max)));
+		s  = _mm_max_epi16(s, _mm_sub_epi16(_mm_setzero_si128(), tv));
+		av = batch_av_clamp(p, _mm_sub_epi16(av, s));
+		tv = batch_tv_clamp(p, _mm_add_epi16(tv, s));
+		break;
+	default:
+		av = set;
+		tv = _mm_set1_epi16(p->x.tv);
+		break;
+	}
+	_mm_storeu_si128((__m128i *)a, av);
+	_mm_storeu_si128((__m128i *)t, tv);
+	if((p->x.mode <= MA) && (p->x.tv == APEX_BULB)) memset(r, 0, sizeof(r));
+	else _mm_storeu_si128((__m128i *)r, _mm_sub_epi16(_mm_add_epi16(av, tv), e));
+	for(j = 0; j < 8; j++){
+		b->solved[i + j].av  = a[j];
+		b->solved[i + j].tv  = t[j];
+		b->solved[i + j].err = r[j];
+	}
+}
+
+static void batch_sse2(const batch_plan_t *p, const batch_t *b, size_t i, size_t end){
+	const __m128i sign = _mm_set1_epi32((int)0x80000000u);
+	for(; i + 8 <= end; i += 8){
+		__m128i v, w, lo, hi, ev8, ev;
+		v  = _mm_loadu_si128((const __m128i *)(b->lux + i));
+		w  = _mm_loadu_si128((const __m128i *)(b->lux + i + 4));
+		v  = _mm_xor_si128(_mm_sub_epi32(v, _mm_cmpeq_epi32(v, _mm_setzero_si128())), sign);
+		w  = _mm_xor_si128(_mm_sub_epi32(w, _mm_cmpeq_epi32(w, _mm_setzero_si128())), sign);
+		lo = _mm_unpacklo_epi64(_mm_shuffle_epi32(batch_ev8_sse2(v), _MM_SHUFFLE(3, 3, 2, 0)),
+		     _mm_shuffle_epi32(batch_ev8_sse2(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2))), _MM_SHUFFLE(3, 3, 2, 0)));
+		hi = _mm_unpacklo_epi64(_mm_shuffle_epi32(batch_ev8_sse2(w), _MM_SHUFFLE(3, 3, 2, 0)),
+		     _mm_shuffle_epi32(batch_ev8_sse2(_mm_shuffle_epi32(w, _MM_SHUFFLE(3, 2, 3, 2))), _MM_SHUFFLE(3, 3, 2, 0)));
+		ev8 = _mm_packs_epi32(lo, hi);
+		ev  = _mm_srli_epi16(_mm_min_epi16(_mm_max_epi16(ev8, _mm_setzero_si128()), _mm_set1_epi16(15 * 8)), 3);
+		if(b->ev8) _mm_storeu_si128((__m128i *)(b->ev8 + i), ev8);
+		if(b->ev) _mm_storel_epi64((__m128i *)(b->ev + i), _mm_packus_epi16(ev, ev));
+		if(b->solved) batch_solve_sse2(p, b, i, ev8);
+	}
+	batch_scalar(p, b, i, end);
+}
+
+/* the same, four lux at a time */
+__attribute__((target("avx2")))
+static inline __m256i batch_ev8_avx2(__m128i v){
+	__m256i bits, e, x, f;
+	uint8_t j;
+	bits = _mm256_castpd_si256(_mm256_add_pd(_mm256_cvtepi32_pd(v), _mm256_set1_pd(2147483648.0)));
+	e = _mm256_srli_epi64(bits, 52);
+	x = _mm256_and_si256(_mm256_srli_epi64(bits, 21), _mm256_set1_epi64x(0x7FFFFFFF));
+	f = _mm256_set1_epi64x(1);
+	for(j = 2; j < 10; j++) f = _mm256_sub_epi64(f, _mm256_cmpgt_epi32(x, _mm256_set1_epi64x(EV8_threshold[j] - 0x80000000u)));
+	e = _mm256_sub_epi64(e, _mm256_set1_epi64x(1023 + 9));
+	/* the low halves of the lanes, in the low 128 bits */
+	return _mm256_permutevar8x32_epi32(_mm256_add_epi64(_mm256_slli_epi64(e, 3), f), _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6));
+}
+
+__attribute__((target("avx2")))
+static void batch_avx2(const batch_plan_t *p, const batch_t *b, size_t i, size_t end){
+	const __m256i sign = _mm256_set1_epi32((int)0x80000000u);
+	for(; i + 8 <= end; i += 8){
+		__m256i v;
+		__m128i ev8, ev;
+		v   = _mm256_loadu_si256((const __m256i *)(b->lux + i));
+		v   = _mm256_xor_si256(_mm256_sub_epi32(v, _mm256_cmpeq_epi32(v, _mm256_setzero_si256())), sign);
+		ev8 = _mm_packs_epi32(_mm256_castsi256_si128(batch_ev8_avx2(_mm256_castsi256_si128(v))),
+		                      _mm256_castsi256_si128(batch_ev8_avx2(_mm256_extracti128_si256(v, 1))));
+		ev  = _mm_srli_epi16(_mm_min_epi16(_mm_max_epi16(ev8, _mm_setzero_si128()), _mm_set1_epi16(15 * 8)), 3);
+		if(b->ev8) _mm_storeu_si128((__m128i *)(b->ev8 + i), ev8);
+		if(b->ev) _mm_storel_epi64((__m128i *)(b->ev + i), _mm_packus_epi16(ev, ev));
+		if(b->solved) batch_solve_sse2(p, b, i, ev8);
+	}
+	batch_scalar(p, b, i, end);
+}
+
+#endif /* __x86_64__ */
+
+/* The best kernel this CPU runs. */
+batch_isa_t batch_isa_best(void){
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) return BATCH_AVX2;
+	return BATCH_SSE2;
+#else
+	return BATCH_SCALAR;
+#endif
+}
+
+/* samples i to end of b with the kernel isa (scalar if the CPU can't) */
+void batch_range(const batch_plan_t *p, const batch_t *b, batch_isa_t isa, size_t i, size_t end){
+	if(isa > batch_isa_best()) isa = BATCH_SCALAR;
+	switch(isa){
+#if defined(__x86_64__)
+	case BATCH_AVX2: batch_avx2(p, b, i, end); return;
+	case BATCH_SSE2: batch_sse2(p, b, i, end); return;
+#endif
+	default:         batch_scalar(p, b, i, end); return;
+	}
+}
+
+/* A whole batch, on this thread. */
+void batch_run(const batch_t *b, batch_isa_t isa){
+	batch_plan_t p;
+	batch_plan(&p, &b->x);
+	batch_range(&p, b, isa, 0, b->n);
+}
+
+/* -- the pool ----------------------------------------------------------- */
+
+/* chunks of the batch of the pool, until there are none left */
+static void batch_chunks(batch_pool_t *pool){
+	const batch_t *b = pool->job;
+	size_t i;
+	while((i = __atomic_fetch_add(&pool->next, BATCH_CHUNK, __ATOMIC_RELAXED)) < b->n)
+		batch_range(pool->plan, b, pool->isa, i, (b->n - i > BATCH_CHUNK) ? i + BATCH_CHUNK : b->n);
+}
+
+static void *batch_worker(void *arg){
+	batch_pool_t *pool = arg;
+	uint32_t gen = 0;
+	for(;;){
+		pthread_mutex_lock(&pool->lock);
+		while((pool->gen == gen) && !pool->quit) pthread_cond_wait(&pool->go, &pool->lock);
+		if(pool->quit){ pthread_mutex_unlock(&pool->lock); return NULL; }
+		gen = pool->gen;
+		pthread_mutex_unlock(&pool->lock);
+		batch_chunks(pool);
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->busy == 0) pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+void batch_pool_free(batch_pool_t *pool);
+
+/* Starts threads - 1 workers (the caller of batch_pool_run() is the last
+ * one) using the kernel isa. 0 if they can't all be started - then the
+ * ones that were are stopped again and there is nothing to free.
+ */
+uint8_t batch_pool_init(batch_pool_t *pool, uint8_t threads, batch_isa_t isa){
+	uint8_t t;
+	if(threads < 1) threads = 1;
+	if(threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+	pool->threads = 0;
+	pool->isa  = isa;
+	pool->gen  = 0;
+	pool->busy = pool->quit = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->go, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for(t = 0; t < threads - 1; t++){
+		if(pthread_create(&pool->th[t], NULL, batch_worker, pool)){ batch_pool_free(pool); return 0; }
+		pool->threads++;
+	}
+	return 1;
+}
+
+/* A whole batch, shared out - returns when it is done. */
+void batch_pool_run(batch_pool_t *pool, const batch_t *b){
+	batch_plan_t p;
+	batch_plan(&p, &b->x);
+	pthread_mutex_lock(&pool->lock);
+	pool->job  = b;
+	pool->plan = &p;
+	pool->next = 0;
+	pool->busy = pool->threads;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->go);
+	pthread_mutex_unlock(&pool->lock);
+	batch_chunks(pool);
+	pthread_mutex_lock(&pool->lock);
+	while(pool->busy) pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* Stops the workers of a pool batch_pool_init() started. */
+void batch_pool_free(batch_pool_t *pool){
+	uint8_t t;
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->go);
+	pthread_mutex_unlock(&pool->lock);
+	for(t = 0; t < pool->threads; t++) pthread_join(pool->th[t], NULL);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->go);
+	pthread_cond_destroy(&pool->done);
+}
+
+#endif /* SLR_BATCH_H */
@@ -0,0 +1,105 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *  Turns trace dumps (see slr_trace.h) into latency histograms: reads the
+ *  UART capture from the files given, or stdin, pairs every end event with
+ *  the begin of the same tracepoint and prints, per tracepoint, the count,
+ *  min / median / 99th percentile / max of the durations in microseconds,
+ *  and their power-of-two histogram in nanoseconds.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../slr_trace.h"
+
+#define TRACE_NAME(id, name) name,
+static const char *trace_name[TRACE_IDS] = { TRACE_POINTS(TRACE_NAME) };
+
+#define BUCKETS 32
+
+typedef struct {
+	uint32_t begin;          /* timestamp of the open begin event */
+	uint8_t  open;
+	uint32_t n, cap;
+	double  *us;             /* every duration                    */
+	uint32_t hist[BUCKETS];  /* [i]: 2^(i-1) <= ns < 2^i, [0]: < 1 */
+} stage_t;
+
+static stage_t stage[TRACE_IDS];
+static double hz = 1e9;
+static unsigned long lines, events, lost, orphans;
+
+static int cmp(const void *a, const void *b){
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static void add(stage_t *s, double us){
+	uint32_t b = 0;
+	if(s->n == s->cap){
+		s->cap = s->cap ? 2 * s->cap : 256;
+		s->us = realloc(s->us, s->cap * sizeof(double));
+		if(!s->us){ perror("trace_hist"); exit(2); }
+	}
+	s->us[s->n++] = us;
+	while(b < BUCKETS - 1 && us * 1000 >= (double)(1u << b)) b++;
+	s->hist[b]++;
+}
+
+static void parse(FILE *f){
+	char line[128];
+	unsigned long seq, id, arg, ts, v;
+	while(fgets(line, sizeof(line), f)){
+		lines++;
+		if(sscanf(line, "H %lx", &v) == 1){ hz = (double)v; continue; }
+		if(sscanf(line, "E %lx", &v) == 1){ lost = v; continue; }
+		if(sscanf(line, "T %lx %lx %lx %lx", &seq, &id, &arg, &ts) != 4) continue;
+		events++;
+		if((id & ~TRACE_END_BIT) >= TRACE_IDS) continue;
+		if(id & TRACE_END_BIT){
+			stage_t *s = &stage[id & ~TRACE_END_BIT];
+			if(!s->open){ orphans++; continue; }
+			s->open = 0;
+			add(s, (uint32_t)((uint32_t)ts - s->begin) * 1e6 / hz);
+		}else{
+			if(stage[id].open) orphans++;
+			stage[id].open  = 1;
+			stage[id].begin = (uint32_t)ts;
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	int i;
+	uint32_t b, max;
+
+	if(argc < 2) parse(stdin);
+	for(i = 1; i < argc; i++){
+		FILE *f = fopen(argv[i], "r");
+		if(!f){ perror(argv[i]); return 2; }
+		parse(f);
+		fclose(f);
+	}
+	printf("%lu lines, %lu events, %lu lost, %lu unpaired, clock %.0f Hz\n\n", lines, events, lost, orphans, hz);
+	for(i = 0; i < TRACE_IDS; i++){
+		stage_t *s = &stage[i];
+		if(!s->n) continue;
+		qsort(s->us, s->n, sizeof(double), cmp);
+		printf("%s: %u, min %.3f, median %.3f, p99 %.3f, max %.3f us\n", trace_name[i], s->n,
+			s->us[0], s->us[s->n / 2], s->us[(s->n * 99) / 100], s->us[s->n - 1]);
+		for(max = 0, b = 0; b < BUCKETS; b++) if(s->hist[b] > max) max = s->hist[b];
+		for(b = 0; b < BUCKETS; b++){
+			char bar[41];
+			uint32_t w;
+			if(!s->hist[b]) continue;
+			w = (s->hist[b] * 40 + max - 1) / max;
+			memset(bar, '#', w);
+			bar[w] = 0;
+			if(b == 0) printf("  %10s < 1 ns %8u %s\n", "", s->hist[b], bar);
+			else       printf("  %10u..%-10u ns %8u %s\n", 1u << (b - 1), 1u << b, s->hist[b], bar);
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -21,6 +21,9 @@
  *  ---------
  *  One of the two limitations I won't try to mendle is the 
  *  lightmeter sensor limitation. The range is from 0 EV to 15 EV. 
+ *  (The metering itself now goes from EV -12 to EV 15, with the sensor
+ *  gain and integration time following the light - see tsl2591_adapt() -
+ *  but the exposure tables still stop at 0..15 EV.)
  *
  *  The second limitation is dictated by the shutter's hardware 
  *  capabilities. If is handmade (Kevin Kadooka's one leaf shutter), it 
@@ -29,38 +32,58 @@
  *  1/1000 or 1/2000 (unless is from a more capable fullframe Canon DSLR).
  *  And, anything bellow 1 sec. speed is considered bulb mode - here, the 
  *  firmware won't help you to calculate your long exposures.
+ *  (Now it does: past 1 s the RTC times the exposure, with the reciprocity
+ *  of the film - see slr_long.h.)
  * 
  */
 
+#ifndef SLR_H
+#define SLR_H
+
+#include <stdint.h>
+#include "slr_hal.h"
+#include "slr_trace.h"
+
+/** Build with -DSLR_NO_FLOAT to prove the camera logic is integer only:
+ *  any float or double after this point is a compile error (see the
+ *  "nofloat" target of the Makefile, which also checks the object file for
+ *  soft-float helpers).
+ */
+#ifdef SLR_NO_FLOAT
+#pragma GCC poison float double
+#endif
+
 typedef enum { MANUAL = 0, EOS} lens_t;
 typedef enum { EOS50MM12 = 0, EOS50MM14, EOS50MM18, EOS85MM12, EOS85MM18} eos_t;
-typedef enum { IS = 0, MA, MT, AV, TV} cameramode_t;
+typedef enum { IS = 0, MA, MT, AV, TV, PR} cameramode_t;
 
 /** film sensitivity in ISO values - 160 will be treated as 100 ISO */
 const uint16_t ISO_values[8]={25,50,100,200,400,800,1600,3200};
 
 /** Shutter speeds.
- *  the array index will be used to determine if microseconds!
- *  got it? if index is between 1 and 3 is about microseconds 
- *  (you will use a microsecond delay function).
+ *  Exposure durations in microseconds, which are also the ticks of the
+ *  shutter timer (1 MHz, see slr_shutter.h) - one unit for every index,
+ *  no delay function to choose. They are the exact times of the whole
+ *  stops, 2^-n s, the ones apex_tv_us() gives: the marks are rounded, and
+ *  1/60 is 1/64 s.
  */
-const uint16_t Tv_speed[]={
-	777, /* speed error */
-	125, /* 1/8000, value in microseconds,  */
-	250, /* 1/4000,  -"- */
-	500, /* 1/2000,  -"- */
-	1,   /* 1/1000, value in milliseconds   */
-	2,   /* 1/500,   -"- */
-	4,   /* 1/250,   -"- */
-	8,   /* 1/125,   -"- */
-	17,  /* 1/60,    -"- */
-	33,  /* 1/30,    -"- */
-	67,  /* 1/15,    -"- */
-	125, /* 1/8,     -"- */
-	250, /* 1/4,     -"- */
-	500, /* 1/2,     -"- */
-	1000,/* 1,       -"- */
-	0    /* Bulb mode    */
+const uint32_t Tv_speed[]={
+	777,     /* speed error */
+	122,     /* 1/8000 */
+	244,     /* 1/4000 */
+	488,     /* 1/2000 */
+	977,     /* 1/1000 */
+	1953,    /* 1/500  */
+	3906,    /* 1/250  */
+	7813,    /* 1/125  */
+	15625,   /* 1/60   */
+	31250,   /* 1/30   */
+	62500,   /* 1/15   */
+	125000,  /* 1/8    */
+	250000,  /* 1/4    */
+	500000,  /* 1/2    */
+	1000000, /* 1      */
+	0        /* Bulb mode */
 };
 
 const uint16_t Tv_markings[]=
@@ -87,463 +110,488 @@ const uint16_t Tv_markings[]=
 /** USER CONSTANTS - user settable.
  *  You must set the maximum speed of your shutter by specifying the 
  *  index inside the ST_speed[] array. Default is 4, 
- *  meaning ST_speed[4] = 1, meaning 1/1000 maximum shutter speed.
+ *  meaning ST_speed[4] = 977us, meaning 1/1000 maximum shutter speed.
  *
  *  And you must set the minimum aperture value for the manual lens you will use
  *   it is 16 by default...
  *  I know, the shutter is a constant, a fixed mechanism, and a lens is a 
  *  variable, something you can change anytime, but let this be for a while.
  *  For the EOS lenses, this will be set automatically.
+ *  (Set them in the two defines - the program lines below are computed
+ *  from them at compile time.)
  */
-const uint8_t Tv_max_speed = 4; 
-const uint8_t Av_min_aperture = 9;
-
-/** aperture values (exceptions 1.2=12 1.7=20 1.8=22)
+#ifndef SLR_TV_MAX_SPEED
+#define SLR_TV_MAX_SPEED    4
+#endif
+#ifndef SLR_AV_MIN_APERTURE
+#define SLR_AV_MIN_APERTURE 9
+#endif
+const uint8_t Tv_max_speed = SLR_TV_MAX_SPEED; 
+const uint8_t Av_min_aperture = SLR_AV_MIN_APERTURE;
+
+/** aperture values, in tenths of f-number (exceptions 1.2=12 1.7=20 1.8=22)
  *                               8                                        88  96 104
  */                        /*0   1    2   3   4   5   6    7   8   9  10  11  12  13*/
-const float  Av_values[]   ={0,  1,  1.4, 2, 2.8, 4, 5.6,  8, 11, 16, 22, 32, 45, 64};
-/* Canon EF 50mm lenses */
-const int8_t EOSEF50mm12[] ={9, 12,  16, 24, 32, 40, 48,  56, 64, 72, -1, -1, -1, -1};
-const int8_t EOSEF50mm14[] ={10, 0,  16, 24, 32, 40, 48,  56, 64, 72, 80, -1, -1, -1};
-const int8_t EOSEF50mm18[] ={10, 0,  22, 24, 32, 40, 48,  56, 64, 72, 80, -1, -1, -1};
-/* Canon EF 85mm lenses */
-const int8_t EOSEF85mm12[] ={9, 12,  16, 24, 32, 40, 48,  56, 64, 72, -1, -1, -1, -1};
-const int8_t EOSEF85mm18[] ={10, 0,  22, 24, 32, 40, 48,  56, 64, 72, 80, -1, -1, -1};
-
-/* ========================================================================== */
-/* ======================== 25 ISO TABLES =================================== */
-/* ========================================================================== */
-
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Tv_speed[] array.
+const uint16_t Av_values[] ={0, 10,  14, 20, 28, 40, 56,  80,110,160,220,320,450,640};
+/** Canon EF lenses, in eos_t order: name, smallest aperture (Av_values[]
+ *  index), and the aperture codes at index 1 and 2 - 0 where the lens
+ *  doesn't open that far, 12 for f/1.2, 22 for f/1.8. From index 3 on the
+ *  code is 8 * index up to the smallest aperture, -1 past it. The EOSEF*
+ *  arrays and the program lines below are both made from this list.
  */
-const uint8_t AV01_25[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV14_25[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2}; 
-const uint8_t AV02_25[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV28_25[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV04_25[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV56_25[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-const uint8_t AV08_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7}; 
-const uint8_t AV11_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8}; 
-const uint8_t AV16_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9}; 
-const uint8_t AV22_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10}; 
-const uint8_t AV32_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11}; 
-const uint8_t AV45_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12}; 
-const uint8_t AV64_25[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
+#define SLR_EF_LENSES(X) \
+	X(EOSEF50mm12,  9, 12, 16) /* Canon EF 50mm lenses */ \
+	X(EOSEF50mm14, 10,  0, 16) \
+	X(EOSEF50mm18, 10,  0, 22) \
+	X(EOSEF85mm12,  9, 12, 16) /* Canon EF 85mm lenses */ \
+	X(EOSEF85mm18, 10,  0, 22)
+/* the widest aperture of a lens, Av_values[] index */
+#define SLR_EF_WIDE(c1) ((c1) > 0 ? 1 : 2)
+
+#define SLR_EF_AP(c,c1,c2,i) ((i) > (c) ? -1 : (i) == 1 ? (c1) : (i) == 2 ? (c2) : 8 * (i))
+#define SLR_EF_ARRAY(name,c,c1,c2) const int8_t name[] ={c, \
+	SLR_EF_AP(c,c1,c2, 1), SLR_EF_AP(c,c1,c2, 2), SLR_EF_AP(c,c1,c2, 3), SLR_EF_AP(c,c1,c2, 4), \
+	SLR_EF_AP(c,c1,c2, 5), SLR_EF_AP(c,c1,c2, 6), SLR_EF_AP(c,c1,c2, 7), SLR_EF_AP(c,c1,c2, 8), \
+	SLR_EF_AP(c,c1,c2, 9), SLR_EF_AP(c,c1,c2,10), SLR_EF_AP(c,c1,c2,11), SLR_EF_AP(c,c1,c2,12), \
+	SLR_EF_AP(c,c1,c2,13)};
+/*  EOSEF50mm12[] = {9, 12, 16, 24, 32, 40, 48, 56, 64, 72, -1, -1, -1, -1} and so on */
+SLR_EF_LENSES(SLR_EF_ARRAY)
+/* aperture codes of the EOS lenses, by eos_t */
+#define EOS_AP_NAME(name,c,c1,c2) name,
+const int8_t *const EOS_apertures[] = { SLR_EF_LENSES(EOS_AP_NAME) };
+
+/** APEX units of the exposure state: Av 0 = f/1, Tv 0 = 1 s, in 1/24
+ *  stops - 24 holds the third and the half stops of the dials and the 1/8
+ *  stops of the meter and of the EF lens (see slr_apex.h). An index of the
+ *  tables is a whole stop of them.
  */
-const uint8_t TV00001_25[] = {0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0}; 
-const uint8_t TV00012_25[] = {0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8,  9, 10, 11, 12, 13}; 
-const uint8_t TV00014_25[] = {0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7,  8,  9, 10, 11, 12}; 
-const uint8_t TV00018_25[] = {0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6,  7,  8,  9, 10, 11}; 
-const uint8_t TV00115_25[] = {0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5,  6,  7,  8,  9, 10}; 
-const uint8_t TV00130_25[] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4,  5,  6,  7,  8,  9}; 
-const uint8_t TV00160_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3,  4,  5,  6,  7,  8}; 
-const uint8_t TV01125_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2,  3,  4,  5,  6,  7}; 
-const uint8_t TV01250_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  2,  3,  4,  5,  6}; 
-const uint8_t TV01500_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  1,  2,  3,  4,  5}; 
-const uint8_t TV11000_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  1,  2,  3,  4}; 
-const uint8_t TV12000_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  1,  2,  3}; 
-const uint8_t TV14000_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  1,  2}; 
-const uint8_t TV18000_25[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  1}; 
-/* ==================== END 25 ISO TABLES =================================== */
-
+#define APEX_UNIT  24
+#define APEX_THIRD (APEX_UNIT / 3)          /* a click of the dials...   */
+#define APEX_HALF  (APEX_UNIT / 2)          /* ... or, set so, this one  */
+#define APEX_AV(i) (((i) - 1) * APEX_UNIT)  /* of an Av_values[] index   */
+#define APEX_TV(i) ((14 - (i)) * APEX_UNIT) /* of a Tv_speed[] index     */
+#define APEX_BULB  INT16_MIN                /* the Tv of bulb            */
+/* ... and back, the nearest whole stop: an Av, a Tv >= 0 - slower is 15 */
+#define APEX_AV_INDEX(a) (((a) + APEX_UNIT / 2) / APEX_UNIT + 1)
+#define APEX_TV_INDEX(t) (((t) < 0) ? 15 : 14 - ((t) + APEX_UNIT / 2) / APEX_UNIT)
 
 /* ========================================================================== */
-/* ========================= 50 ISO TABLES ================================== */
+/* ==================== EXPOSURE TABLES (ALL ISO) =========================== */
 /* ========================================================================== */
 
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
+/** The aperture priority and shutter priority tables are not typed by hand
+ *  anymore - the preprocessor generates them from the APEX relation
+ *  Av + Tv = Ev + Sv, written with array indices:
  *
- *  The array will contain the indices in Tv_speed[] array.
- */
-const uint8_t AV01_50[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0}; 
-const uint8_t AV14_50[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV02_50[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2}; 
-const uint8_t AV28_50[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV04_50[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV56_50[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV08_50[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-const uint8_t AV11_50[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7}; 
-const uint8_t AV16_50[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8}; 
-const uint8_t AV22_50[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9}; 
-const uint8_t AV32_50[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10}; 
-const uint8_t AV45_50[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11}; 
-const uint8_t AV64_50[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
- */
-const uint8_t TV00001_50[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV00012_50[] = {0, 0, 1, 2, 3, 4, 5, 6, 7, 8,  9, 10, 11, 12, 13,  0}; 
-const uint8_t TV00014_50[] = {0, 0, 0, 1, 2, 3, 4, 5, 6, 7,  8,  9, 10, 11, 12, 13}; 
-const uint8_t TV00018_50[] = {0, 0, 0, 0, 1, 2, 3, 4, 5, 6,  7,  8,  9, 10, 11, 12}; 
-const uint8_t TV00115_50[] = {0, 0, 0, 0, 0, 1, 2, 3, 4, 5,  6,  7,  8,  9, 10, 11}; 
-const uint8_t TV00130_50[] = {0, 0, 0, 0, 0, 0, 1, 2, 3, 4,  5,  6,  7,  8,  9, 10}; 
-const uint8_t TV00160_50[] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3,  4,  5,  6,  7,  8,  9}; 
-const uint8_t TV01125_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2,  3,  4,  5,  6,  7,  8}; 
-const uint8_t TV01250_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 1,  2,  3,  4,  5,  6,  7}; 
-const uint8_t TV01500_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  1,  2,  3,  4,  5,  6}; 
-const uint8_t TV11000_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  1,  2,  3,  4,  5}; 
-const uint8_t TV12000_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  1,  2,  3,  4}; 
-const uint8_t TV14000_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  1,  2,  3}; 
-const uint8_t TV18000_50[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  1,  2}; 
-/* ===================== END 50 ISO TABLES ================================== */
-
-
-
-/* ========================================================================== */
-/* ======================== 100 ISO TABLES ================================== */
-/* ========================================================================== */
-
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
+ *      tv = 15 - ev + av - iso   (aperture priority, index in Tv_speed[])
+ *      av = ev + tv - 15 + iso   (shutter priority, index in Av_values[])
  *
- *  The array will contain the indices in Tv_speed[] array.
- */
-const uint8_t AV01_100[] = {14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0}; 
-const uint8_t AV14_100[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0}; 
-const uint8_t AV02_100[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV28_100[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2}; 
-const uint8_t AV04_100[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV56_100[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV08_100[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV11_100[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-const uint8_t AV16_100[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7}; 
-const uint8_t AV22_100[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8}; 
-const uint8_t AV32_100[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9}; 
-const uint8_t AV45_100[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10}; 
-const uint8_t AV64_100[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
+ *  where ev is the metered EV (0..15) and iso is the index in ISO_values[].
+ *  Aperture priority results are clamped to 0..15 (0 = speed error, too much
+ *  light; 15 = bulb, too dark). Shutter priority results outside 1..13 are 0.
  *
- *  The array will contain the indices in Av_values[] array.
+ *  Every entry fits in a nibble, so two EVs share a byte (the even EV in the
+ *  low nibble) and a whole 0..15 EV row takes 8 bytes. Both tables live in a
+ *  single const block: first the 8 ISO x 13 Av rows, then the 8 ISO x 14 Tv
+ *  rows (bulb has no row) - 1728 bytes instead of 216 arrays of 16 bytes.
+ *  Use lookupTVindex() and lookupAVindex() to read them. The camera solves
+ *  its exposures in 1/24 stops (solveExposure(), slr_apex.h): the tables
+ *  are the whole stop cross-check of it, so they are built for the host
+ *  checks only (SLR_TABLES) and take no flash in the firmware.
  */
-const uint8_t TV00001_100[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0}; 
-const uint8_t TV00012_100[] = {0, 1, 2, 3, 4, 5, 6, 7, 8,  9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV00014_100[] = {0, 0, 1, 2, 3, 4, 5, 6, 7,  8,  9, 10, 11, 12, 13,  0}; 
-const uint8_t TV00018_100[] = {0, 0, 0, 1, 2, 3, 4, 5, 6,  7,  8,  9, 10, 11, 12, 13}; 
-const uint8_t TV00115_100[] = {0, 0, 0, 0, 1, 2, 3, 4, 5,  6,  7,  8,  9, 10, 11, 12}; 
-const uint8_t TV00130_100[] = {0, 0, 0, 0, 0, 1, 2, 3, 4,  5,  6,  7,  8,  9, 10, 11}; 
-const uint8_t TV00160_100[] = {0, 0, 0, 0, 0, 0, 1, 2, 3,  4,  5,  6,  7,  8,  9, 10}; 
-const uint8_t TV01125_100[] = {0, 0, 0, 0, 0, 0, 0, 1, 2,  3,  4,  5,  6,  7,  8,  9}; 
-const uint8_t TV01250_100[] = {0, 0, 0, 0, 0, 0, 0, 0, 1,  2,  3,  4,  5,  6,  7,  8}; 
-const uint8_t TV01500_100[] = {0, 0, 0, 0, 0, 0, 0, 0, 0,  1,  2,  3,  4,  5,  6,  7}; 
-const uint8_t TV11000_100[] = {0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  1,  2,  3,  4,  5,  6}; 
-const uint8_t TV12000_100[] = {0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  1,  2,  3,  4,  5}; 
-const uint8_t TV14000_100[] = {0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  1,  2,  3,  4}; 
-const uint8_t TV18000_100[] = {0, 0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  1,  2,  3}; 
-/* ==================== END 100 ISO TABLES ================================== */
-
-/* ========================================================================== */
-/* ======================== 200 ISO TABLES ================================== */
-/* ========================================================================== */
-
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Tv_speed[] array.
- */
-const uint8_t AV01_200[] = {13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0}; 
-const uint8_t AV14_200[] = {14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0}; 
-const uint8_t AV02_200[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0}; 
-const uint8_t AV28_200[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV04_200[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2}; 
-const uint8_t AV56_200[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV08_200[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV11_200[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV16_200[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-const uint8_t AV22_200[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7}; 
-const uint8_t AV32_200[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8}; 
-const uint8_t AV45_200[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9}; 
-const uint8_t AV64_200[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
- */
-const uint8_t TV00001_200[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0}; 
-const uint8_t TV00012_200[] = {1, 2, 3, 4, 5, 6, 7, 8,  9, 10, 11, 12, 13,  0,  0,  0}; 
-const uint8_t TV00014_200[] = {0, 1, 2, 3, 4, 5, 6, 7,  8,  9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV00018_200[] = {0, 0, 1, 2, 3, 4, 5, 6,  7,  8,  9, 10, 11, 12, 13,  0}; 
-const uint8_t TV00115_200[] = {0, 0, 0, 1, 2, 3, 4, 5,  6,  7,  8,  9, 10, 11, 12, 13}; 
-const uint8_t TV00130_200[] = {0, 0, 0, 0, 1, 2, 3, 4,  5,  6,  7,  8,  9, 10, 11, 12}; 
-const uint8_t TV00160_200[] = {0, 0, 0, 0, 0, 1, 2, 3,  4,  5,  6,  7,  8,  9, 10, 11}; 
-const uint8_t TV01125_200[] = {0, 0, 0, 0, 0, 0, 1, 2,  3,  4,  5,  6,  7,  8,  9, 10}; 
-const uint8_t TV01250_200[] = {0, 0, 0, 0, 0, 0, 0, 1,  2,  3,  4,  5,  6,  7,  8,  9}; 
-const uint8_t TV01500_200[] = {0, 0, 0, 0, 0, 0, 0, 0,  1,  2,  3,  4,  5,  6,  7,  8}; 
-const uint8_t TV11000_200[] = {0, 0, 0, 0, 0, 0, 0, 0,  0,  1,  2,  3,  4,  5,  6,  7}; 
-const uint8_t TV12000_200[] = {0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  1,  2,  3,  4,  5,  6}; 
-const uint8_t TV14000_200[] = {0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  1,  2,  3,  4,  5}; 
-const uint8_t TV18000_200[] = {0, 0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  1,  2,  3,  4}; 
-/* ==================== END 200 ISO TABLES ================================== */
-
-/* ========================================================================== */
-/* ======================== 400 ISO TABLES ================================== */
-/* ========================================================================== */
-
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Tv_speed[] array.
- */
-const uint8_t AV01_400[] = {12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0}; 
-const uint8_t AV14_400[] = {13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0}; 
-const uint8_t AV02_400[] = {14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0}; 
-const uint8_t AV28_400[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0}; 
-const uint8_t AV04_400[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV56_400[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3   2}; 
-const uint8_t AV08_400[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV11_400[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV16_400[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV22_400[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-const uint8_t AV32_400[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7}; 
-const uint8_t AV45_400[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8}; 
-const uint8_t AV64_400[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
- */
-const uint8_t TV00001_400[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0}; 
-const uint8_t TV00012_400[] = {2, 3, 4, 5, 6, 7, 8,  9, 10, 11, 12, 13,  0,  0,  0,  0}; 
-const uint8_t TV00014_400[] = {1, 2, 3, 4, 5, 6, 7,  8,  9, 10, 11, 12, 13,  0,  0,  0}; 
-const uint8_t TV00018_400[] = {0, 1, 2, 3, 4, 5, 6,  7,  8,  9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV00115_400[] = {0, 0, 1, 2, 3, 4, 5,  6,  7,  8,  9, 10, 11, 12, 13,  0}; 
-const uint8_t TV00130_400[] = {0, 0, 0, 1, 2, 3, 4,  5,  6,  7,  8,  9, 10, 11, 12, 13}; 
-const uint8_t TV00160_400[] = {0, 0, 0, 0, 1, 2, 3,  4,  5,  6,  7,  8,  9, 10, 11, 12}; 
-const uint8_t TV01125_400[] = {0, 0, 0, 0, 0, 1, 2,  3,  4,  5,  6,  7,  8,  9, 10, 11}; 
-const uint8_t TV01250_400[] = {0, 0, 0, 0, 0, 0, 1,  2,  3,  4,  5,  6,  7,  8,  9, 10}; 
-const uint8_t TV01500_400[] = {0, 0, 0, 0, 0, 0, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9}; 
-const uint8_t TV11000_400[] = {0, 0, 0, 0, 0, 0, 0,  0,  1,  2,  3,  4,  5,  6,  7,  8}; 
-const uint8_t TV12000_400[] = {0, 0, 0, 0, 0, 0, 0,  0,  0,  1,  2,  3,  4,  5,  6,  7}; 
-const uint8_t TV14000_400[] = {0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  1,  2,  3,  4,  5,  6}; 
-const uint8_t TV18000_400[] = {0, 0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  1,  2,  3,  4,  5}; 
-/* ==================== END 400 ISO TABLES ================================== */
-
-/* ========================================================================== */
-/* ======================== 800 ISO TABLES ================================== */
-/* ========================================================================== */
-
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Tv_speed[] array.
+#define SLR_ISO_ROWS  8  /* ISO_values[0..7]                 */
+#define SLR_AV_ROWS   13 /* Av_values[1..13]                 */
+#define SLR_TV_ROWS   14 /* Tv_speed[1..14], bulb excluded   */
+#define SLR_ROW_BYTES 8  /* 16 EV values, two per byte       */
+#define SLR_TV_BASE   (SLR_ISO_ROWS * SLR_AV_ROWS * SLR_ROW_BYTES)
+
+#define SLR_AVP(iso,av,ev) \
+	((15 - (ev) + (av) - (iso)) < 0 ? 0 : \
+	((15 - (ev) + (av) - (iso)) > 15 ? 15 : (15 - (ev) + (av) - (iso))))
+#define SLR_TVP(iso,tv,ev) \
+	(((ev) + (tv) - 15 + (iso)) < 1 || ((ev) + (tv) - 15 + (iso)) > 13 ? 0 : \
+	((ev) + (tv) - 15 + (iso)))
+#define SLR_PACK(f,iso,r,k) (uint8_t)(f(iso,r,2*(k)) | (f(iso,r,2*(k)+1) << 4))
+#define SLR_ROW(f,iso,r) \
+	SLR_PACK(f,iso,r,0), SLR_PACK(f,iso,r,1), SLR_PACK(f,iso,r,2), \
+	SLR_PACK(f,iso,r,3), SLR_PACK(f,iso,r,4), SLR_PACK(f,iso,r,5), \
+	SLR_PACK(f,iso,r,6), SLR_PACK(f,iso,r,7)
+#define SLR_AV_ISO(iso) \
+	SLR_ROW(SLR_AVP,iso, 1), SLR_ROW(SLR_AVP,iso, 2), SLR_ROW(SLR_AVP,iso, 3), \
+	SLR_ROW(SLR_AVP,iso, 4), SLR_ROW(SLR_AVP,iso, 5), SLR_ROW(SLR_AVP,iso, 6), \
+	SLR_ROW(SLR_AVP,iso, 7), SLR_ROW(SLR_AVP,iso, 8), SLR_ROW(SLR_AVP,iso, 9), \
+	SLR_ROW(SLR_AVP,iso,10), SLR_ROW(SLR_AVP,iso,11), SLR_ROW(SLR_AVP,iso,12), \
+	SLR_ROW(SLR_AVP,iso,13)
+#define SLR_TV_ISO(iso) \
+	SLR_ROW(SLR_TVP,iso, 1), SLR_ROW(SLR_TVP,iso, 2), SLR_ROW(SLR_TVP,iso, 3), \
+	SLR_ROW(SLR_TVP,iso, 4), SLR_ROW(SLR_TVP,iso, 5), SLR_ROW(SLR_TVP,iso, 6), \
+	SLR_ROW(SLR_TVP,iso, 7), SLR_ROW(SLR_TVP,iso, 8), SLR_ROW(SLR_TVP,iso, 9), \
+	SLR_ROW(SLR_TVP,iso,10), SLR_ROW(SLR_TVP,iso,11), SLR_ROW(SLR_TVP,iso,12), \
+	SLR_ROW(SLR_TVP,iso,13), SLR_ROW(SLR_TVP,iso,14)
+
+#ifdef SLR_TABLES
+const uint8_t SLR_ExpTable[SLR_TV_BASE + SLR_ISO_ROWS * SLR_TV_ROWS * SLR_ROW_BYTES]={
+	/* aperture priority: [ISO][Av][EV] -> index in Tv_speed[] */
+	SLR_AV_ISO(0), SLR_AV_ISO(1), SLR_AV_ISO(2), SLR_AV_ISO(3),
+	SLR_AV_ISO(4), SLR_AV_ISO(5), SLR_AV_ISO(6), SLR_AV_ISO(7),
+	/* shutter priority: [ISO][Tv][EV] -> index in Av_values[] */
+	SLR_TV_ISO(0), SLR_TV_ISO(1), SLR_TV_ISO(2), SLR_TV_ISO(3),
+	SLR_TV_ISO(4), SLR_TV_ISO(5), SLR_TV_ISO(6), SLR_TV_ISO(7)
+};
+#endif
+/* ==================== END EXPOSURE TABLES ================================= */
+
+/** PROGRAM LINES
+ *  The Av/Tv pair of the program mode for every exposure, one line for
+ *  each eos_t lens and one for the manual lens: wide open while the speed
+ *  climbs up to the handheld limit (SLR_P_HAND), then the aperture closes
+ *  at that speed down to the smallest one of the lens, then the speed
+ *  goes on up to Tv_max_speed. Computed by the preprocessor as the tables
+ *  above, indexed by ev + iso (the Ev + Sv of the tables, 0..22), an entry
+ *  holds the Av_values[] index in the low nibble and the Tv_speed[] index
+ *  in the high one. Beyond the ends of a line the entry is clamped - wide
+ *  open at 1 s, or the smallest aperture at Tv_max_speed.
+ *  Use lookupProgram() to read them. The camera itself solves the program
+ *  in 1/24 stops (solveExposure(), slr_apex.h), with the same SLR_P_AV();
+ *  the lines are its whole stop cross-check, built with SLR_TABLES only
+ *  as the tables above.
  */
-const uint8_t AV01_800[] = {11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0, 0, 0}; 
-const uint8_t AV14_800[] = {12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0, 0, 0}; 
-const uint8_t AV02_800[] = {13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0, 0, 0}; 
-const uint8_t AV28_800[] = {14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1, 0, 0}; 
-const uint8_t AV04_800[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2, 1, 0}; 
-const uint8_t AV56_800[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3, 2, 1}; 
-const uint8_t AV08_800[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4, 3, 2}; 
-const uint8_t AV11_800[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5, 4, 3}; 
-const uint8_t AV16_800[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6, 5, 4}; 
-const uint8_t AV22_800[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7, 6, 5}; 
-const uint8_t AV32_800[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8, 7, 6}; 
-const uint8_t AV45_800[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9, 8, 7}; 
-const uint8_t AV64_800[] = {15, 15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10, 9, 8}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
+#define SLR_P_HAND  8   /* Tv_speed[8], 1/60 - the slowest handheld speed */
+#define SLR_P_ROWS  23  /* ev + iso, 0..22                                */
+/* a line for every lens of SLR_EF_LENSES, then the manual lens */
+#define SLR_EF_COUNT(name,c,c1,c2) + 1
+#define SLR_P_LINES (SLR_EF_LENSES(SLR_EF_COUNT) + 1)
+
+/* The program: the Av that keeps the speed of an exposure e (Ev + Sv) at
+ * the handheld one h, between the widest aperture w and the smallest c -
+ * any APEX unit, the same for all four.
  */
-const uint8_t TV00001_800[] = {4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0,  0}; 
-const uint8_t TV00012_800[] = {3, 4, 5, 6, 7, 8,  9, 10, 11, 12, 13,  0,  0,  0,  0,  0}; 
-const uint8_t TV00014_800[] = {2, 3, 4, 5, 6, 7,  8,  9, 10, 11, 12, 13,  0,  0,  0,  0}; 
-const uint8_t TV00018_800[] = {1, 2, 3, 4, 5, 6,  7,  8,  9, 10, 11, 12, 13,  0,  0,  0}; 
-const uint8_t TV00115_800[] = {0, 1, 2, 3, 4, 5,  6,  7,  8,  9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV00130_800[] = {0, 0, 1, 2, 3, 4,  5,  6,  7,  8,  9, 10, 11, 12, 13,  0}; 
-const uint8_t TV00160_800[] = {0, 0, 0, 1, 2, 3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13}; 
-const uint8_t TV01125_800[] = {0, 0, 0, 0, 1, 2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12}; 
-const uint8_t TV01250_800[] = {0, 0, 0, 0, 0, 1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11}; 
-const uint8_t TV01500_800[] = {0, 0, 0, 0, 0, 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10}; 
-const uint8_t TV11000_800[] = {0, 0, 0, 0, 0, 0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9}; 
-const uint8_t TV12000_800[] = {0, 0, 0, 0, 0, 0,  0,  0,  1,  2,  3,  4,  5,  6,  7,  8}; 
-const uint8_t TV14000_800[] = {0, 0, 0, 0, 0, 0,  0,  0,  0,  1,  2,  3,  4,  5,  6,  7}; 
-const uint8_t TV18000_800[] = {0, 0, 0, 0, 0, 0,  0,  0,  0,  0,  1,  2,  3,  4,  5,  6}; 
-/* ==================== END 800 ISO TABLES ================================== */
-
-/* ========================================================================== */
-/* ======================== 1600 ISO TABLES ================================= */
-/* ========================================================================== */
+#define SLR_P_AV(e,w,c,h) ((e) - (h) < (w) ? (w) : ((e) - (h) > (c) ? (c) : (e) - (h)))
+/* ... in indices: the stops are Av index - 1 and 14 - Tv index, and the
+ * Ev + Sv of the row r is r - 2 */
+#define SLR_P_A(w,c,r) (SLR_P_AV((r) - 2, (w) - 1, (c) - 1, 14 - SLR_P_HAND) + 1)
+#define SLR_P_T(w,c,r) \
+	(SLR_P_A(w,c,r) + 15 - (r) < SLR_TV_MAX_SPEED ? SLR_TV_MAX_SPEED : \
+	(SLR_P_A(w,c,r) + 15 - (r) > 14 ? 14 : (SLR_P_A(w,c,r) + 15 - (r))))
+#define SLR_PE(w,c,r) (uint8_t)(SLR_P_A(w,c,r) | (SLR_P_T(w,c,r) << 4))
+#define SLR_P_LINE(w,c) { \
+	SLR_PE(w,c, 0), SLR_PE(w,c, 1), SLR_PE(w,c, 2), SLR_PE(w,c, 3), \
+	SLR_PE(w,c, 4), SLR_PE(w,c, 5), SLR_PE(w,c, 6), SLR_PE(w,c, 7), \
+	SLR_PE(w,c, 8), SLR_PE(w,c, 9), SLR_PE(w,c,10), SLR_PE(w,c,11), \
+	SLR_PE(w,c,12), SLR_PE(w,c,13), SLR_PE(w,c,14), SLR_PE(w,c,15), \
+	SLR_PE(w,c,16), SLR_PE(w,c,17), SLR_PE(w,c,18), SLR_PE(w,c,19), \
+	SLR_PE(w,c,20), SLR_PE(w,c,21), SLR_PE(w,c,22)},
+#define SLR_P_LIMITS(w,c) (uint8_t)((w) | ((c) << 4)),
+/* the same, from the SLR_EF_LENSES entry of a lens */
+#define SLR_P_EF_LINE(name,c,c1,c2)   SLR_P_LINE(SLR_EF_WIDE(c1), c)
+#define SLR_P_EF_LIMITS(name,c,c1,c2) SLR_P_LIMITS(SLR_EF_WIDE(c1), c)
+
+#ifdef SLR_TABLES
+const uint8_t SLR_Program[SLR_P_LINES][SLR_P_ROWS]={
+	SLR_EF_LENSES(SLR_P_EF_LINE) SLR_P_LINE(1, SLR_AV_MIN_APERTURE)
+};
+/* widest (low nibble) and smallest (high nibble) aperture of every line */
+const uint8_t SLR_ProgramLimits[SLR_P_LINES]={
+	SLR_EF_LENSES(SLR_P_EF_LIMITS) SLR_P_LIMITS(1, SLR_AV_MIN_APERTURE)
+};
+#endif
+/* ==================== END PROGRAM LINES =================================== */
 
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Tv_speed[] array.
- */
-const uint8_t AV01_1600[] = {10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0,  0,  0}; 
-const uint8_t AV14_1600[] = {11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0,  0}; 
-const uint8_t AV02_1600[] = {12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0}; 
-const uint8_t AV28_1600[] = {13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0}; 
-const uint8_t AV04_1600[] = {14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0}; 
-const uint8_t AV56_1600[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0}; 
-const uint8_t AV08_1600[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV11_1600[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2}; 
-const uint8_t AV16_1600[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV22_1600[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV32_1600[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV45_1600[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-const uint8_t AV64_1600[] = {15, 15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
+/* -- Global variables -------------------------------------------------- */ 
+/** The exposure state. The main loop changes it in SLR_Exp, through the
+ *  SLR_* names below, and publishes it whole with slr_publish(); anyone
+ *  else - an interrupt, the solver at the release - takes a copy with
+ *  slr_snapshot(), which always gets one published state, never half of
+ *  two, and without masking any interrupt.
  */
-const uint8_t TV00001_1600[] = {5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0,  0,  0}; 
-const uint8_t TV00012_1600[] = {4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0,  0}; 
-const uint8_t TV00014_1600[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0}; 
-const uint8_t TV00018_1600[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0}; 
-const uint8_t TV00115_1600[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0}; 
-const uint8_t TV00130_1600[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV00160_1600[] = {0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0}; 
-const uint8_t TV01125_1600[] = {0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13}; 
-const uint8_t TV01250_1600[] = {0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}; 
-const uint8_t TV01500_1600[] = {0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}; 
-const uint8_t TV11000_1600[] = {0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10}; 
-const uint8_t TV12000_1600[] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9}; 
-const uint8_t TV14000_1600[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8}; 
-const uint8_t TV18000_1600[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7}; 
-/* ==================== END 1600 ISO TABLES ================================= */
-
-/* ========================================================================== */
-/* ======================== 3200 ISO TABLES ================================= */
-/* ========================================================================== */
-
-/** Aperture priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Tv_speed[] array.
+typedef struct {
+	uint32_t lux;   /* this comes form the TSL2591 library, in 1/256 lux     */
+	int16_t  ev8;   /* the EV in 1/8 stops, not clamped to 0..15             */
+	uint8_t  ev;    /* the same, integer and 0..15 - for the tables          */
+	uint8_t  iso;   /* current ISO - index to the ISO_values[] array         */
+	int16_t  av;    /* current aperture, APEX (1/24 stops, 0 = f/1)          */
+	int16_t  tv;    /* current shutter speed, APEX (0 = 1 s), or APEX_BULB   */
+	int8_t   shift; /* program shift in stops, > 0 for faster speeds         */
+	lens_t   lens;  /* current lens type                                     */
+	eos_t    eos;   /* current EOS lens model                                */
+	cameramode_t mode; /* current camera mode set by user                    */
+} exposure_t;
+
+exposure_t SLR_Exp;  /* the main loop's working copy */
+
+/* The click of the Av and Tv dials, APEX_THIRD or APEX_HALF - a user
+ * setting, changed with setDialStep() (slr_lens.h). The over/under bar
+ * and the frame log stay in thirds.
  */
-const uint8_t AV01_3200[] = { 9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0,  0,  0,  0}; 
-const uint8_t AV14_3200[] = {10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0,  0,  0}; 
-const uint8_t AV02_3200[] = {11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0,  0}; 
-const uint8_t AV28_3200[] = {12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0,  0}; 
-const uint8_t AV04_3200[] = {13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0,  0}; 
-const uint8_t AV56_3200[] = {14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,  0}; 
-const uint8_t AV08_3200[] = {15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0}; 
-const uint8_t AV11_3200[] = {15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1}; 
-const uint8_t AV16_3200[] = {15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2}; 
-const uint8_t AV22_3200[] = {15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3}; 
-const uint8_t AV32_3200[] = {15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4}; 
-const uint8_t AV45_3200[] = {15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5}; 
-const uint8_t AV64_3200[] = {15, 15, 15, 15, 15, 15, 15, 14, 13, 12, 11, 10,  9,  8,  7,  6}; 
-
-/** Shutter priority tables with regard to EV value (Ev=[0..15]) 
- *
- *  The array will contain the indices in Av_values[] array.
+#ifndef SLR_DIAL_STEP
+#define SLR_DIAL_STEP APEX_THIRD
+#endif
+uint8_t SLR_Dial = SLR_DIAL_STEP;
+
+/* Two copies: the published one is buf[seq & 1], the next one is written
+ * in the other and published by the increment of seq. An interrupt
+ * reading it can't be preempted by the main loop, so it never waits.
  */
-const uint8_t TV00001_3200[] = {6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0,  0,  0,  0}; 
-const uint8_t TV00012_3200[] = {5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0,  0,  0}; 
-const uint8_t TV00014_3200[] = {4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0,  0}; 
-const uint8_t TV00018_3200[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0,  0}; 
-const uint8_t TV00115_3200[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0,  0}; 
-const uint8_t TV00130_3200[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0,  0}; 
-const uint8_t TV00160_3200[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0,  0}; 
-const uint8_t TV01125_3200[] = {0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,  0}; 
-const uint8_t TV01250_3200[] = {0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13}; 
-const uint8_t TV01500_3200[] = {0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}; 
-const uint8_t TV11000_3200[] = {0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}; 
-const uint8_t TV12000_3200[] = {0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10}; 
-const uint8_t TV14000_3200[] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9}; 
-const uint8_t TV18000_3200[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8}; 
-/* ==================== END 3200 ISO TABLES ================================= */
-
-/* -- Global variables -------------------------------------------------- */ 
-uint8_t  SLR_EV; /* using only the integer values of it                   */
-float    SLR_LUX;/* this comes form the TSL2591 library                   */
-uint8_t  SLR_ISO;/* current ISO - index to the ISO_values[] array         */
-uint8_t  SLR_Av; /* current aperture - index to the Av_values[] array     */
-uint8_t  SLR_Tv; /* current shutter speed - index to the Tv_speed[] array */
-lens_t   SLR_LensType; /* current lens type                               */
-eos_t    SLR_EOSModel; /* current EOS lens model                          */
-cameramode_t SLR_Mode; /* current camera mode set by user                 */
+typedef struct {
+	exposure_t        buf[2];
+	volatile uint32_t seq;
+} slr_state_t;
+
+slr_state_t SLR_State;
+
+#define SLR_EV       SLR_Exp.ev
+#define SLR_EV8      SLR_Exp.ev8
+#define SLR_LUX      SLR_Exp.lux
+#define SLR_ISO      SLR_Exp.iso
+#define SLR_Av       SLR_Exp.av
+#define SLR_Tv       SLR_Exp.tv
+#define SLR_LensType SLR_Exp.lens
+#define SLR_EOSModel SLR_Exp.eos
+#define SLR_Mode     SLR_Exp.mode
+#define SLR_Shift    SLR_Exp.shift
 /* ---------------------------------------------------------------------- */
 
 /** FUNCTIONS
  *  =========
  */
  
+/* Av_values[] index of the widest aperture of an EOSEF* array */
+uint8_t eos_wide_av(const int8_t *ap){
+	uint8_t i = 1;
+	while(ap[i] <= 0) i++;
+	return i;
+}
+
+/* Main loop side: publishes SLR_Exp as it is now. */
+void slr_publish(void){
+	uint32_t seq = SLR_State.seq + 1;
+	SLR_State.buf[seq & 1] = SLR_Exp;
+	SLR_BARRIER();
+	SLR_State.seq = seq;
+}
+
+/* Copies the published exposure state to x. An interrupt gets it at the
+ * first try; the main loop itself has nothing to wait for either, being
+ * the only writer - the retry is for a reader the writer can preempt.
+ */
+void slr_snapshot(exposure_t *x){
+	uint32_t seq;
+	do{
+		seq = SLR_State.seq;
+		SLR_BARRIER();
+		*x = SLR_State.buf[seq & 1];
+		SLR_BARRIER();
+	}while(SLR_State.seq != seq);
+}
+
 /* Sets the initial values for the ISO, Aperture, Shutter speed, etc.
  *
  */ 
 void slr_init(void){
 	/* for start, lets set some safe values, no correlation between them yet */
 	SLR_ISO = 2; /* ISO 100 - a good start for ISO */
-	SLR_Av  = 6; /* Aperture 5.6 - any lens have that */
-	SLR_Tv  = 7; /* Shutter speed 1/125 */
+	SLR_Av  = APEX_AV(6); /* Aperture 5.6 - any lens have that */
+	SLR_Tv  = APEX_TV(7); /* Shutter speed 1/125 */
 	SLR_EV  = 13;/* Light is ok */
+	SLR_EV8 = 13 * 8;
+	SLR_Shift = 0;
+	slr_publish();
 } 
 
-/* It will read the sensor at a press of a button - returns a code for success
- *  and lights a green led when the exposure is read correctly.
- * Requires a functional light sensor library... 
+/** Fixed-point LUX to EV conversion, in 1/8 stop units.
+ *  EV = log2(LUX / 1.75) - the calibration of the old float chart, where
+ *  EV 1 starts at 3.5 lux - but without gaps between the stops and without
+ *  a single float operation. The integer part of log2 is the position of the
+ *  leading one (CLZ instruction on the M3); the division by 1.75 is in the
+ *  1/8 stop thresholds of the normalized value, so the fraction comes from
+ *  the 5 bits following the leading one through a 32 entry table, corrected
+ *  by one compare against the exact threshold (a 1/32 slice never holds
+ *  more than one 1/8 stop threshold). Exact for every 32 bit input - no
+ *  rounded multiply in between (host/check_tables.c checks both sides of
+ *  every step).
  */
-uint8_t read_exposure(void){
-	/**/
-	
-}
+/* floor(8 * log2((1 + i/32) * 4/7)) + 8, the steps of the normalized value
+ * at the start of the slice i */
+const uint8_t EV8_segment[32]={
+	1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5,
+	6, 6, 6, 6, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 9, 9
+};
+/* ceil(2^31 * 7/4 * 2^((j - 8)/8)) - 1, the last normalized value under
+ * the 1/8 stop threshold j - the 10th is past 2^32 */
+const uint32_t EV8_threshold[11]={
+	1879048191u, 2049116583u, 2234577479u, 2436824020u, 2657375437u,
+	2897888463u, 3160169777u, 3446189578u, 3758096383u, 4098233166u,
+	0xFFFFFFFFu
+};
 
-/* sets the EV value from the LUX value returned by the light sensor */
-void getEV(float LUXvalue){
-	if(LUXvalue  < 3.5)                                    {SLR_EV = 0; return;} 
-	if((LUXvalue > 3.4)     && (LUXvalue < 7))             {SLR_EV = 1; return;}
-	if((LUXvalue > 6.9)     && (LUXvalue < 14))            {SLR_EV = 2; return;}
-	if((LUXvalue > 13.9)    && (LUXvalue < 28))            {SLR_EV = 3; return;}
-	if((LUXvalue > 27.9)    && (LUXvalue < 56))            {SLR_EV = 4; return;}
-	if((LUXvalue > 55.9)    && (LUXvalue < 112))           {SLR_EV = 5; return;}
-	if((LUXvalue > 111.9)   && (LUXvalue < 225))           {SLR_EV = 6; return;}
-	if((LUXvalue > 224.9)   && (LUXvalue < 450))           {SLR_EV = 7; return;}
-	if((LUXvalue > 449.9)   && (LUXvalue < 900))           {SLR_EV = 8; return;}
-	if((LUXvalue > 899.9)   && (LUXvalue < 1800))          {SLR_EV = 9; return;}
-	if((LUXvalue > 1799.9)  && (LUXvalue < 3600))          {SLR_EV =10; return;}
-	if((LUXvalue > 3599.9)  && (LUXvalue < 7200))          {SLR_EV =11; return;}
-	if((LUXvalue > 7199.9)  && (LUXvalue < 14400))         {SLR_EV =12; return;}
-	if((LUXvalue > 14399.9) && (LUXvalue < 28900))         {SLR_EV =13; return;}
-	if((LUXvalue > 28899.9) && (LUXvalue < 57800))         {SLR_EV =14; return;}
-	if(LUXvalue  > 57799.9)                                {SLR_EV =15; return;}
+/* returns the EV in 1/8 stops for a LUX value of LUX * 2^e, given in
+ * 1/256 lux units. Constant time, no branches. A zero LUX reads as 1.
+ */
+int16_t getEV8scaled(uint32_t LUX, int8_t e){
+	uint32_t x, f;
+	uint8_t  n;
+	x = LUX + (LUX == 0);                            /* no log2(0)       */
+	n = __builtin_clz(x);
+	x <<= n;                                         /* 1.xxx * 2^31     */
+	f = EV8_segment[(x >> 26) & 31];
+	f += (x > EV8_threshold[f + 1]);
+	return (int16_t)((22 - (int16_t)n + e) * 8 + f);
 }
 
+/* returns the EV in 1/8 stops (EV 13 = 104) for a LUX value given in
+ * 1/256 lux units (Q24.8). A zero LUX reads as 1/256 lux, that is -71
+ * (EV -8 7/8), the lowest value Q24.8 can hold.
+ */
+int16_t getEV8(uint32_t LUXq8){
+	return getEV8scaled(LUXq8, 0);
+}
 
-void setEOSlens(uint8_t dir){
-	/**/
+/* the same for a LUX value in 2^-40 lux units (Q24.40), the precision of
+ * tsl2591_calculateLux40() - it reaches the darkest scenes the sensor can
+ * see, well under EV -8.
+ */
+int16_t getEV8wide(uint64_t LUXq40){
+	uint32_t hi = (uint32_t)(LUXq40 >> 32);
+	uint8_t  s = hi ? 32 - __builtin_clz(hi) : 0;
+	return getEV8scaled((uint32_t)(LUXq40 >> s), (int8_t)(s - 32));
 }
 
-void setSLRmode(uint8_t dir){
-	/**/
+/* sets the EV value from the LUX value returned by the light sensor, in
+ * 1/256 lux units (see tsl2591_calculateLux)
+ */
+void getEV(uint32_t LUXq8){
+	int16_t ev8;
+	TRACE_BEGIN(TR_GETEV);
+	ev8 = getEV8(LUXq8);
+	SLR_EV8 = ev8;
+	if(ev8 < 0) ev8 = 0;
+	if(ev8 > 15 * 8) ev8 = 15 * 8;
+	SLR_EV = (uint8_t)(ev8 >> 3);
+	TRACE_END(TR_GETEV);
 }
 
-void setISOindex(uint8_t dir){
-	/**/
+#ifdef SLR_TABLES
+/* Aperture priority lookup - returns the index in Tv_speed[] for the given
+ * ISO_values[] index, Av_values[] index and EV, or 0 (speed error) if the
+ * needed speed is faster than Tv_max_speed. An aperture smaller than
+ * Av_min_aperture is clamped to Av_min_aperture.
+ */
+uint8_t lookupTVindex(uint8_t iso, uint8_t av, uint8_t ev){
+	uint8_t tv;
+	if(av > Av_min_aperture) av = Av_min_aperture;
+	if((iso >= SLR_ISO_ROWS) || (av == 0) || (ev > 15)) return 0;
+	tv = SLR_ExpTable[(iso * SLR_AV_ROWS + av - 1) * SLR_ROW_BYTES + (ev >> 1)];
+	tv = (tv >> ((ev & 1) << 2)) & 0x0F;
+	if(tv < Tv_max_speed) tv = 0;
+	return tv;
 }
 
-/* sets the Av of the lens according to the selected lens */
-void setAVindex(uint8_t dir){
-	/**/
+/* Shutter priority lookup - returns the index in Av_values[] for the given
+ * ISO_values[] index, Tv_speed[] index and EV, or 0 if no aperture between
+ * Av_values[1] and Av_min_aperture fits. A speed faster than Tv_max_speed is
+ * clamped to Tv_max_speed.
+ */
+uint8_t lookupAVindex(uint8_t iso, uint8_t tv, uint8_t ev){
+	uint8_t av;
+	if(tv < Tv_max_speed) tv = Tv_max_speed;
+	if((iso >= SLR_ISO_ROWS) || (tv == 0) || (tv > SLR_TV_ROWS) || (ev > 15)) return 0;
+	av = SLR_ExpTable[SLR_TV_BASE + (iso * SLR_TV_ROWS + tv - 1) * SLR_ROW_BYTES + (ev >> 1)];
+	av = (av >> ((ev & 1) << 2)) & 0x0F;
+	if(av > Av_min_aperture) av = 0;
+	return av;
 }
 
-/* sets the Tv according to the hardware capabilities of the shutter. 
- * the maximum speed of the shutter must be declared by the user.
+/* Program lookup - returns the Av_values[] index (low nibble) and the
+ * Tv_speed[] index (high nibble) of the program line for the ISO_values[]
+ * index and EV, shifted along the line by shift stops (> 0: faster speed,
+ * wider aperture) as far as the lens and the shutter go.
  */
-void setTVindex(uint8_t dir){
-	/**/
+uint8_t lookupProgram(uint8_t line, uint8_t iso, uint8_t ev, int8_t shift){
+	uint8_t x, lim;
+	int8_t a, t, k = shift;
+	if(line >= SLR_P_LINES) line = SLR_P_LINES - 1;
+	if(iso >= SLR_ISO_ROWS) iso = SLR_ISO_ROWS - 1;
+	if(ev > 15) ev = 15;
+	x = SLR_Program[line][ev + iso];
+	if(!k) return x;
+	lim = SLR_ProgramLimits[line];
+	a = x & 0x0F;
+	t = x >> 4;
+	if(k > a - (lim & 0x0F)) k = a - (lim & 0x0F);
+	if(k > t - SLR_TV_MAX_SPEED) k = t - SLR_TV_MAX_SPEED;
+	if(k < a - (lim >> 4)) k = a - (lim >> 4);
+	if(k < t - 14) k = t - 14;
+	return (uint8_t)((a - k) | ((t - k) << 4));
 }
+#endif /* SLR_TABLES */
 
+/* The setters below are called with the dial or button direction: dir 1
+ * steps the setting up, 0 steps it down (see slr_input.h).
+ */
 
-uint16_t getISOvalue(void){
-	/**/
+/* next (1) or previous (0) camera mode, round the cameramode_t list */
+void setSLRmode(uint8_t dir){
+	if(dir) SLR_Mode = (SLR_Mode == PR) ? IS : (cameramode_t)(SLR_Mode + 1);
+	else    SLR_Mode = (SLR_Mode == IS) ? PR : (cameramode_t)(SLR_Mode - 1);
+	/* bulb is for the manual modes */
+	if((SLR_Mode > MA) && (SLR_Tv == APEX_BULB)) SLR_Tv = 0;
 }
 
-/* gets the index of aperture value if in TV mode */
-uint8_t getAVindex(void){
-	/**/
+/* The dial setters take the net detents of a dial, > 0 up, and clamp
+ * once (see input_poll()); the *index() ones are a single detent.
+ */
+
+/* steps ISO_values[] indices up (> 0) or down */
+void setISO(int8_t steps){
+	int16_t iso = (int16_t)SLR_ISO + steps;
+	if(iso < 0) iso = 0;
+	if(iso > SLR_ISO_ROWS - 1) iso = SLR_ISO_ROWS - 1;
+	SLR_ISO = (uint8_t)iso;
 }
 
-/* gets the index of shutter speed value if in AV mode */
-uint8_t getTVindex(void){
-	/**/
+void setISOindex(uint8_t dir){
+	setISO(dir ? 1 : -1);
 }
 
+/* sets the Tv according to the hardware capabilities of the shutter, in
+ * clicks (SLR_Dial). the maximum speed of the shutter must be declared by
+ * the user. steps > 0 go to slower speeds, down to 1 s, then bulb in the
+ * manual modes; an off-click Tv takes the first one to the click next to
+ * it. In program mode the dial shifts the program instead, a stop a step,
+ * towards faster speeds for steps < 0.
+ */
+void setTV(int8_t steps){
+	int16_t tv = SLR_Tv, fast = APEX_TV(Tv_max_speed), c;
+	if(!steps) return;
+	if(SLR_Mode == PR){
+		c = SLR_Shift - steps;
+		if(c < -15) c = -15;
+		if(c > 15) c = 15;
+		SLR_Shift = (int8_t)c;
+		return;
+	}
+	if(tv == APEX_BULB){
+		if(steps >= 0) return;
+		tv = 0;        /* the first step out of bulb is 1 s */
+		steps++;
+	}
+	if(steps > 0){
+		c = (tv + SLR_Dial - 1) / SLR_Dial - steps;
+		if(c >= 0) SLR_Tv = c * SLR_Dial;
+		else SLR_Tv = (SLR_Mode <= MA) ? APEX_BULB : 0;
+	}else{
+		c = (tv / SLR_Dial - steps) * SLR_Dial;
+		SLR_Tv = (c > fast) ? fast : c;
+	}
+}
 
+/* dir 1 is the next slower speed, 0 the next faster one */
+void setTVindex(uint8_t dir){
+	setTV(dir ? 1 : -1);
+}
 
+uint16_t getISOvalue(void){
+	return ISO_values[SLR_ISO];
+}
 
+#endif /* SLR_H */
@@ -0,0 +1,213 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    A P E X   S O L V E R
+ *    ---------------------
+ *    Av + Tv = Ev + Sv, solved with integers in 1/24 stop units - 24 holds
+ *    both the third stops of the dials and the 1/8 stops of the meter and
+ *    of the EF lens, so nothing gets rounded twice. No table search, no
+ *    loop: a handful of adds, a compare per limit and at most a divide,
+ *    the same cycles for any exposure. This is what the camera works the
+ *    exposure out with, at the release and on the display; the exposure
+ *    tables of slr.h stay as its cross-check - at a whole stop both give
+ *    the same answer (host/check_apex.c).
+ *
+ *    The units are the ones of the exposure state (APEX_UNIT, slr.h): Av
+ *    0 = f/1, Tv 0 = 1 s, and the EV of the meter, as in the tables, is
+ *    referred to ISO 100.
+ */
+#ifndef SLR_APEX_H
+#define SLR_APEX_H
+
+#include "slr.h"
+
+#define APEX_TV_HAND ((14 - SLR_P_HAND) * APEX_UNIT) /* the handheld speed of the program */
+#define APEX_LATITUDE 12  /* a solve may miss by half a stop at the limits of the camera */
+
+/** an exposure, in 1/24 stops */
+typedef struct {
+	int16_t av, tv;
+	int16_t err;    /* av + tv - ev: > 0 under exposed, < 0 over exposed, when a limit is hit */
+} apex_t;
+
+/** aperture range of the lens, in 1/24 stops, and the step it is set in */
+typedef struct {
+	int16_t av_min, av_max;
+	uint8_t step;   /* 3 (1/8 stop) for the EF lens, the clicks of the dials (SLR_Dial) for a manual one */
+} apex_lens_t;
+
+/* why the camera can't make a solved exposure */
+typedef enum { APEX_OK = 0, APEX_NO_SPEED, APEX_NO_APERTURE} apex_fault_t;
+
+/* round(1000000 * 2^(-r/24)) - the microseconds of 1/24 stops under 1 s */
+const uint32_t APEX_T24[24]={
+	1000000, 971532, 943874, 917004, 890899, 865537, 840896, 816958,
+	 793701, 771105, 749154, 727827, 707107, 686977, 667420, 648420,
+	 629961, 612027, 594604, 577676, 561231, 545254, 529732, 514651
+};
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* Ev + Sv of a meter reading in 1/8 stops, for the ISO_values[] index iso */
+int16_t apex_ev24(int16_t ev8, uint8_t iso){
+	return ev8 * 3 + ((int16_t)iso - 2) * APEX_UNIT;
+}
+
+/* EF aperture code of an Av, the nearest 1/8 stop (see the EOSEF* arrays) */
+int8_t apex_av_code(int16_t av){
+	return (int8_t)((av + 1) / 3 + 8);
+}
+
+/* ... and back */
+int16_t apex_code_av(int8_t code){
+	return ((int16_t)code - 8) * 3;
+}
+
+/* to the nearest step, in steps */
+int16_t apex_steps(int16_t v, uint8_t step){
+	return (v >= 0) ? (v + step / 2) / step : -((step / 2 - v) / step);
+}
+
+/* to the nearest third of a stop */
+int16_t apex_thirds(int16_t v){
+	return apex_steps(v, APEX_THIRD);
+}
+
+/* the aperture range of the lens of x: the EOSEF* array of the EF lens,
+ * or Av_values[1] to Av_min_aperture
+ */
+void apex_lens(const exposure_t *x, apex_lens_t *l){
+	if(x->lens == EOS){
+		const int8_t *ap = EOS_apertures[x->eos];
+		l->av_min = apex_code_av(ap[eos_wide_av(ap)]);
+		l->av_max = apex_code_av(ap[ap[0]]);
+		l->step   = 3;
+	}else{
+		l->av_min = 0;
+		l->av_max = APEX_AV(Av_min_aperture);
+		l->step   = SLR_Dial;
+	}
+}
+
+/* the speed range of the shutter: Tv_max_speed down to 1 s */
+int16_t apex_tv_clamp(int16_t tv){
+	int16_t fast = APEX_TV(Tv_max_speed);
+	if(tv > fast) return fast;
+	if(tv < 0) return 0;
+	return tv;
+}
+
+/* into the lens range, to the nearest step */
+int16_t apex_av_clamp(const apex_lens_t *l, int16_t av){
+	if(av < l->av_min) return l->av_min;
+	if(av > l->av_max) return l->av_max;
+	return l->av_min + ((av - l->av_min + (l->step >> 1)) / l->step) * l->step;
+}
+
+/* The Av and Tv the camera works with in the mode of x - the ones set, or
+ * the ones solved from its EV:
+ *   IS, MA - as set (Tv APEX_BULB for bulb, err 0 then);
+ *   MT, AV - the Av set, on the lens; the Tv of the meter, slower than
+ *            1 s too (< 0, a long exposure), faster than the shutter not;
+ *   TV     - the Tv set, within the shutter; the Av of the meter, on the
+ *            lens;
+ *   PR     - the program, SLR_P_AV() in 1/24 stops, shifted by whole
+ *            stops as far as the lens and the shutter go.
+ */
+apex_t solveExposure(const exposure_t *x){
+	apex_lens_t l;
+	apex_t r;
+	int16_t ev = apex_ev24(x->ev8, x->iso), fast = APEX_TV(Tv_max_speed), s;
+	apex_lens(x, &l);
+	switch(x->mode){
+	case MT:
+	case AV:
+		r.av = apex_av_clamp(&l, x->av);
+		r.tv = ev - r.av;
+		if(r.tv > fast) r.tv = fast;
+		break;
+	case TV:
+		r.tv = apex_tv_clamp(x->tv);
+		r.av = apex_av_clamp(&l, ev - r.tv);
+		break;
+	case PR:
+		r.av = apex_av_clamp(&l, SLR_P_AV(ev, l.av_min, l.av_max, APEX_TV_HAND));
+		r.tv = apex_tv_clamp(ev - r.av);
+		/* the same limits as lookupProgram(); off the lens step only
+		 * when the shutter stops it, then the nearest step */
+		s = x->shift * APEX_UNIT;
+		if(s > r.av - l.av_min) s = r.av - l.av_min;
+		if(s > fast - r.tv) s = fast - r.tv;
+		if(s < r.av - l.av_max) s = r.av - l.av_max;
+		if(s < -r.tv) s = -r.tv;
+		r.av = apex_av_clamp(&l, r.av - s);
+		r.tv = apex_tv_clamp(r.tv + s);
+		break;
+	default:
+		r.av = x->av;
+		r.tv = x->tv;
+		if(r.tv == APEX_BULB){ r.err = 0; return r; }
+		break;
+	}
+	r.err = r.av + r.tv - ev;
+	return r;
+}
+
+/* sets SLR_Av and SLR_Tv from the program for the lens mounted */
+void getProgram(void){
+	exposure_t x = SLR_Exp;
+	apex_t s;
+	x.mode = PR;
+	s = solveExposure(&x);
+	SLR_Av = s.av;
+	SLR_Tv = s.tv;
+}
+
+/* APEX_OK if the camera can make the exposure s solved in the mode, or
+ * what it misses by more than APEX_LATITUDE: a speed faster than the
+ * shutter in MT and AV, an aperture of the lens in TV. The manual modes
+ * and the program take what they get.
+ */
+apex_fault_t apex_fault(cameramode_t mode, const apex_t *s){
+	if(((mode == MT) || (mode == AV)) && (s->err < -APEX_LATITUDE)) return APEX_NO_SPEED;
+	if((mode == TV) && ((s->err < -APEX_LATITUDE) || (s->err > APEX_LATITUDE))) return APEX_NO_APERTURE;
+	return APEX_OK;
+}
+
+/* gets the index of aperture value if in TV mode, the Av_values[] one
+ * nearest the solved Av, or 0 if no aperture of the lens fits
+ */
+uint8_t getAVindex(void){
+	exposure_t x = SLR_Exp;
+	apex_t s;
+	x.mode = TV;
+	s = solveExposure(&x);
+	if(apex_fault(TV, &s)) return 0;
+	return APEX_AV_INDEX(s.av);
+}
+
+/* gets the index of shutter speed value if in AV mode, the Tv_speed[] one
+ * nearest the solved Tv (15 slower than 1 s), or 0 (speed error) if it is
+ * faster than the shutter
+ */
+uint8_t getTVindex(void){
+	exposure_t x = SLR_Exp;
+	apex_t s;
+	x.mode = AV;
+	s = solveExposure(&x);
+	if(apex_fault(AV, &s)) return 0;
+	return APEX_TV_INDEX(s.tv);
+}
+
+/* Exposure time of a Tv, in us (down to Tv -12, about an hour). */
+uint32_t apex_tv_us(int16_t tv){
+	int16_t q;
+	uint8_t r;
+	if(tv < -12 * APEX_UNIT) tv = -12 * APEX_UNIT;
+	q = (tv + 12 * APEX_UNIT) / APEX_UNIT - 12;
+	r = tv - q * APEX_UNIT;
+	if(q <= 0) return APEX_T24[r] << -q;
+	return (APEX_T24[r] + ((1u << q) >> 1)) >> q;
+}
+
+#endif /* SLR_APEX_H */
@@ -0,0 +1,142 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    S H U T T E R   C A L I B R A T I O N
+ *    -------------------------------------
+ *    A bench job, with the back open and a phototransistor in the middle
+ *    of the film gate (see shutter_light_isr()): every speed from
+ *    Tv_max_speed to 1 s is fired CAL_SHOTS times with its correction, the
+ *    light at the gate timed from the captures of its edges, and the mean
+ *    error taken off the correction - again, up to CAL_PASSES times, until
+ *    the error is within CAL_TOLERANCE. The table then goes to the data
+ *    EEPROM, where shutter_init() finds it, and shutter_fire_us() applies
+ *    it to every exposure after - to the times between these speeds too.
+ *
+ *    Timing the gate, not the magnets, takes in everything the curtains
+ *    do between the release and the film: the travel of each curtain, the
+ *    magnets letting go late, the second one catching up at the fast
+ *    speeds. Run it again when the shutter ages.
+ */
+#ifndef SLR_CALIB_H
+#define SLR_CALIB_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_shutter.h"
+#include "slr_log.h"
+
+/* the table is saved through the writes of the log, out of its words */
+#if (SHUTTER_CAL_BASE + SHUTTER_CAL_WORDS >= LOG_BASE) && (SHUTTER_CAL_BASE < LOG_BASE + LOG_WORDS)
+#error "the shutter calibration table is in the frame log (SHUTTER_CAL_BASE, LOG_WORDS)"
+#endif
+
+#define CAL_SHOTS      16      /* exposures timed per speed and pass       */
+#define CAL_PASSES     4       /* passes over one speed, at most           */
+#define CAL_TOLERANCE  1       /* us, mean error that ends the speed       */
+#define CAL_TIMEOUT_US 100000u /* after the second curtain, for the dark   */
+
+typedef enum { CAL_IDLE = 0, CAL_RUNNING, CAL_SAVING, CAL_DONE, CAL_NO_LIGHT} cal_state_t;
+
+typedef struct {
+	cal_state_t state;
+	uint8_t  tv;            /* speed being timed                         */
+	uint8_t  shot, pass;
+	uint8_t  fired;         /* 1 exposing, 2 waiting for the dark         */
+	uint8_t  word;          /* of the table, being saved                 */
+	int32_t  sum;           /* errors of the shots of this pass, us      */
+	uint32_t done_us;       /* the second curtain went                    */
+	int16_t  error[16];     /* mean error of the first pass of a speed   */
+	int16_t  residual[16];  /* ... and of the last one                   */
+	uint16_t slow;          /* bit per speed the shutter can't make: too
+	                           long with the curtains SHUTTER_MIN_GAP apart */
+	uint16_t shots;         /* exposures timed                           */
+} cal_t;
+
+cal_t SLR_Cal;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* Starts the calibration - 0 if the shutter is busy. */
+uint8_t cal_start(void){
+	if(shutter_busy()) return 0;
+	SLR_Cal.state = CAL_RUNNING;
+	SLR_Cal.tv    = Tv_max_speed;
+	SLR_Cal.shot  = SLR_Cal.pass = SLR_Cal.fired = 0;
+	SLR_Cal.sum   = 0;
+	SLR_Cal.slow  = 0;
+	SLR_Cal.shots = 0;
+	return 1;
+}
+
+uint8_t cal_busy(void){
+	return (SLR_Cal.state == CAL_RUNNING) || (SLR_Cal.state == CAL_SAVING);
+}
+
+/* the end of a pass over a speed: its mean error off the correction */
+void cal_pass(void){
+	int32_t e = SLR_Cal.sum, c;
+	e = (e + ((e < 0) ? -(CAL_SHOTS / 2) : CAL_SHOTS / 2)) / CAL_SHOTS;
+	if(SLR_Cal.pass == 0) SLR_Cal.error[SLR_Cal.tv] = (int16_t)e;
+	SLR_Cal.residual[SLR_Cal.tv] = (int16_t)e;
+	c = SLR_Shutter.corr[SLR_Cal.tv] - e;
+	if(c > INT16_MAX) c = INT16_MAX;
+	if(c < SHUTTER_MIN_GAP - (int32_t)Tv_speed[SLR_Cal.tv]) c = SHUTTER_MIN_GAP - (int32_t)Tv_speed[SLR_Cal.tv];
+	SLR_Shutter.corr[SLR_Cal.tv] = (int16_t)c;
+	SLR_Cal.shot = 0;
+	SLR_Cal.sum  = 0;
+	if((e > CAL_TOLERANCE) || (e < -CAL_TOLERANCE)){
+		if(++SLR_Cal.pass < CAL_PASSES) return;
+		if(e > 0) SLR_Cal.slow |= 1u << SLR_Cal.tv;
+	}
+	SLR_Cal.pass = 0;
+	if(++SLR_Cal.tv > 14){
+		SLR_Cal.word  = 0;
+		SLR_Cal.state = CAL_SAVING;
+	}
+}
+
+/* Main loop side: moves the calibration on, returns its state. Without
+ * the light at the gate it ends in CAL_NO_LIGHT, with the table it had.
+ */
+cal_state_t cal_poll(void){
+	switch(SLR_Cal.state){
+	case CAL_RUNNING:
+		if(SLR_Cal.fired == 1){
+			if(shutter_busy()) break;
+			SLR_Cal.done_us = hal_micros();
+			SLR_Cal.fired = 2;
+		}
+		if(SLR_Cal.fired == 2){
+			if(!SLR_Shutter.measured){
+				if(hal_micros() - SLR_Cal.done_us < CAL_TIMEOUT_US) break;
+				shutter_load();
+				SLR_Cal.state = CAL_NO_LIGHT;
+				break;
+			}
+			SLR_Cal.sum += (int32_t)SLR_Shutter.gate_us - (int32_t)Tv_speed[SLR_Cal.tv];
+			SLR_Cal.shots++;
+			SLR_Cal.fired = 0;
+			if(++SLR_Cal.shot == CAL_SHOTS) cal_pass();
+			break;
+		}
+		SLR_Shutter.measured = SLR_Shutter.lit = 0;
+		if(shutter_fire(SLR_Cal.tv)) SLR_Cal.fired = 1;
+		break;
+	case CAL_SAVING:
+		/* the words that changed, then the check word */
+		while(SLR_Cal.word <= SHUTTER_CAL_WORDS){
+			uint32_t w = (SLR_Cal.word < SHUTTER_CAL_WORDS) ? SHUTTER_CAL_WORD(SLR_Shutter.corr, SLR_Cal.word)
+			                                                : shutter_cal_check(SLR_Shutter.corr);
+			if((hal_eeprom_read(SHUTTER_CAL_BASE + SLR_Cal.word) != w)
+			&& !log_eeprom_write(SHUTTER_CAL_BASE + SLR_Cal.word, w)) break;
+			SLR_Cal.word++;
+		}
+		if((SLR_Cal.word > SHUTTER_CAL_WORDS) && !log_busy()) SLR_Cal.state = CAL_DONE;
+		break;
+	default:
+		break;
+	}
+	return SLR_Cal.state;
+}
+
+#endif /* SLR_CALIB_H */
@@ -0,0 +1,327 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    D I S P L A Y
+ *    -------------
+ *    The readout on a 128x32 SSD1306 OLED: shutter speed, aperture and
+ *    mode on the first line, ISO and EV on the second, and an over/under
+ *    bar in 1/3 stops under them. Every update draws the whole readout in
+ *    a frame buffer, which costs nothing, and compares it with a shadow of
+ *    what the display shows: only the columns that changed are sent, as a
+ *    few DMA transfers started one from the interrupt of the other. A dial
+ *    detent changes one field, some tens of bytes instead of the 518 of a
+ *    full redraw - the bus is free sooner and the MCU back in Stop mode.
+ *
+ *    The SSD1306 memory is 4 pages of 8 pixel rows; a byte is a column of a
+ *    page, bit 0 at the top.
+ */
+#ifndef SLR_DISPLAY_H
+#define SLR_DISPLAY_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_apex.h"
+
+#define DISPLAY_W      128
+#define DISPLAY_PAGES  4
+#define DISPLAY_SPANS  16   /* changed regions of one update                 */
+#define DISPLAY_GAP    8    /* unchanged columns worth a new region (its 6
+                               command bytes), fewer are sent along         */
+
+/* 5x7 font, columns, of the characters the readout uses */
+const char Display_chars[] = " \"+-./0123456789ABEIMOPRSTVf";
+const uint8_t Display_font[][5] = {
+	{0x00,0x00,0x00,0x00,0x00}, {0x00,0x07,0x00,0x07,0x00}, {0x08,0x08,0x3E,0x08,0x08},
+	{0x08,0x08,0x08,0x08,0x08}, {0x00,0x60,0x60,0x00,0x00}, {0x20,0x10,0x08,0x04,0x02},
+	{0x3E,0x51,0x49,0x45,0x3E}, {0x00,0x42,0x7F,0x40,0x00}, {0x42,0x61,0x51,0x49,0x46},
+	{0x21,0x41,0x45,0x4B,0x31}, {0x18,0x14,0x12,0x7F,0x10}, {0x27,0x45,0x45,0x45,0x39},
+	{0x3C,0x4A,0x49,0x49,0x30}, {0x01,0x71,0x09,0x05,0x03}, {0x36,0x49,0x49,0x49,0x36},
+	{0x06,0x49,0x49,0x29,0x1E}, {0x7E,0x11,0x11,0x11,0x7E}, {0x7F,0x49,0x49,0x49,0x36},
+	{0x7F,0x49,0x49,0x49,0x41}, {0x00,0x41,0x7F,0x41,0x00}, {0x7F,0x02,0x0C,0x02,0x7F},
+	{0x3E,0x41,0x41,0x41,0x3E}, {0x7F,0x09,0x09,0x09,0x06}, {0x7F,0x09,0x19,0x29,0x46},
+	{0x46,0x49,0x49,0x49,0x31}, {0x01,0x01,0x7F,0x01,0x01}, {0x1F,0x20,0x40,0x20,0x1F},
+	{0x08,0x7E,0x09,0x01,0x02}
+};
+
+const char *const Display_modes[] = {"IS", "MA", "MT", "AV", "TV", "PR"};
+
+/* power up: display off, horizontal addressing, 32 rows, charge pump, on */
+const uint8_t Display_init[] = {0xAE, 0x20, 0x00, 0xA8, 0x1F, 0xDA, 0x02, 0x8D, 0x14, 0xAF};
+
+/* the marks of the third stops, as on the dials: the 1/x of the speeds
+ * from 1/4 (Tv 6/3) to 1/8000 (39/3), and the tenths of a second from
+ * 0.3 (5/3) down to 30 (-15/3)
+ */
+const uint16_t Display_tv_marks[34] = {
+	4, 5, 6, 8, 10, 13, 15, 20, 25, 30, 40, 50, 60, 80, 100, 125, 160,
+	200, 250, 320, 400, 500, 640, 800, 1000, 1250, 1600, 2000, 2500, 3200, 4000, 5000, 6400, 8000
+};
+const uint16_t Display_tv_tenths[21] = {
+	3, 4, 5, 6, 8, 10, 13, 16, 20, 25, 32, 40, 50, 60, 80, 100, 130, 150, 200, 250, 300
+};
+/* the tenths of the f-numbers of the third stops, f/1 (Av 0) to f/64 (36/3) */
+const uint16_t Display_av_marks[37] = {
+	10, 11, 12, 14, 16, 18, 20, 22, 25, 28, 32, 35, 40, 45, 50, 56, 63, 71, 80,
+	90, 100, 110, 130, 140, 160, 180, 200, 220, 250, 290, 320, 360, 400, 450, 510, 570, 640
+};
+/* the same for the half stops: 1/4 (Tv 4/2) to 1/8000 (26/2), 0.3 (3/2)
+ * to 30 (-10/2), f/1 to f/64 (24/2)
+ */
+const uint16_t Display_tv_halves[23] = {
+	4, 6, 8, 10, 15, 20, 30, 45, 60, 90, 125, 180, 250, 350, 500, 750, 1000, 1500, 2000, 3000, 4000, 6000, 8000
+};
+const uint16_t Display_tv_half_tenths[14] = {
+	3, 5, 7, 10, 15, 20, 30, 40, 60, 80, 100, 150, 200, 300
+};
+const uint16_t Display_av_halves[25] = {
+	10, 12, 14, 17, 20, 24, 28, 33, 40, 48, 56, 67, 80, 95, 110, 130, 160, 190, 220, 270, 320, 380, 450, 540, 640
+};
+
+/* what the readout shows - an update with the same is skipped */
+typedef struct {
+	uint8_t mode, iso;
+	uint8_t step;    /* SLR_Dial, the marks shown  */
+	uint8_t fault;   /* apex_fault_t: its field shows -- */
+	int16_t av, tv;  /* APEX, 1/24 stops            */
+	int8_t  ev;      /* whole stops                 */
+	int8_t  over;    /* 1/3 stops, > 0 over exposed */
+} display_view_t;
+
+typedef struct {
+	uint8_t page, x0, x1;
+} display_span_t;
+
+typedef struct {
+	uint8_t fb[DISPLAY_PAGES][DISPLAY_W];     /* the readout, drawn by the update    */
+	uint8_t shadow[DISPLAY_PAGES][DISPLAY_W]; /* what the display shows, DMA source  */
+	/* transfers of the update, run by display_xfer_isr() */
+	display_span_t   span[DISPLAY_SPANS];
+	uint8_t          cmd[6];
+	volatile uint8_t spans, next, data;
+	volatile uint8_t busy;
+	/* main loop only */
+	display_view_t shown;
+	uint8_t  full;      /* the display content is unknown, send it all */
+	uint8_t  stale;     /* an update waited for the bus                */
+	/* statistics */
+	uint32_t bytes;     /* sent, commands included                     */
+	uint16_t updates;   /* updates that sent something                 */
+} display_t;
+
+display_t SLR_Display;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* starts the transfer of the next span, command then data */
+void display_start(void){
+	display_span_t *s;
+	uint16_t n;
+	if(SLR_Display.next >= SLR_Display.spans){ SLR_Display.busy = 0; return; }
+	s = &SLR_Display.span[SLR_Display.next];
+	if(!SLR_Display.data){
+		SLR_Display.cmd[0] = 0x21; SLR_Display.cmd[1] = s->x0; SLR_Display.cmd[2] = s->x1;
+		SLR_Display.cmd[3] = 0x22; SLR_Display.cmd[4] = s->page; SLR_Display.cmd[5] = s->page;
+		SLR_Display.data = 1;
+		SLR_Display.bytes += 6;
+		hal_display_xfer(0, SLR_Display.cmd, 6);
+		return;
+	}
+	n = s->x1 - s->x0 + 1;
+	SLR_Display.data = 0;
+	SLR_Display.next++;
+	SLR_Display.bytes += n;
+	hal_display_xfer(1, &SLR_Display.shadow[s->page][s->x0], n);
+}
+
+/* DMA complete interrupt of the display bus */
+void display_xfer_isr(void){
+	display_start();
+}
+
+uint8_t display_busy(void){
+	return SLR_Display.busy;
+}
+
+/* Powers the display up; the first update sends the whole readout. */
+void display_init(void){
+	SLR_Display.spans = SLR_Display.next = SLR_Display.data = 0;
+	SLR_Display.full = 1;
+	SLR_Display.stale = 0;
+	SLR_Display.busy = 1;
+	SLR_Display.bytes += sizeof(Display_init);
+	hal_display_xfer(0, Display_init, sizeof(Display_init));
+}
+
+/* -- drawing, in the frame buffer -- */
+
+/* the decimal digits of v at p, returns their count */
+uint8_t display_utoa(char *p, uint16_t v){
+	char d[5];
+	uint8_t n = 0, i;
+	do{ d[n++] = '0' + v % 10; v /= 10; }while(v);
+	for(i = 0; i < n; i++) p[i] = d[n - 1 - i];
+	return n;
+}
+
+/* clears w columns of a page from x, then writes s there */
+void display_text(uint8_t page, uint8_t x, uint8_t w, const char *s){
+	uint8_t *row = &SLR_Display.fb[page][x];
+	uint8_t i, c, k;
+	for(i = 0; i < w; i++) row[i] = 0;
+	for(i = 0; s[i] && (i + 1) * 6 <= w; i++){
+		for(c = 0; Display_chars[c] && Display_chars[c] != s[i]; c++);
+		if(!Display_chars[c]) c = 0;
+		for(k = 0; k < 5; k++) row[i * 6 + k] = Display_font[c][k];
+	}
+}
+
+/* the shutter speed of an APEX Tv, to the nearest click of the dials
+ * (step, APEX_THIRD or APEX_HALF): 1/8000 to 1/4, 0"3 to 30", whole
+ * seconds past that, B for bulb
+ */
+void display_tv(int16_t tv, uint8_t step, char *p){
+	int16_t n, top = 13 * APEX_UNIT / step, quarter = 2 * APEX_UNIT / step;
+	uint32_t v;
+	uint8_t k;
+	if(tv == APEX_BULB){ p[0] = 'B'; p[1] = 0; return; }
+	n = apex_steps(tv, step);
+	if(n > top) n = top;
+	if(n >= quarter){
+		p[0] = '1'; p[1] = '/';
+		v = (step == APEX_HALF) ? Display_tv_halves[n - quarter] : Display_tv_marks[n - quarter];
+		p[2 + display_utoa(p + 2, (uint16_t)v)] = 0;
+		return;
+	}
+	if(n >= -5 * APEX_UNIT / step){
+		v = (step == APEX_HALF) ? Display_tv_half_tenths[quarter - 1 - n] : Display_tv_tenths[quarter - 1 - n];
+		k = display_utoa(p, v / 10);
+		p[k++] = '"';
+		if(v % 10) p[k++] = '0' + v % 10;
+		p[k] = 0;
+		return;
+	}
+	v = (apex_tv_us(tv) + 500000) / 1000000;
+	k = display_utoa(p, (uint16_t)v);
+	p[k++] = '"';
+	p[k] = 0;
+}
+
+/* the f-number of an APEX Av, to the nearest click of the dials: f/1.4,
+ * f/16
+ */
+void display_av(int16_t av, uint8_t step, char *p){
+	int16_t n = apex_steps(av, step), top = 12 * APEX_UNIT / step;
+	uint16_t v;
+	uint8_t k = 2;
+	if(n < 0) n = 0;
+	if(n > top) n = top;
+	v = (step == APEX_HALF) ? Display_av_halves[n] : Display_av_marks[n];
+	p[0] = 'f'; p[1] = '/';
+	k += display_utoa(p + k, v / 10);
+	if((v < 100) && (v % 10)){ p[k++] = '.'; p[k++] = '0' + v % 10; }
+	p[k] = 0;
+}
+
+/* the over/under bar: a tick every 1/3 stop, long ones at the stops, over
+ * the bottom page; the mark above it, on the page before
+ */
+void display_bar(int8_t over){
+	uint8_t *mark = SLR_Display.fb[2], *scale = SLR_Display.fb[3];
+	int8_t k;
+	uint8_t x, i;
+	for(x = 0; x < DISPLAY_W; x++) mark[x] = scale[x] = 0;
+	for(x = 10; x <= 118; x++) scale[x] = 0x01;
+	for(k = -9; k <= 9; k++) scale[64 + k * 6] = (k % 3) ? 0x03 : 0x0F;
+	scale[64] = 0x1F;
+	if(over > 9) over = 9;
+	if(over < -9) over = -9;
+	x = 64 + over * 6;
+	for(i = 0; i < 5; i++) mark[x - 2 + i] = (i == 2) ? 0x70 : (i & 1) ? 0x30 : 0x10;
+}
+
+/* the changed regions of every page into the span list, the shadow
+ * updated - DISPLAY_SPANS / DISPLAY_PAGES at most per page, the last one
+ * going on to the end of the page
+ */
+void display_diff(void){
+	uint8_t p, x, x0, x1, k, n = 0;
+	for(p = 0; p < DISPLAY_PAGES; p++){
+		uint8_t *fb = SLR_Display.fb[p], *sh = SLR_Display.shadow[p];
+		for(x = 0, k = 0; x < DISPLAY_W; ){
+			if(!SLR_Display.full && (fb[x] == sh[x])){ x++; continue; }
+			x0 = x1 = x;
+			if(++k == DISPLAY_SPANS / DISPLAY_PAGES){
+				x1 = x = DISPLAY_W - 1;
+			}
+			/* up to the next run of DISPLAY_GAP unchanged columns */
+			for(x++; x < DISPLAY_W; x++){
+				if(SLR_Display.full || (fb[x] != sh[x])) x1 = x;
+				else if(x - x1 >= DISPLAY_GAP) break;
+			}
+			SLR_Display.span[n].page = p;
+			SLR_Display.span[n].x0 = x0;
+			SLR_Display.span[n].x1 = x1;
+			n++;
+			for(; x0 <= x1; x0++) sh[x0] = fb[x0];
+		}
+	}
+	SLR_Display.full = 0;
+	SLR_Display.spans = n;
+}
+
+/* Main loop side: redraws what changed in the exposure state, returns 1 if
+ * it sent something. With the bus still busy it waits for the next call.
+ */
+uint8_t display_update(void){
+	exposure_t x;
+	display_view_t v;
+	apex_t s;
+	uint8_t n;
+	char buf[8];
+
+	slr_snapshot(&x);
+	s = solveExposure(&x);
+	v.mode  = x.mode;
+	v.iso   = x.iso;
+	v.step  = SLR_Dial;
+	v.fault = apex_fault(x.mode, &s);
+	v.av    = s.av;
+	v.tv    = s.tv;
+	v.ev    = (int8_t)(x.ev8 >> 3);
+	/* av + tv - (ev + sv), to 1/3 stops, as far as the bar goes */
+	if(s.err > 10 * APEX_THIRD) s.err = 10 * APEX_THIRD;
+	if(s.err < -10 * APEX_THIRD) s.err = -10 * APEX_THIRD;
+	v.over = (int8_t)-apex_thirds(s.err);
+	if(!SLR_Display.full && !SLR_Display.stale
+	&& (v.mode == SLR_Display.shown.mode) && (v.iso == SLR_Display.shown.iso) && (v.fault == SLR_Display.shown.fault)
+	&& (v.step == SLR_Display.shown.step)
+	&& (v.av == SLR_Display.shown.av) && (v.tv == SLR_Display.shown.tv)
+	&& (v.ev == SLR_Display.shown.ev) && (v.over == SLR_Display.shown.over)) return 0;
+	if(SLR_Display.busy){ SLR_Display.stale = 1; return 0; }
+	SLR_Display.stale = 0;
+	SLR_Display.shown = v;
+
+	display_tv(v.tv, v.step, buf);
+	display_text(0, 0, 36, (v.fault == APEX_NO_SPEED) ? "--" : buf);
+	display_av(v.av, v.step, buf);
+	display_text(0, 48, 36, (v.fault == APEX_NO_APERTURE) ? "f/--" : buf);
+	display_text(0, 116, 12, Display_modes[v.mode]);
+	buf[0] = 'I'; buf[1] = 'S'; buf[2] = 'O';
+	buf[3 + display_utoa(buf + 3, ISO_values[v.iso])] = 0;
+	display_text(1, 0, 42, buf);
+	buf[0] = 'E'; buf[1] = 'V'; n = 2;
+	if(v.ev < 0) buf[n++] = '-';
+	buf[n + display_utoa(buf + n, (v.ev < 0) ? -v.ev : v.ev)] = 0;
+	display_text(1, 92, 36, buf);
+	display_bar(v.over);
+
+	display_diff();
+	if(!SLR_Display.spans) return 0;
+	SLR_Display.updates++;
+	SLR_Display.next = SLR_Display.data = 0;
+	SLR_Display.busy = 1;
+	display_start();
+	return 1;
+}
+
+#endif /* SLR_DISPLAY_H */
@@ -0,0 +1,223 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    F L I C K E R
+ *    -------------
+ *    Fluorescent tubes and most LED lamps pulse at twice the mains, 100 or
+ *    120 Hz (some LEDs at the mains itself), up to dark between two
+ *    pulses. The meter doesn't see it: every TSL2591 integration is a
+ *    whole number of periods of all of them, so its EV is the mean. A fast
+ *    speed does - it takes the light of wherever in the period it lands,
+ *    and the frames of a roll come out a stop apart.
+ *
+ *    In the flicker mode the release starts with a burst of FLICKER_N
+ *    samples of a photodiode beside the TSL2591, FLICKER_SAMPLE_US apart:
+ *    100 ms, a whole number of periods of 50, 60, 100 and 120 Hz, so each
+ *    of them falls on a bin of the DFT and the others and the mean leave
+ *    it alone. Four bins, integer, a quarter wave table: no FFT needed.
+ *    The strongest one, deep enough, is the flicker, with its depth and
+ *    phase, and the samples folded over one period give its shape - a
+ *    square LED pulse is no sine.
+ *
+ *    The release then waits for a peak: the middle of the exposure, in the
+ *    middle of the gate (Flicker_gate_us after the first magnet), lands on
+ *    it, at every frame. The exposure is worked out for the light over
+ *    the exposure around the peak, not the mean (flicker_peak_ev8()). Slow
+ *    speeds, a period or more, see the mean anyway, and fire at once.
+ */
+#ifndef SLR_FLICKER_H
+#define SLR_FLICKER_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_shutter.h"
+
+#define FLICKER_SAMPLE_US 500     /* 2 kHz                                   */
+#define FLICKER_N         200     /* samples of a burst                      */
+#define FLICKER_CYCLE_US  (FLICKER_N * FLICKER_SAMPLE_US)  /* 100 ms          */
+#define FLICKER_BINS      20      /* of the period, for its shape            */
+#define FLICKER_MIN_DEPTH 40      /* permille of the mean, less is steady    */
+
+/** USER CONSTANT - the first curtain magnet to the light in the middle of
+ *  the gate, us (the travel of the curtain; the calibration rig of
+ *  slr_calib.h shows it).
+ */
+const uint16_t Flicker_gate_us = 6000;
+
+/* DFT bins of 50, 60, 100 and 120 Hz over a burst */
+const uint8_t Flicker_k[4] = {5, 6, 10, 12};
+
+/* round(16384 sin(2 pi j / FLICKER_N)), a quarter wave */
+const int16_t Flicker_sin[FLICKER_N / 4 + 1] = {
+	    0,   515,  1029,  1542,  2053,  2563,  3070,  3574,  4075,
+	 4571,  5063,  5550,  6031,  6507,  6976,  7438,  7893,  8340,
+	 8779,  9209,  9630, 10042, 10444, 10835, 11216, 11585, 11943,
+	12290, 12624, 12946, 13255, 13551, 13833, 14102, 14357, 14598,
+	14825, 15036, 15233, 15415, 15582, 15733, 15869, 15989, 16094,
+	16182, 16255, 16311, 16352, 16376, 16384
+};
+
+/* round(1000 2^((n + 1/2) / 8)), n = 0..15: light to 1/8 stops, rounded */
+const uint16_t Flicker_stops[16] = {1044, 1139, 1242, 1354, 1477, 1610, 1756, 1915,
+                                    2089, 2278, 2484, 2709, 2954, 3221, 3513, 3831};
+
+typedef enum { FLICKER_IDLE = 0, FLICKER_SAMPLING, FLICKER_SAMPLED} flicker_state_t;
+
+typedef struct {
+	uint8_t  on;                  /* the flicker mode                          */
+	volatile flicker_state_t state;
+	uint16_t buf[FLICKER_N];      /* the burst, ADC counts                     */
+	uint32_t t0;                  /* hal_micros() of its first sample          */
+	/* the last burst analysed */
+	uint8_t  k;                   /* DFT bin of the flicker, 0 = steady light  */
+	uint8_t  hz;                  /* its frequency                             */
+	uint16_t depth;               /* amplitude of it, permille of the mean     */
+	uint16_t mean;                /* ADC counts                                */
+	uint32_t peak_us;             /* hal_micros() of the peak nearest the middle */
+	uint16_t shape[FLICKER_BINS]; /* a period from the peak, permille of the mean */
+	uint32_t bursts;
+} flicker_t;
+
+flicker_t SLR_Flicker;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* 16384 sin(2 pi j / FLICKER_N), and the cosine */
+int16_t flicker_sin(uint16_t j){
+	j %= FLICKER_N;
+	if(j <= FLICKER_N / 4)     return Flicker_sin[j];
+	if(j <= FLICKER_N / 2)     return Flicker_sin[FLICKER_N / 2 - j];
+	if(j <= 3 * FLICKER_N / 4) return -Flicker_sin[j - FLICKER_N / 2];
+	return -Flicker_sin[FLICKER_N - j];
+}
+#define flicker_cos(j) flicker_sin((j) + FLICKER_N / 4)
+
+uint32_t flicker_isqrt(uint64_t x){
+	uint64_t r = 0, b = (uint64_t)1 << 62;
+	while(b > x) b >>= 2;
+	while(b){
+		if(x >= r + b){ x -= r + b; r = (r >> 1) + b; }
+		else r >>= 1;
+		b >>= 2;
+	}
+	return (uint32_t)r;
+}
+
+/* Starts a burst - 0 if one is running. */
+uint8_t flicker_start(void){
+	if(SLR_Flicker.state == FLICKER_SAMPLING) return 0;
+	SLR_Flicker.state = FLICKER_SAMPLING;
+	SLR_Flicker.t0 = hal_micros() + FLICKER_SAMPLE_US;
+	hal_flicker_burst(SLR_Flicker.buf, FLICKER_N, FLICKER_SAMPLE_US);
+	return 1;
+}
+
+/* DMA complete interrupt of the burst */
+void flicker_burst_isr(void){
+	SLR_Flicker.state = FLICKER_SAMPLED;
+}
+
+uint8_t flicker_busy(void){
+	return SLR_Flicker.state == FLICKER_SAMPLING;
+}
+
+/* The flicker of the burst: frequency, depth, the peak and the shape. */
+void flicker_analyse(void){
+	uint32_t sum = 0, mag, best = 0, acc[FLICKER_BINS] = {0};
+	int32_t re = 0, im = 0, bre = 0, bim = 0;
+	int64_t v, vmax;
+	uint16_t n, j, jp = 0, cnt[FLICKER_BINS] = {0};
+	uint8_t i, k = 0, b;
+
+	for(n = 0; n < FLICKER_N; n++) sum += SLR_Flicker.buf[n];
+	SLR_Flicker.mean = sum / FLICKER_N;
+	SLR_Flicker.bursts++;
+	/* the four bins; the mean falls on none of them */
+	for(i = 0; i < 4; i++){
+		int64_t r = 0, m = 0;
+		for(n = 0, j = 0; n < FLICKER_N; n++){
+			r += (int32_t)SLR_Flicker.buf[n] * flicker_cos(j);
+			m += (int32_t)SLR_Flicker.buf[n] * flicker_sin(j);
+			j += Flicker_k[i];
+			if(j >= FLICKER_N) j -= FLICKER_N;
+		}
+		re = (int32_t)(r >> 4);
+		im = (int32_t)(m >> 4);
+		mag = flicker_isqrt((int64_t)re * re + (int64_t)im * im);
+		if(mag > best){ best = mag; k = Flicker_k[i]; bre = re; bim = im; }
+	}
+	/* amplitude 2 |X| / N over the mean sum / N, |X| in 1/1024 */
+	SLR_Flicker.depth = sum ? (uint16_t)((uint64_t)best * 2000 / ((uint64_t)sum << 10)) : 0;
+	if(SLR_Flicker.depth < FLICKER_MIN_DEPTH){
+		SLR_Flicker.k = SLR_Flicker.hz = 0;
+		return;
+	}
+	SLR_Flicker.k  = k;
+	SLR_Flicker.hz = (uint8_t)(k * (1000000u / FLICKER_CYCLE_US));
+	/* the phase of the peak, in 1/FLICKER_N of a period */
+	vmax = INT64_MIN;
+	for(j = 0; j < FLICKER_N; j++){
+		v = (int64_t)bre * flicker_cos(j) + (int64_t)bim * flicker_sin(j);
+		if(v > vmax){ vmax = v; jp = j; }
+	}
+	/* sample n is at phase n k, the peaks at jp: the one nearest the middle
+	 * of the burst, where the phase holds best if the mains is a bit off */
+	n = (uint16_t)((k * FLICKER_N / 2 + FLICKER_N / 2 - jp) / FLICKER_N);
+	SLR_Flicker.peak_us = SLR_Flicker.t0 + ((uint32_t)jp * FLICKER_SAMPLE_US + (uint32_t)n * FLICKER_CYCLE_US + k / 2) / k;
+	/* the samples folded over a period, bin 0 on the peak */
+	for(n = 0, j = 0; n < FLICKER_N; n++){
+		uint16_t rel = (j + FLICKER_N - jp) % FLICKER_N;
+		b = (uint8_t)(((uint32_t)rel * FLICKER_BINS + FLICKER_N / 2) / FLICKER_N % FLICKER_BINS);
+		acc[b] += SLR_Flicker.buf[n];
+		cnt[b]++;
+		j += k;
+		if(j >= FLICKER_N) j -= FLICKER_N;
+	}
+	for(b = 0; b < FLICKER_BINS; b++)
+		SLR_Flicker.shape[b] = cnt[b] ? (uint16_t)((uint64_t)acc[b] * 1000 * FLICKER_N / ((uint64_t)cnt[b] * sum)) : 1000;
+}
+
+/* Main loop side: 1 once the burst is over and analysed, or if there was
+ * none to wait for.
+ */
+uint8_t flicker_done(void){
+	if(SLR_Flicker.state == FLICKER_SAMPLING) return 0;
+	if(SLR_Flicker.state == FLICKER_SAMPLED){
+		flicker_analyse();
+		SLR_Flicker.state = FLICKER_IDLE;
+	}
+	return 1;
+}
+
+/* 1 if an exposure of us is short enough to be timed on a peak */
+uint8_t flicker_sync(uint32_t us){
+	return SLR_Flicker.k && ((uint64_t)us * SLR_Flicker.k < FLICKER_CYCLE_US);
+}
+
+/* 1/8 stops the light over us around the peak is over the mean */
+int8_t flicker_peak_ev8(uint32_t us){
+	uint32_t sum = 0;
+	int16_t h, b;
+	uint8_t n = 0;
+	if(!flicker_sync(us)) return 0;
+	/* 2h + 1 bins of the period, the odd count nearest the exposure */
+	h = (int16_t)((us * SLR_Flicker.k * FLICKER_BINS) / (2 * FLICKER_CYCLE_US));
+	for(b = -h; b <= h; b++) sum += SLR_Flicker.shape[(b + FLICKER_BINS) % FLICKER_BINS];
+	sum /= 2 * h + 1;
+	while((n < 16) && (sum >= Flicker_stops[n])) n++;
+	return (int8_t)n;
+}
+
+/* us to wait, past the lead of the shutter, for the middle of an exposure
+ * of us to land on a peak - 0 without flicker, or for a slow speed
+ */
+uint16_t flicker_wait(uint32_t us){
+	uint32_t d, ph;
+	if(!flicker_sync(us)) return 0;
+	d  = hal_micros() + Shutter_lead + Flicker_gate_us + us / 2 - SLR_Flicker.peak_us;
+	/* the phase of it, in 1/k us */
+	ph = (uint32_t)(((uint64_t)d * SLR_Flicker.k) % FLICKER_CYCLE_US);
+	return ph ? (uint16_t)((FLICKER_CYCLE_US - ph + SLR_Flicker.k / 2) / SLR_Flicker.k) : 0;
+}
+
+#endif /* SLR_FLICKER_H */
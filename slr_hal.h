@@ -0,0 +1,148 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ */
+
+/** HARDWARE ABSTRACTION
+ *  ====================
+ *  The hooks the camera logic needs from the hardware. The STM32L1 firmware
+ *  implements them on top of its peripherals; the host build (see host/)
+ *  implements them on top of a simulated clock, so that slr.h and its
+ *  modules run unchanged on a PC.
+ */
+#ifndef SLR_HAL_H
+#define SLR_HAL_H
+
+#include <stdint.h>
+
+/* keeps the compiler from moving memory accesses across it - enough to
+ * order the data and the index of a ring buffer shared with an interrupt
+ * on the single core M3
+ */
+#define SLR_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+/* free running microsecond time base (wraps after ~71 minutes) */
+uint32_t hal_micros(void);
+
+/* -- shutter timer ------------------------------------------------------ */
+/* A 16 bit up-counter at 1 MHz with two compare channels, one for each
+ * curtain (0 = first curtain, 1 = second curtain). On a match the timer
+ * calls shutter_timer_isr(ch); when armed with pin != 0 the timer output
+ * releases the curtain magnet itself at the match (output compare), without
+ * waiting for the interrupt.
+ */
+uint16_t hal_tim_now(void);
+void     hal_tim_arm(uint8_t ch, uint16_t at, uint8_t pin);
+void     hal_tim_disarm(uint8_t ch);
+/* releases a curtain magnet from software */
+void     hal_curtain_release(uint8_t curtain);
+/* For the calibration (see slr_calib.h), a phototransistor in the film
+ * gate sits on a third capture channel of the same timer, both edges: the
+ * interrupt calls shutter_light_isr(light, capture).
+ */
+
+/* -- light sensor ------------------------------------------------------- */
+/* The TSL2591 runs continuously and pulls its INT pin at the end of every
+ * integration; the EXTI interrupt calls meter_ready_isr(). Both calls below
+ * only queue an I2C transfer and return.
+ */
+/* writes the CONTROL register (gain and integration time, see tsl2591.h),
+ * which also restarts the integration */
+void     hal_tsl2591_config(uint8_t gain, uint8_t it);
+/* starts the DMA read of the four channel data registers; the DMA complete
+ * interrupt calls meter_sample_isr(ch0, ch1) */
+void     hal_tsl2591_read(void);
+/* powers the sensor down (ENABLE register), until the next config */
+void     hal_tsl2591_off(void);
+
+/* For the flicker mode (see slr_flicker.h), a photodiode beside it on the
+ * ADC: hal_flicker_burst() starts n conversions, period_us apart on a timer
+ * trigger, the first one period_us from the call, into buf by DMA, and
+ * returns; the DMA complete interrupt calls flicker_burst_isr().
+ */
+void     hal_flicker_burst(uint16_t *buf, uint16_t n, uint16_t period_us);
+
+/* -- EF lens ------------------------------------------------------------ */
+/* Starts a full duplex DMA exchange of len bytes with the lens. The lens
+ * holds the bus while it works (an aperture move); the DMA complete
+ * interrupt, or the EXTI of the bus release after it, calls
+ * lens_xfer_isr() once both are over.
+ */
+void     hal_lens_xfer(const uint8_t *tx, uint8_t *rx, uint8_t len);
+
+/* -- mirror ------------------------------------------------------------- */
+/* Starts the mirror up (1) or down (0) and returns. The mirror position
+ * switch interrupt calls release_mirror_isr(up) once it is there - for up,
+ * after the bounce is damped.
+ */
+void     hal_mirror(uint8_t up);
+
+/* -- user interface ----------------------------------------------------- */
+void     hal_led_green(uint8_t on);
+/* The dial encoders and the buttons sit on timer capture channels, both
+ * edges, all at one interrupt priority. An edge on a dial pin calls
+ * input_encoder_isr(dial, ab) with both pins of the dial read in the
+ * interrupt; an edge on a button calls input_button_isr(src, level,
+ * capture) with the 1 MHz capture register of the edge (see slr_input.h).
+ * The half-press is an EXTI line, both edges: power_halfpress_isr(level),
+ * pressed = 0 (see slr_power.h). The dial and button pins are EXTI lines
+ * too, only to wake the MCU from Stop mode.
+ */
+
+/* -- display ------------------------------------------------------------ */
+/* The SSD1306 OLED, on SPI with its D/C pin: starts the DMA of len bytes,
+ * commands (data = 0) or display memory (data = 1), and returns; the DMA
+ * complete interrupt calls display_xfer_isr().
+ */
+void     hal_display_xfer(uint8_t data, const uint8_t *buf, uint16_t len);
+
+/* -- data EEPROM -------------------------------------------------------- */
+/* The data EEPROM, by 32 bit words from the start of it. A read is a
+ * memory read; hal_eeprom_write() starts the write of one word - erase
+ * and program, about 3.3 ms, no page erase - and returns, and the end of
+ * programming interrupt calls log_eeprom_isr(). An erased word reads 0.
+ * HAL_EEPROM_WORDS is its size: 4 KB on the Cat.1 and Cat.2 parts, 8 KB
+ * and more on the bigger ones.
+ */
+#ifndef HAL_EEPROM_WORDS
+#define HAL_EEPROM_WORDS 1024
+#endif
+uint32_t hal_eeprom_read(uint16_t word);
+void     hal_eeprom_write(uint16_t word, uint32_t data);
+
+/* -- RTC ---------------------------------------------------------------- */
+/* The RTC on the 32768 Hz LSE crystal, running in Stop mode: its seconds
+ * and sub-seconds read as one count of crystal ticks (wraps after ~36 h).
+ * hal_rtc_alarm() sets the alarm at a tick, one shot: its EXTI line wakes
+ * the MCU from Stop mode and the interrupt calls long_rtc_isr() (see
+ * slr_long.h); hal_rtc_alarm_off() cancels it.
+ */
+uint32_t hal_rtc_ticks(void);
+void     hal_rtc_alarm(uint32_t tick);
+void     hal_rtc_alarm_off(void);
+
+/* -- power -------------------------------------------------------------- */
+/* PRIMASK, around a look at the interrupts' state and what is done on it:
+ * the last look for work before hal_sleep() - an interrupt coming in
+ * between still wakes it (WFI wakes on a pending interrupt even masked)
+ * and runs at hal_irq_enable() - or the meter power down.
+ */
+void     hal_irq_disable(void);
+void     hal_irq_enable(void);
+/* Waits for an interrupt, in Sleep mode (deep = 0: the core stops, the
+ * peripherals and their clocks run) or in Stop mode (deep = 1: every clock
+ * but the RTC one stops, only the EXTI lines of the half-press, the dials,
+ * the buttons and the RTC alarm wake it). Returns after the interrupt, with
+ * the clocks restored - the interrupt itself runs on the wake-up clock, so
+ * it only sets flags.
+ */
+void     hal_sleep(uint8_t deep);
+
+/* -- debug UART --------------------------------------------------------- */
+/* queues len bytes for the UART (DMA) and returns - buf is read while
+ * they go, so it must stay as it is until hal_uart_busy() is 0, and no
+ * other write may start before that */
+void     hal_uart_write(const uint8_t *buf, uint16_t len);
+/* 1 while the last write is still going out */
+uint8_t  hal_uart_busy(void);
+
+#endif /* SLR_HAL_H */
@@ -0,0 +1,189 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    D I A L S   A N D   B U T T O N S
+ *    ---------------------------------
+ *    The encoder and button pins are timer input capture channels, on both
+ *    edges. Their interrupts decode and debounce right there and drop one
+ *    event per detent or press in a ring buffer; input_poll(), from the
+ *    main loop, takes all the events in the ring at once, adds up the
+ *    detents of each dial and hands the net result to the set*() function
+ *    of that dial in one call - a fast spin is one batch for the main
+ *    loop, one clamp, one lens move and one redraw (changed), and nothing
+ *    waits on a debounce delay.
+ *    All the input interrupts run at the same priority, so they never
+ *    preempt each other: the ring has a single producer and a single
+ *    consumer, and needs no lock.
+ */
+#ifndef SLR_INPUT_H
+#define SLR_INPUT_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_lens.h"
+
+#define INPUT_RING     32    /* events, power of two                          */
+#define INPUT_DEBOUNCE 5000  /* us a button must be quiet before a press     */
+
+/* the event sources: the dials first, then the buttons */
+typedef enum { INPUT_DIAL_AV = 0, INPUT_DIAL_TV, INPUT_DIAL_ISO,
+               INPUT_BTN_MODE, INPUT_BTN_LENS, INPUT_SOURCES} input_src_t;
+#define INPUT_DIALS INPUT_BTN_MODE
+
+/* what a dial does: called once with its net detents, > 0 up */
+void (*const Input_dial[INPUT_DIALS])(int8_t steps) = {
+	setAV, setTV, setISO
+};
+/* what a button does: called with dir 1, once per press */
+void (*const Input_button[INPUT_SOURCES - INPUT_DIALS])(uint8_t dir) = {
+	setSLRmode, setEOSlens
+};
+
+/* An event is a byte: the source in the high nibble, the direction of the
+ * detent (1 up, 0 down) in bit 0. A button press is always "up".
+ */
+#define INPUT_EVENT(src, dir) (uint8_t)(((src) << 4) | ((dir) & 1))
+
+/** Quadrature step for the (previous << 2 | current) state of the A (bit 0)
+ *  and B (bit 1) pins: +1, -1, or 0 for no change and for an impossible
+ *  jump of both pins.
+ */
+const int8_t Input_qdec[16] = {
+	 0, +1, -1,  0,
+	-1,  0,  0, +1,
+	+1,  0,  0, -1,
+	 0, -1, +1,  0
+};
+
+typedef struct {
+	uint8_t  ab;        /* pins at the last edge                    */
+	int8_t   acc;       /* quarter steps since the last detent      */
+} input_dial_t;
+
+typedef struct {
+	/* ring buffer, filled by the input interrupts, emptied by input_poll() */
+	uint8_t          ring[INPUT_RING];
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	/* decoder and debounce state, interrupts only */
+	input_dial_t dial[INPUT_DIALS];
+	uint32_t     last_us[INPUT_SOURCES - INPUT_DIALS];  /* last edge of a button */
+	uint8_t      level[INPUT_SOURCES - INPUT_DIALS];    /* its pin, at that edge  */
+	uint16_t     dropped;       /* events lost to a full ring                 */
+	/* main loop only */
+	int32_t      net[INPUT_SOURCES];  /* steps handed to the actions, + up - down */
+	uint32_t     events;        /* events taken from the ring                 */
+	uint32_t     steps;         /* action calls made for them: one a dial
+	                               a batch, one a press                       */
+	uint16_t     batches;       /* input_poll() calls that found events       */
+	uint8_t      changed;       /* set by input_poll(), cleared by the display */
+} input_t;
+
+input_t SLR_Input;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* with the pins of every dial as they are now, bit 0 A and bit 1 B, and
+ * the buttons released
+ */
+void input_init(const uint8_t *ab){
+	uint8_t i;
+	for(i = 0; i < INPUT_DIALS; i++){
+		SLR_Input.dial[i].ab  = ab[i] & 3;
+		SLR_Input.dial[i].acc = 0;
+	}
+	for(i = 0; i < INPUT_SOURCES - INPUT_DIALS; i++){
+		SLR_Input.level[i]   = 1;
+		SLR_Input.last_us[i] = hal_micros() - INPUT_DEBOUNCE;
+	}
+	SLR_Input.head = SLR_Input.tail = 0;
+	SLR_Input.dropped = 0;
+}
+
+void input_push(uint8_t ev){
+	uint8_t head = SLR_Input.head;
+	if((uint8_t)(head - SLR_Input.tail) >= INPUT_RING){ SLR_Input.dropped++; return; }
+	SLR_Input.ring[head & (INPUT_RING - 1)] = ev;
+	SLR_BARRIER();
+	SLR_Input.head = head + 1;
+}
+
+/* the 32 bit time of a 16 bit capture taken less than 65 ms ago */
+uint32_t input_capture_us(uint16_t capture){
+	uint32_t now = hal_micros();
+	return now - (uint16_t)((uint16_t)now - capture);
+}
+
+/* Capture interrupt of an A or B pin of a dial, with both pins read.
+ * Every edge steps the Gray code table; a contact bouncing on one pin only
+ * goes back and forth between two neighbour states and cancels itself.
+ * A detent is counted when the dial is back at rest (both pins high) and
+ * at least half a detent went one way, so one lost edge doesn't lose it.
+ */
+void input_encoder_isr(uint8_t dial, uint8_t ab){
+	input_dial_t *d = &SLR_Input.dial[dial];
+	ab &= 3;
+	d->acc += Input_qdec[(d->ab << 2) | ab];
+	d->ab = ab;
+	if(ab != 3) return;
+	if(d->acc >= 2)       input_push(INPUT_EVENT(dial, 1));
+	else if(d->acc <= -2) input_push(INPUT_EVENT(dial, 0));
+	d->acc = 0;
+}
+
+/* Capture interrupt of a button pin (pressed = 0, to ground), with the
+ * pin read in the interrupt and the captured time of the edge. The first
+ * edge after INPUT_DEBOUNCE of quiet is the button leaving the level it
+ * rested at: if that was released, it is a press, taken at once. Every
+ * edge restarts the quiet time, so the bounces behind it are ignored. The
+ * last interrupt of a burst always runs after its last edge, so the level
+ * it reads is the one the button rests at next.
+ */
+void input_button_isr(uint8_t src, uint8_t level, uint16_t capture){
+	uint32_t t = input_capture_us(capture);
+	uint8_t b = src - INPUT_DIALS;
+	if((t - SLR_Input.last_us[b] >= INPUT_DEBOUNCE) && SLR_Input.level[b]) input_push(INPUT_EVENT(src, 1));
+	SLR_Input.level[b]   = level & 1;
+	SLR_Input.last_us[b] = t;
+}
+
+/* Main loop side: takes every event in the ring, adds up each source,
+ * hands a dial its net count in one call, runs a button once per press,
+ * and publishes the exposure state they changed, once - returns the
+ * events taken.
+ */
+uint8_t input_poll(void){
+	int16_t net[INPUT_SOURCES] = {0};
+	uint8_t head = SLR_Input.head, n = 0, src;
+	SLR_BARRIER();
+	while(SLR_Input.tail != head){
+		uint8_t ev = SLR_Input.ring[SLR_Input.tail & (INPUT_RING - 1)];
+		SLR_BARRIER();
+		SLR_Input.tail++;
+		src = ev >> 4;
+		if(src >= INPUT_SOURCES) continue;
+		net[src] += (ev & 1) ? 1 : -1;
+		n++;
+	}
+	if(!n) return 0;
+	SLR_Input.events += n;
+	SLR_Input.batches++;
+	for(src = 0; src < INPUT_SOURCES; src++){
+		int16_t k = net[src];
+		if(!k) continue;
+		SLR_Input.net[src] += k;
+		SLR_Input.changed = 1;
+		if(src < INPUT_DIALS){
+			/* at most INPUT_RING events, an int8_t holds them */
+			Input_dial[src]((int8_t)k);
+			SLR_Input.steps++;
+			continue;
+		}
+		SLR_Input.steps += k;
+		for(; k > 0; k--) Input_button[src - INPUT_DIALS](1);
+	}
+	slr_publish();
+	return n;
+}
+
+#endif /* SLR_INPUT_H */
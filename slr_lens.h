@@ -0,0 +1,256 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    C A N O N   E F   L E N S
+ *    -------------------------
+ *    Asynchronous driver of the EF lens bus (SPI, mode 3). The main loop
+ *    only queues commands - identify the lens, read its aperture range,
+ *    drive the aperture - and returns; every transfer runs on DMA and the
+ *    next command is started from the interrupt of the previous one, so
+ *    the lens never sits on the shutter release path. Aperture moves are
+ *    coalesced: turning the dial over several stops while the lens is busy
+ *    gives a single move, to the last aperture asked for.
+ *
+ *    USE YOUR CANON LENS AT YOUR OWN RISC! (see slr.h)
+ */
+#ifndef SLR_LENS_H
+#define SLR_LENS_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_apex.h"
+
+/** EF bus opcodes, as logged between Canon bodies and lenses. Check them
+ *  against your own lens before trusting it with them.
+ *  Aperture codes are in 1/8 stops, 8 * (Av + 1): f/1.4 = 16, f/2 = 24...
+ *  the codes of the EOSEF* arrays of slr.h.
+ */
+#define EF_OP_FOCAL  0xA0  /* -> focal length in mm, 2 bytes               */
+#define EF_OP_RANGE  0xB0  /* -> wide open and closed aperture codes       */
+#define EF_OP_MOVE   0x13  /* signed 1/8 stop steps, lens busy while moving */
+
+typedef enum { LENS_CMD_IDENTIFY = 0, LENS_CMD_RANGE, LENS_CMD_APERTURE, LENS_CMDS} lens_cmd_t;
+
+#define LENS_QUEUE 4   /* pending commands, power of two */
+#define LENS_FRAME 3   /* bytes of every transfer        */
+
+/* focal length of the EOS lenses, by eos_t (their aperture codes are the
+ * EOS_apertures[] of slr.h) */
+const uint8_t EOS_focal[] = {50, 50, 50, 85, 85};
+#define EOS_MODELS (sizeof(EOS_focal) / sizeof(EOS_focal[0]))
+
+typedef struct {
+	uint8_t  cmd;
+	uint32_t queued_us; /* hal_micros() when queued */
+} lens_req_t;
+
+typedef struct {
+	/* command queue, filled by the main loop, emptied by lens_xfer_isr() */
+	lens_req_t       queue[LENS_QUEUE];
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	volatile uint8_t busy;       /* a transfer is in flight                   */
+	volatile uint8_t av_queued;  /* an aperture move is waiting in the queue  */
+	volatile int8_t  av_target;  /* aperture code it will drive to            */
+	lens_req_t cur;              /* the command in flight                     */
+	uint8_t  tx[LENS_FRAME], rx[LENS_FRAME];
+	/* what the lens told us */
+	uint8_t  valid;              /* identified as one of the eos_t lenses     */
+	eos_t    model;              /* which one                                 */
+	volatile uint8_t identified; /* for lens_poll(), set by the interrupt     */
+	uint16_t focal;              /* mm                                        */
+	uint8_t  wide, closed;       /* aperture codes                            */
+	int8_t   pos;                /* current aperture code                     */
+	/* statistics */
+	uint16_t coalesced;          /* aperture requests merged into a queued one */
+	uint16_t overruns;           /* commands lost to a full queue             */
+	uint32_t latency_us[LENS_CMDS]; /* queued to done, last command of a kind */
+} eflens_t;
+
+eflens_t SLR_Lens;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* starts the transfer of the next queued command, from the main loop when
+ * the bus is idle or from the interrupt of the previous transfer
+ */
+void lens_start(void){
+	int16_t steps;
+	for(;;){
+		if(SLR_Lens.tail == SLR_Lens.head){ SLR_Lens.busy = 0; return; }
+		SLR_Lens.cur = SLR_Lens.queue[SLR_Lens.tail & (LENS_QUEUE - 1)];
+		SLR_BARRIER();
+		SLR_Lens.tail++;
+		SLR_Lens.busy = 1;
+		SLR_Lens.tx[1] = SLR_Lens.tx[2] = 0;
+		switch(SLR_Lens.cur.cmd){
+		case LENS_CMD_IDENTIFY:
+			SLR_Lens.tx[0] = EF_OP_FOCAL;
+			break;
+		case LENS_CMD_RANGE:
+			SLR_Lens.tx[0] = EF_OP_RANGE;
+			break;
+		default:
+			/* the flag goes down before the target is read: a dial turn
+			 * from now on queues a new move */
+			SLR_Lens.av_queued = 0;
+			SLR_BARRIER();
+			steps = SLR_Lens.av_target - SLR_Lens.pos;
+			if(!SLR_Lens.valid || (steps == 0)){
+				/* nothing to move, done already */
+				SLR_Lens.latency_us[LENS_CMD_APERTURE] = hal_micros() - SLR_Lens.cur.queued_us;
+				continue;
+			}
+			SLR_Lens.tx[0] = EF_OP_MOVE;
+			SLR_Lens.tx[1] = (uint8_t)steps;
+			break;
+		}
+		hal_lens_xfer(SLR_Lens.tx, SLR_Lens.rx, LENS_FRAME);
+		return;
+	}
+}
+
+/* queues a command and starts the bus if idle - 0 if the queue is full */
+uint8_t lens_queue(uint8_t cmd){
+	uint8_t head = SLR_Lens.head;
+	lens_req_t *r;
+	if((uint8_t)(head - SLR_Lens.tail) >= LENS_QUEUE){ SLR_Lens.overruns++; return 0; }
+	r = &SLR_Lens.queue[head & (LENS_QUEUE - 1)];
+	r->cmd = cmd;
+	r->queued_us = hal_micros();
+	SLR_BARRIER();
+	SLR_Lens.head = head + 1;
+	/* queued before looking: if the interrupt ends the transfer in
+	 * between, it starts the new command itself */
+	SLR_BARRIER();
+	if(!SLR_Lens.busy) lens_start();
+	return 1;
+}
+
+/* Forgets the lens and queues its identification. */
+void lens_init(void){
+	SLR_Lens.head = SLR_Lens.tail = 0;
+	SLR_Lens.busy = SLR_Lens.av_queued = 0;
+	SLR_Lens.valid = SLR_Lens.identified = 0;
+	SLR_Lens.coalesced = SLR_Lens.overruns = 0;
+	lens_queue(LENS_CMD_IDENTIFY);
+	lens_queue(LENS_CMD_RANGE);
+}
+
+/* Drives the lens to an APEX Av, the nearest 1/8 stop it has - returns 0
+ * if that is past its range. Only the last of several calls made while
+ * the lens is busy is carried out.
+ */
+uint8_t lens_aperture(int16_t av){
+	int8_t code = apex_av_code(av);
+	if(SLR_Lens.valid && ((code < (int8_t)SLR_Lens.wide) || (code > (int8_t)SLR_Lens.closed))) return 0;
+	SLR_Lens.av_target = code;
+	SLR_BARRIER();
+	if(SLR_Lens.av_queued){ SLR_Lens.coalesced++; return 1; }
+	SLR_Lens.av_queued = 1;
+	if(!lens_queue(LENS_CMD_APERTURE)){ SLR_Lens.av_queued = 0; return 0; }
+	return 1;
+}
+
+/* Opens the lens fully, for the viewfinder. */
+uint8_t lens_open(void){
+	return lens_aperture(apex_code_av((int8_t)SLR_Lens.wide));
+}
+
+/* 1 while a command is queued or in flight */
+uint8_t lens_busy(void){
+	return SLR_Lens.busy || (SLR_Lens.tail != SLR_Lens.head);
+}
+
+/* DMA complete interrupt of the lens SPI, once the lens released the bus */
+void lens_xfer_isr(void){
+	uint8_t m;
+	switch(SLR_Lens.cur.cmd){
+	case LENS_CMD_IDENTIFY:
+		SLR_Lens.focal = ((uint16_t)SLR_Lens.rx[1] << 8) | SLR_Lens.rx[2];
+		break;
+	case LENS_CMD_RANGE:
+		SLR_Lens.wide   = SLR_Lens.rx[1];
+		SLR_Lens.closed = SLR_Lens.rx[2];
+		SLR_Lens.pos    = (int8_t)SLR_Lens.wide; /* an EF lens rests wide open */
+		for(m = 0; m < EOS_MODELS; m++){
+			const int8_t *ap = EOS_apertures[m];
+			if((EOS_focal[m] == SLR_Lens.focal) && (ap[eos_wide_av(ap)] == SLR_Lens.wide) && (ap[ap[0]] == SLR_Lens.closed)) break;
+		}
+		if(m < EOS_MODELS){
+			SLR_Lens.model = (eos_t)m;
+			SLR_Lens.identified = 1;
+		}
+		SLR_Lens.valid = (m < EOS_MODELS);
+		break;
+	default:
+		SLR_Lens.pos += (int8_t)SLR_Lens.tx[1];
+		break;
+	}
+	SLR_Lens.latency_us[SLR_Lens.cur.cmd] = hal_micros() - SLR_Lens.cur.queued_us;
+	lens_start();
+}
+
+/* Main loop side: a lens just identified sets the lens type and model of
+ * the exposure state (only the main loop writes it, see slr_publish()).
+ */
+void lens_poll(void){
+	if(!SLR_Lens.identified) return;
+	SLR_Lens.identified = 0;
+	SLR_LensType = EOS;
+	SLR_EOSModel = SLR_Lens.model;
+	slr_publish();
+}
+
+/* Selects the lens model by hand: dir 1 for the next model, 0 for the
+ * previous one. An identified lens sets it by itself; one that can't be
+ * identified gets its apertures from the model, but is never driven.
+ */
+void setEOSlens(uint8_t dir){
+	if(dir) SLR_EOSModel = (eos_t)((SLR_EOSModel + 1) % EOS_MODELS);
+	else    SLR_EOSModel = (eos_t)((SLR_EOSModel + EOS_MODELS - 1) % EOS_MODELS);
+}
+
+/* sets the Av of the lens according to the selected lens, in clicks of
+ * the dial (SLR_Dial): steps > 0 close, < 0 open, within the apertures of
+ * the lens; an off-click Av takes the first one to the click next to it.
+ * An EOS lens is driven there in background, one move for all the steps.
+ */
+void setAV(int8_t steps){
+	apex_lens_t l;
+	int16_t av = SLR_Av;
+	if(!steps) return;
+	apex_lens(&SLR_Exp, &l);
+	if(steps > 0) av = (av / SLR_Dial + steps) * SLR_Dial;
+	else          av = ((av + SLR_Dial - 1) / SLR_Dial + steps) * SLR_Dial;
+	if(av > l.av_max) av = l.av_max;
+	if(av < l.av_min) av = l.av_min;
+	if(SLR_LensType == EOS) lens_aperture(av);
+	SLR_Av = av;
+}
+
+/* dir 1 closes a click, 0 opens one */
+void setAVindex(uint8_t dir){
+	setAV(dir ? 1 : -1);
+}
+
+/* The dials click in third stops (dir 1) or in half stops (0); the Av and
+ * the Tv set go to the nearest click of the new step.
+ */
+void setDialStep(uint8_t dir){
+	apex_lens_t l;
+	int16_t av, fast = APEX_TV(Tv_max_speed);
+	SLR_Dial = dir ? APEX_THIRD : APEX_HALF;
+	apex_lens(&SLR_Exp, &l);
+	av = apex_steps(SLR_Av, SLR_Dial) * SLR_Dial;
+	if(av > l.av_max) av = l.av_max;
+	if(av < l.av_min) av = l.av_min;
+	if((SLR_LensType == EOS) && (av != SLR_Av)) lens_aperture(av);
+	SLR_Av = av;
+	if(SLR_Tv != APEX_BULB){
+		SLR_Tv = apex_steps(SLR_Tv, SLR_Dial) * SLR_Dial;
+		if(SLR_Tv > fast) SLR_Tv = fast;
+	}
+}
+
+#endif /* SLR_LENS_H */
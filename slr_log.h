@@ -0,0 +1,258 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    F R A M E   L O G
+ *    -----------------
+ *    Every frame shot, in the data EEPROM of the STM32L1: ISO, Av, Tv, EV,
+ *    mode and lens, packed in one 32 bit word (Av and Tv to the third of a
+ *    stop of the dials, the EV in 1/8 stops).
+ *
+ *    The L1 data EEPROM has no page erase: a word write erases and
+ *    programs that word alone, in about 3.3 ms, and every word stands
+ *    some 300k of them. The log is a ring over LOG_WORDS words, written in
+ *    order and never in place, so each word is written once a lap - the
+ *    wear is spread over the whole area, with nothing like a counter word
+ *    rewritten on every frame. The two top bits of a record are its lap,
+ *    1, 2, 3, 1... (an erased word reads 0): the words before the head are
+ *    of this lap, the ones from it on of the previous one, so log_init()
+ *    finds the head again with a binary search.
+ *
+ *    At the release the record is packed at the lock and only queued at
+ *    the fire (log_frame(), a store in a RAM ring); the main loop writes
+ *    it with the release idle, while the film is advanced - a frame never
+ *    waits for the EEPROM. log_export() streams the log over the UART,
+ *    see host/log_csv.c for the decoder.
+ *
+ *    The records of the firmware before the thirds ("SLRL": Tv_speed[] and
+ *    Av_values[] indices) stay in the EEPROM as they are, with no rewrite
+ *    pass a power cut could break: a record tells its layout by itself,
+ *    the spare bits 25..29 of the old one are never all 0 in the new one,
+ *    and log_read() gives it back upgraded (log_upgrade()). They go as the
+ *    log wraps over them.
+ */
+#ifndef SLR_LOG_H
+#define SLR_LOG_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_apex.h"
+
+#define LOG_KEEP  16    /* words kept at the top of the EEPROM, for
+                           the shutter calibration (slr_shutter.h) */
+#ifndef LOG_BASE
+#define LOG_BASE  0     /* first word of it, hal_eeprom_*() words   */
+#endif
+#ifndef LOG_WORDS
+#define LOG_WORDS (HAL_EEPROM_WORDS - LOG_BASE - LOG_KEEP)  /* the rest */
+#endif
+#if LOG_BASE + LOG_WORDS > HAL_EEPROM_WORDS
+#error "the frame log is past the end of the data EEPROM (HAL_EEPROM_WORDS)"
+#endif
+#define LOG_QUEUE 8     /* frames waiting for the EEPROM, power of two */
+
+/* record: bit 0 iso, 3 av in thirds (0 = f/1), 9 tv in thirds + 64 (0 =
+ * bulb), 16 ev8 + 128, 24 LOG_ML_BASE + mode * 6 + lens (0 manual, 1 +
+ * eos_t), 30 lap - LOG_AV() and LOG_TV() give them back in APEX 1/24
+ * stops */
+#define LOG_ML_BASE  28   /* 28..63: bits 25..29 never all 0 */
+#define LOG_ISO(r)   ((r) & 0x07)
+#define LOG_AV(r)    ((int16_t)(((r) >> 3) & 0x3F) * APEX_THIRD)
+#define LOG_TV(r)    ((((r) >> 9) & 0x7F) ? ((int16_t)(((r) >> 9) & 0x7F) - 64) * APEX_THIRD : APEX_BULB)
+#define LOG_EV8(r)   ((int16_t)(((r) >> 16) & 0xFF) - 128)
+#define LOG_MODE(r)  (((((r) >> 24) & 0x3F) - LOG_ML_BASE) / 6)
+#define LOG_LENS(r)  (((((r) >> 24) & 0x3F) - LOG_ML_BASE) % 6)
+#define LOG_LAP(r)   ((r) >> 30)
+/* a record of the old layout: bit 0 iso, 3 av index, 7 tv index (15 bulb
+ * or longer than 1 s), 11 ev8 + 128, 19 mode, 22 lens, 25..29 spare, 30
+ * lap */
+#define LOG_OLD(r)   (((r) & (0x1Fu << 25)) == 0)
+#define LOG_NEXT_LAP(l) (((l) == 3) ? 1 : (l) + 1)
+
+/* the export stream: "SLR2", the count of records (16 bits), the records
+ * oldest first, in the new layout, then a Fletcher-16 of the records - all
+ * little endian. host/log_csv.c reads the "SLRL" exports of the old
+ * firmware too. */
+#define LOG_MAGIC "SLR2"
+
+typedef struct {
+	uint32_t queue[LOG_QUEUE];
+	uint8_t  head, tail;          /* of the queue, main loop only         */
+	volatile uint8_t busy;        /* a word being written                 */
+	uint16_t next;                /* word the next record goes to         */
+	uint8_t  lap;                 /* lap of the records written now       */
+	uint8_t  full;                /* the log has wrapped at least once    */
+	uint32_t written;             /* records written since log_init()     */
+	uint32_t dropped;             /* frames lost to a full queue          */
+	uint8_t  tx[6 * 4];           /* the export chunk the UART DMA sends  */
+} log_t;
+
+log_t SLR_Log;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* At power up: finds the head of the log. */
+void log_init(void){
+	uint16_t lo = 0, hi = LOG_WORDS;
+	uint8_t lap = LOG_LAP(hal_eeprom_read(LOG_BASE));
+	SLR_Log.head = SLR_Log.tail = 0;
+	SLR_Log.busy = 0;
+	SLR_Log.written = SLR_Log.dropped = 0;
+	if(!lap){
+		/* nothing written yet */
+		SLR_Log.next = 0;
+		SLR_Log.lap  = 1;
+		SLR_Log.full = 0;
+		return;
+	}
+	/* the first word whose lap isn't the one of word 0 */
+	while(lo < hi){
+		uint16_t mid = lo + (hi - lo) / 2;
+		if(LOG_LAP(hal_eeprom_read(LOG_BASE + mid)) == lap) lo = mid + 1;
+		else hi = mid;
+	}
+	SLR_Log.full = (lo == LOG_WORDS) || (hal_eeprom_read(LOG_BASE + lo) != 0);
+	if(lo == LOG_WORDS){
+		lo = 0;
+		lap = LOG_NEXT_LAP(lap);
+	}
+	SLR_Log.next = lo;
+	SLR_Log.lap  = lap;
+}
+
+/* The record of an exposure of x at av and tv (APEX), without its lap.
+ * The log keeps thirds: a half stop set on the dials goes to the nearest
+ * third, a sixth of a stop off at most.
+ */
+uint32_t log_pack(const exposure_t *x, int16_t av, int16_t tv){
+	int16_t ev8 = x->ev8, a = apex_thirds(av), t = 0;
+	if(ev8 < -128) ev8 = -128;
+	if(ev8 > 127) ev8 = 127;
+	if(a < 0) a = 0;
+	if(a > 63) a = 63;
+	if(tv != APEX_BULB){
+		t = apex_thirds(tv) + 64;
+		if(t < 1) t = 1;
+		if(t > 127) t = 127;
+	}
+	return (uint32_t)(x->iso & 0x07) | ((uint32_t)a << 3) | ((uint32_t)t << 9)
+	     | ((uint32_t)(ev8 + 128) << 16)
+	     | ((uint32_t)(LOG_ML_BASE + (x->mode % 6) * 6 + ((x->lens == EOS) ? x->eos + 1 : 0)) << 24);
+}
+
+/* A record in the new layout, from either, with its lap. An old Tv 15 is
+ * bulb: a metered time past 1 s wasn't kept.
+ */
+uint32_t log_upgrade(uint32_t r){
+	uint8_t av, tv;
+	if(!LOG_OLD(r)) return r;
+	av = (r >> 3) & 0x0F;
+	tv = (r >> 7) & 0x0F;
+	return (r & 0x07) | ((uint32_t)(av ? (av - 1) * 3 : 0) << 3)
+	     | ((uint32_t)((tv && (tv < 15)) ? (14 - tv) * 3 + 64 : 0) << 9)
+	     | (((r >> 11) & 0xFF) << 16)
+	     | ((uint32_t)(LOG_ML_BASE + (((r >> 19) & 0x07) % 6) * 6 + ((r >> 22) & 0x07) % 6) << 24)
+	     | (r & (3u << 30));
+}
+
+/* Queues a record from log_pack(), at the fire - 0 if the queue is full. */
+uint8_t log_frame(uint32_t r){
+	uint8_t head = SLR_Log.head;
+	TRACE_BEGIN(TR_LOG);
+	if((uint8_t)(head - SLR_Log.tail) == LOG_QUEUE){ SLR_Log.dropped++; TRACE_END(TR_LOG); return 0; }
+	SLR_Log.queue[head & (LOG_QUEUE - 1)] = r;
+	SLR_Log.head = head + 1;
+	TRACE_END(TR_LOG);
+	return 1;
+}
+
+/* the end of programming interrupt of the EEPROM */
+void log_eeprom_isr(void){
+	SLR_Log.busy = 0;
+}
+
+uint8_t log_busy(void){
+	return SLR_Log.busy;
+}
+
+/* Writes a word of the data EEPROM outside the log, for another module
+ * (the shutter calibration, slr_calib.h) - 0 if the EEPROM is busy, to try
+ * again later. The end of it is the interrupt of the log all the same.
+ */
+uint8_t log_eeprom_write(uint16_t word, uint32_t data){
+	if(SLR_Log.busy) return 0;
+	SLR_Log.busy = 1;
+	hal_eeprom_write(word, data);
+	return 1;
+}
+
+/* 1 if a record waits for the EEPROM */
+uint8_t log_pending(void){
+	return SLR_Log.head != SLR_Log.tail;
+}
+
+/* Main loop side: starts the write of the next record queued, if the
+ * EEPROM is free - idle is 0 while a release is in progress, which leaves
+ * the records in the queue.
+ */
+void log_poll(uint8_t idle){
+	uint32_t r;
+	if(!idle || SLR_Log.busy || !log_pending()) return;
+	r = SLR_Log.queue[SLR_Log.tail & (LOG_QUEUE - 1)] | ((uint32_t)SLR_Log.lap << 30);
+	log_eeprom_write(LOG_BASE + SLR_Log.next, r);
+	SLR_Log.tail++;
+	SLR_Log.written++;
+	if(++SLR_Log.next == LOG_WORDS){
+		SLR_Log.next = 0;
+		SLR_Log.lap = LOG_NEXT_LAP(SLR_Log.lap);
+		SLR_Log.full = 1;
+	}
+}
+
+/* records in the EEPROM */
+uint16_t log_count(void){
+	return SLR_Log.full ? LOG_WORDS : SLR_Log.next;
+}
+
+/* the n-th record in the EEPROM, oldest first, in the new layout */
+uint32_t log_read(uint16_t n){
+	uint16_t w = SLR_Log.full ? SLR_Log.next + n : n;
+	if(w >= LOG_WORDS) w -= LOG_WORDS;
+	return log_upgrade(hal_eeprom_read(LOG_BASE + w));
+}
+
+/* Streams the records in the EEPROM over the UART (see LOG_MAGIC), a few
+ * at a time through SLR_Log.tx, each chunk once the one before has gone -
+ * and returns with the last one gone. The records still queued are not in
+ * it.
+ */
+void log_export(void){
+	uint8_t *buf = SLR_Log.tx, *p;
+	uint16_t n = log_count(), i = 0;
+	uint8_t s1 = 0, s2 = 0, k;
+
+	while(hal_uart_busy());
+	p = buf;
+	for(k = 0; k < 4; k++) *p++ = LOG_MAGIC[k];
+	*p++ = n & 0xFF; *p++ = n >> 8;
+	hal_uart_write(buf, p - buf);
+	while(i < n){
+		while(hal_uart_busy());
+		p = buf;
+		while((i < n) && (p < buf + sizeof(SLR_Log.tx))){
+			uint32_t r = log_read(i++);
+			for(k = 0; k < 4; k++){
+				*p = (uint8_t)(r >> (8 * k));
+				s1 = (s1 + *p) % 255;
+				s2 = (s2 + s1) % 255;
+				p++;
+			}
+		}
+		hal_uart_write(buf, p - buf);
+	}
+	while(hal_uart_busy());
+	buf[0] = s1; buf[1] = s2;
+	hal_uart_write(buf, 2);
+	while(hal_uart_busy());
+}
+
+#endif /* SLR_LOG_H */
@@ -0,0 +1,199 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    L O N G   E X P O S U R E S
+ *    ---------------------------
+ *    Past 1 s the shutter timer is not the clock: the RTC is, on its 32768
+ *    Hz crystal, running in Stop mode. Both curtains are let go from RTC
+ *    alarm interrupts - the first at a tick, the second at a tick counted
+ *    from that one - so the exposure is a whole number of crystal ticks,
+ *    with the same wake-up latency at both ends, and the MCU sleeps in Stop
+ *    mode in between. Nothing is added up along the way: the end tick is
+ *    worked out once, from the start, and the alarms in between (one every
+ *    LONG_STEP, the RTC alarm compares the time of day only) aim at it.
+ *
+ *    The crystal is some ppm off, and it goes off more in the cold: the
+ *    error measured against a reference, Long_rtc_ppm10, is taken off the
+ *    count. 20 ppm is 1.2 ms a minute; the HSI of a delay loop, 1% or
+ *    more, would be 600 ms.
+ *
+ *    Three uses:
+ *      - the metered exposures past 1 s, Tv 15 in the MT and AV modes: the
+ *        time of the meter reading (long_tv_ms()), through the reciprocity
+ *        failure of the film loaded (long_reciprocity());
+ *      - bulb, Tv 15 in the manual modes: open while the release is held,
+ *        the time it was open counted on the RTC (long_elapsed_ms());
+ *      - the bulb timer: with a preset, bulb is a timed exposure of it.
+ */
+#ifndef SLR_LONG_H
+#define SLR_LONG_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_apex.h"
+
+#define LONG_HZ      32768u               /* RTC ticks a second              */
+#define LONG_LEAD    4                    /* ticks from long_start() to the first curtain */
+#define LONG_STEP    (600u * LONG_HZ)     /* the farthest alarm, 10 minutes  */
+#define LONG_MAX_MS  (24u * 3600000u)     /* longest timed exposure, 24 h    */
+
+/** The error of the LSE crystal of this camera, in 1/10 ppm, > 0 if it runs
+ *  fast - measured once against a reference (a GPS second, a counter).
+ */
+#ifndef SLR_RTC_PPM10
+#define SLR_RTC_PPM10 0
+#endif
+const int16_t Long_rtc_ppm10 = SLR_RTC_PPM10;
+
+/** Reciprocity failure: past t0 the film needs its time in stops p times
+ *  over, Schwarzschild's law (t = tm^p from 1 s). Fits of the makers' data
+ *  sheets, good to some 1/3 stop - a bracket is still worth it.
+ */
+typedef enum { FILM_NONE = 0, FILM_TRIX400, FILM_HP5, FILM_FP4, FILM_DELTA100,
+               FILM_ACROS, FILM_PORTRA400, FILM_VELVIA50, FILMS} film_t;
+/* t0, 1/24 stops over 1 s */
+const int16_t  Film_t0[FILMS] = {INT16_MAX, 0, 0, 0, 0, 166, 0, 0};
+/* p, in 1/256 */
+const uint16_t Film_p[FILMS]  = {256, 394, 335, 323, 323, 297, 340, 300};
+
+typedef enum { LONG_IDLE = 0, LONG_ARMED, LONG_OPEN, LONG_DONE} long_state_t;
+
+typedef struct {
+	volatile long_state_t state;
+	uint8_t  bulb;                /* open until long_close()               */
+	uint8_t  film;                /* film_t loaded                         */
+	int16_t  ppm10;               /* of the crystal, see Long_rtc_ppm10    */
+	uint32_t preset_ms;           /* of the bulb timer, 0 = held           */
+	uint32_t open_tick, end_tick; /* RTC ticks of the curtains             */
+	uint32_t close_tick;
+	uint32_t alarm_tick;          /* alarm set                             */
+	volatile uint32_t open_us, close_us; /* hal_micros() at them           */
+	uint32_t wakes;               /* alarms of this exposure               */
+} long_t;
+
+long_t SLR_Long;
+
+/* -- Functions ---------------------------------------------------------- */
+
+void long_init(void){
+	SLR_Long.state = LONG_IDLE;
+	SLR_Long.ppm10 = Long_rtc_ppm10;
+}
+
+/* RTC ticks of ms milliseconds, on this crystal */
+uint32_t long_ticks(uint32_t ms){
+	int64_t t = (int64_t)ms * LONG_HZ;    /* 1/1000 ticks */
+	t += t * SLR_Long.ppm10 / 10000000;
+	t = (t + 500) / 1000;
+	return (t < 1) ? 1 : (uint32_t)t;
+}
+
+/* ... and back */
+uint32_t long_ms(uint32_t ticks){
+	int64_t t = (int64_t)ticks * 1000;
+	t -= t * SLR_Long.ppm10 / 10000000;
+	return (uint32_t)((t + LONG_HZ / 2) / LONG_HZ);
+}
+
+/* The time of an APEX Tv (1/24 stops, see slr_apex.h) of 1 s or more, in
+ * ms - 1 s for a faster one, LONG_MAX_MS at most.
+ */
+uint32_t long_tv_ms(int16_t tv){
+	uint16_t s, q, r;
+	uint64_t us;
+	if(tv > 0) tv = 0;
+	s = -tv;
+	q = s / APEX_UNIT;
+	r = s % APEX_UNIT;
+	if(q > 16) return LONG_MAX_MS;
+	/* 2^(q + r/24) = 2^(q+1) 2^(-(24-r)/24) */
+	us = r ? (uint64_t)APEX_T24[APEX_UNIT - r] << (q + 1) : (uint64_t)1000000 << q;
+	us = (us + 500) / 1000;
+	return (us > LONG_MAX_MS) ? LONG_MAX_MS : (uint32_t)us;
+}
+
+/* The Tv a metered Tv needs on the film, both APEX - the same below 1 s */
+int16_t long_reciprocity(int16_t tv, uint8_t film){
+	int32_t s = -tv, t0;
+	if(film >= FILMS) return tv;
+	t0 = Film_t0[film];
+	if(s <= t0) return tv;
+	s = t0 + (((s - t0) * Film_p[film] + 128) >> 8);
+	return (s > 17 * APEX_UNIT) ? -17 * APEX_UNIT : (int16_t)-s;
+}
+
+/* 1 while an exposure is armed or open */
+uint8_t long_busy(void){
+	return (SLR_Long.state == LONG_ARMED) || (SLR_Long.state == LONG_OPEN);
+}
+
+/* Starts an exposure of ms milliseconds, 0 for bulb: the first curtain
+ * goes LONG_LEAD ticks later - 0 if one is still running.
+ */
+uint8_t long_start(uint32_t ms){
+	if(long_busy()) return 0;
+	if(ms > LONG_MAX_MS) ms = LONG_MAX_MS;
+	SLR_Long.bulb = !ms;
+	SLR_Long.open_tick  = hal_rtc_ticks() + LONG_LEAD;
+	SLR_Long.end_tick   = SLR_Long.open_tick + long_ticks(ms);
+	SLR_Long.alarm_tick = SLR_Long.open_tick;
+	SLR_Long.wakes = 0;
+	SLR_Long.state = LONG_ARMED;
+	hal_rtc_alarm(SLR_Long.open_tick);
+	return 1;
+}
+
+/* RTC alarm interrupt: a curtain, or the next alarm on the way to it */
+void long_rtc_isr(void){
+	uint32_t left;
+	SLR_Long.wakes++;
+	switch(SLR_Long.state){
+	case LONG_ARMED:
+		hal_curtain_release(0);
+		SLR_Long.open_us = hal_micros();
+		SLR_Long.state = LONG_OPEN;
+		if(SLR_Long.bulb) return;
+		break;
+	case LONG_OPEN:
+		if(SLR_Long.alarm_tick != SLR_Long.end_tick) break;
+		hal_curtain_release(1);
+		SLR_Long.close_us = hal_micros();
+		SLR_Long.close_tick = SLR_Long.end_tick;
+		SLR_Long.state = LONG_DONE;
+		return;
+	default:
+		return;
+	}
+	left = SLR_Long.end_tick - SLR_Long.alarm_tick;
+	SLR_Long.alarm_tick += (left > LONG_STEP) ? LONG_STEP : left;
+	hal_rtc_alarm(SLR_Long.alarm_tick);
+}
+
+/* The release let go in bulb, or a timed exposure cut short: the second
+ * curtain now - a tick after the first, if that one hasn't gone yet.
+ */
+void long_close(void){
+	hal_irq_disable();
+	if(SLR_Long.state == LONG_ARMED){
+		SLR_Long.bulb = 0;
+		SLR_Long.end_tick = SLR_Long.open_tick + 1;
+	}else if(SLR_Long.state == LONG_OPEN){
+		hal_rtc_alarm_off();
+		hal_curtain_release(1);
+		SLR_Long.close_us = hal_micros();
+		SLR_Long.close_tick = hal_rtc_ticks();
+		SLR_Long.state = LONG_DONE;
+	}
+	hal_irq_enable();
+}
+
+/* ms open so far, or of the last exposure - the bulb timer */
+uint32_t long_elapsed_ms(void){
+	switch(SLR_Long.state){
+	case LONG_OPEN: return long_ms(hal_rtc_ticks() - SLR_Long.open_tick);
+	case LONG_DONE: return long_ms(SLR_Long.close_tick - SLR_Long.open_tick);
+	default:        return 0;
+	}
+}
+
+#endif /* SLR_LONG_H */
@@ -0,0 +1,183 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    L I G H T   M E T E R
+ *    ---------------------
+ *    Streaming metering pipeline on the TSL2591. The sensor integrates
+ *    continuously; at the end of every integration its interrupt starts a
+ *    DMA read, and the DMA interrupt drops the counts in a small ring
+ *    buffer. meter_poll(), from the main loop, turns them into EV, smooths
+ *    them and publishes the settled value. read_exposure() then only copies
+ *    the last settled value - a half-press doesn't wait for the sensor.
+ *    In adaptive mode the DMA interrupt also picks the gain and integration
+ *    time of the next sample (tsl2591_adapt()), right as the counts arrive.
+ */
+#ifndef SLR_METER_H
+#define SLR_METER_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "tsl2591.h"
+
+#define METER_RING   8  /* samples between two meter_poll(), power of two */
+#define METER_SNAP   8  /* a jump over 1 stop restarts the smoothing      */
+#define METER_NOISE  1  /* within 1/8 stop of the smoothed value = noise  */
+#define METER_HYST   2  /* SLR_EV moves when 1/4 stop past the next stop  */
+
+typedef struct {
+	uint16_t ch0, ch1;      /* full spectrum and infrared counts   */
+	uint8_t  gain, it;      /* sensor setting they were taken with */
+} meter_sample_t;
+
+typedef struct {
+	/* ring buffer, filled by meter_sample_isr(), emptied by meter_poll() */
+	meter_sample_t   ring[METER_RING];
+	volatile uint8_t head;
+	volatile uint8_t tail;
+	uint8_t  gain, it;      /* current sensor setting                       */
+	uint8_t  rd_gain, rd_it;/* setting of the integration being read by DMA */
+	uint8_t  adaptive;      /* gain and integration time follow the light   */
+	uint8_t  on;            /* the sensor is powered and integrating        */
+	volatile uint8_t reading; /* a DMA read is in flight                    */
+	uint16_t switches;      /* setting changes made by the controller       */
+	uint16_t dropped;       /* samples lost to a full ring                  */
+	uint16_t overflows;     /* saturated samples                            */
+	/* smoothing, main loop only */
+	int16_t  ev_q;          /* smoothed EV in 1/128 stops                   */
+	/* last settled reading, what read_exposure() hands out */
+	uint8_t  valid;
+	uint32_t lux;           /* 1/256 lux                                    */
+	int16_t  ev8;           /* 1/8 stops, the full range of the sensor      */
+	uint8_t  ev;            /* whole stops 0..15, with hysteresis           */
+} meter_t;
+
+meter_t SLR_Meter;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* Starts the continuous metering with the given sensor setting - the
+ * first one only, if adaptive.
+ */
+void meter_init(uint8_t gain, uint8_t it, uint8_t adaptive){
+	SLR_Meter.head = SLR_Meter.tail = 0;
+	SLR_Meter.dropped = SLR_Meter.overflows = SLR_Meter.switches = 0;
+	SLR_Meter.adaptive = adaptive;
+	SLR_Meter.ev_q = INT16_MIN;  /* the first sample is a new scene */
+	SLR_Meter.valid = 0;
+	SLR_Meter.gain = gain;
+	SLR_Meter.it = it;
+	SLR_Meter.on = 1;
+	hal_tsl2591_config(gain, it);
+}
+
+/* Powers the sensor down; meter_init() starts it again, with the setting
+ * it had here. Not while a read is in flight (SLR_Meter.reading).
+ */
+void meter_stop(void){
+	hal_tsl2591_off();
+	SLR_Meter.on = 0;
+	SLR_Meter.valid = 0;
+}
+
+/* EXTI interrupt of the sensor INT pin - an integration is complete */
+void meter_ready_isr(void){
+	if(!SLR_Meter.on) return;  /* pending from before meter_stop() */
+	SLR_Meter.rd_gain = SLR_Meter.gain;
+	SLR_Meter.rd_it = SLR_Meter.it;
+	SLR_Meter.reading = 1;
+	hal_tsl2591_read();
+}
+
+/* DMA complete interrupt of the channel read */
+void meter_sample_isr(uint16_t ch0, uint16_t ch1){
+	uint8_t head = SLR_Meter.head;
+	uint8_t gain = SLR_Meter.rd_gain, it = SLR_Meter.rd_it;
+	meter_sample_t *s;
+	SLR_Meter.reading = 0;
+	/* stopped meanwhile: the config below would power the sensor up again */
+	if(!SLR_Meter.on) return;
+	/* the next integration has just started, fix its setting now */
+	if(SLR_Meter.adaptive && tsl2591_adapt(ch0, ch1, &gain, &it)){
+		SLR_Meter.gain = gain;
+		SLR_Meter.it = it;
+		SLR_Meter.switches++;
+		hal_tsl2591_config(gain, it);
+	}
+	if((uint8_t)(head - SLR_Meter.tail) >= METER_RING){ SLR_Meter.dropped++; return; }
+	s = &SLR_Meter.ring[head & (METER_RING - 1)];
+	s->ch0 = ch0;
+	s->ch1 = ch1;
+	s->gain = SLR_Meter.rd_gain;
+	s->it = SLR_Meter.rd_it;
+	SLR_BARRIER();
+	SLR_Meter.head = head + 1;
+}
+
+/* One sample into the smoothing. Differences within 1/8 stop are noise and
+ * get averaged; bigger ones are the light really changing and are followed
+ * at once; a jump over one stop is a new scene, published only once the
+ * next sample confirms it. The first sample after meter_init() has nothing
+ * to be confirmed against, and is published at once.
+ */
+void meter_update(uint32_t lux, int16_t ev8){
+	int32_t d = ev8 * 16 - SLR_Meter.ev_q;
+
+	if(SLR_Meter.valid && ((d > METER_SNAP * 16) || (d < -METER_SNAP * 16))){
+		SLR_Meter.ev_q = ev8 * 16;
+		return;
+	}
+	if((d > METER_NOISE * 16) || (d < -METER_NOISE * 16))
+		SLR_Meter.ev_q = ev8 * 16;
+	else
+		SLR_Meter.ev_q += (int16_t)(d / 4);
+
+	SLR_Meter.lux = lux;
+	SLR_Meter.ev8 = (SLR_Meter.ev_q + 8) >> 4;
+	if(!SLR_Meter.valid
+	|| (SLR_Meter.ev8 >= (SLR_Meter.ev + 1) * 8 + METER_HYST)
+	|| (SLR_Meter.ev8 < SLR_Meter.ev * 8 - METER_HYST)){
+		int16_t ev = SLR_Meter.ev8 >> 3;
+		if(ev < 0) ev = 0;
+		if(ev > 15) ev = 15;
+		SLR_Meter.ev = (uint8_t)ev;
+	}
+	SLR_Meter.valid = 1;
+}
+
+/* Main loop side of the pipeline: drains the ring buffer */
+void meter_poll(void){
+	while(SLR_Meter.tail != SLR_Meter.head){
+		meter_sample_t *s = &SLR_Meter.ring[SLR_Meter.tail & (METER_RING - 1)];
+		uint64_t lux;
+		TRACE_BEGIN(TR_METER_SAMPLE);
+		lux = tsl2591_calculateLux40(s->ch0, s->ch1, s->gain, s->it);
+		SLR_BARRIER();
+		SLR_Meter.tail++;
+		if(lux == TSL2591_LUX40_OVERFLOW) SLR_Meter.overflows++;
+		else meter_update((uint32_t)(lux >> 32), getEV8wide(lux));
+		TRACE_END(TR_METER_SAMPLE);
+	}
+}
+
+/* It reads the exposure at a press of a button - returns 1 for success
+ * and lights the green led when the exposure is read correctly, 0 while the
+ * meter has not settled yet. Takes the last settled reading of the metering
+ * pipeline, so it costs the same at any time and never waits for the sensor.
+ */
+uint8_t read_exposure(void){
+	TRACE_BEGIN(TR_READ_EXPOSURE);
+	if(!SLR_Meter.valid){
+		hal_led_green(0);
+		TRACE_END(TR_READ_EXPOSURE);
+		return 0;
+	}
+	SLR_LUX = SLR_Meter.lux;
+	SLR_EV8 = SLR_Meter.ev8;
+	SLR_EV  = SLR_Meter.ev;
+	slr_publish();
+	hal_led_green(1);
+	TRACE_END(TR_READ_EXPOSURE);
+	return 1;
+}
+
+#endif /* SLR_METER_H */
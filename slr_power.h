@@ -0,0 +1,158 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    M A I N   L O O P   A N D   P O W E R
+ *    -------------------------------------
+ *    No tick: every pass of the main loop does the work the interrupts
+ *    left - dials, meter samples, lens, release, log, display - and sleeps
+ *    until the next interrupt. With the meter off and nothing in flight it
+ *    sleeps in Stop mode, a few uA, woken only by the half-press, a dial or
+ *    a button; otherwise in Sleep mode, with the timers, the DMA and the
+ *    EEPROM running.
+ *
+ *    The half-press wakes the meter: the loop powers the TSL2591 up right
+ *    after the wake, and the first sample of it is the first valid EV -
+ *    one integration time later. The meter stays on POWER_METER_US after
+ *    the half-press is let go or the last dial turn, then it is powered
+ *    down again.
+ *    SLR_Power keeps the wake to first valid EV latency (TR_WAKE when
+ *    traced).
+ *
+ *    A long exposure (slr_long.h) is timed by the RTC, which runs in Stop
+ *    mode: the meter is powered down at the first curtain - the mirror is
+ *    up - and the MCU sleeps in Stop mode to the second one.
+ */
+#ifndef SLR_POWER_H
+#define SLR_POWER_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_meter.h"
+#include "slr_lens.h"
+#include "slr_release.h"
+#include "slr_input.h"
+#include "slr_display.h"
+#include "slr_log.h"
+#include "slr_calib.h"
+
+#define POWER_METER_US 8000000u  /* meter on after the last activity */
+
+typedef struct {
+	/* set by the half-press interrupt */
+	volatile uint8_t  pressed;    /* half-press held                          */
+	volatile uint8_t  press;      /* a new half-press, for the main loop      */
+	volatile uint32_t press_us;   /* when                                     */
+	/* main loop only */
+	uint32_t active_us;           /* last half-press held or dial turn        */
+	uint8_t  waiting;             /* a half-press without its EV yet          */
+	uint8_t  cold;                /* ... that had to power the meter up       */
+	uint32_t wake_us;             /* press_us of it                           */
+	/* statistics */
+	uint32_t latency_us;          /* last half-press to valid EV, cold start  */
+	uint32_t latency_max_us;
+	uint32_t latency_sum_us;
+	uint16_t colds;               /* cold starts measured                     */
+	uint32_t wakes[2];            /* sleeps, [0] Sleep mode, [1] Stop mode    */
+} power_t;
+
+power_t SLR_Power;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* after meter_init(): the meter starts off, with the setting given there */
+void power_init(void){
+	if(SLR_Meter.on) meter_stop();
+	SLR_Power.pressed = SLR_Power.press = 0;
+	SLR_Power.waiting = 0;
+	SLR_Power.active_us = hal_micros();
+}
+
+/* EXTI interrupt of the half-press, both edges - only sets flags, it runs
+ * on the wake-up clock
+ */
+void power_halfpress_isr(uint8_t level){
+	uint8_t pressed = !level;
+	if(pressed && !SLR_Power.pressed){
+		SLR_Power.press_us = hal_micros();
+		SLR_BARRIER();
+		SLR_Power.press = 1;
+		TRACE_BEGIN(TR_WAKE);
+	}
+	SLR_Power.pressed = pressed;
+}
+
+/* 1 while something runs that Stop mode would stop */
+uint8_t power_busy(void){
+	return SLR_Meter.on || SLR_Meter.reading || lens_busy() || display_busy()
+	    || log_busy() || cal_busy() || flicker_busy() || ((SLR_Release.state != RELEASE_IDLE) && !release_long());
+}
+
+/* 1 if an interrupt left work for the main loop - or always, during the
+ * shutter calibration, a bench job that waits on the clock */
+uint8_t power_work(void){
+	return SLR_Power.press || (SLR_Input.head != SLR_Input.tail)
+	    || (SLR_Meter.head != SLR_Meter.tail) || SLR_Lens.identified
+	    || (SLR_Display.stale && !SLR_Display.busy)
+	    || (log_pending() && !log_busy() && (SLR_Release.state == RELEASE_IDLE))
+	    || ((SLR_Release.state == RELEASE_EXPOSING) && (SLR_Long.state == LONG_DONE))
+	    || (SLR_Flicker.state == FLICKER_SAMPLED)
+	    || cal_busy();
+}
+
+/* One pass of the main loop. */
+void power_loop(void){
+	uint32_t now;
+	/* the half-press first: the sensor starts integrating at once */
+	if(SLR_Power.press){
+		SLR_Power.press = 0;
+		SLR_BARRIER();
+		SLR_Power.active_us = SLR_Power.press_us;
+		if(!SLR_Power.waiting){
+			SLR_Power.waiting = 1;
+			SLR_Power.cold = !SLR_Meter.on;
+			SLR_Power.wake_us = SLR_Power.press_us;
+		}
+		if(!SLR_Meter.on) meter_init(SLR_Meter.gain, SLR_Meter.it, SLR_Meter.adaptive);
+	}
+	if(input_poll()) SLR_Power.active_us = hal_micros();
+	meter_poll();
+	lens_poll();
+	release_poll();
+	log_poll(SLR_Release.state == RELEASE_IDLE);
+	cal_poll();
+	now = hal_micros();
+	if(SLR_Power.pressed) SLR_Power.active_us = now;
+	if(SLR_Power.waiting && read_exposure()){
+		SLR_Power.waiting = 0;
+		TRACE_END(TR_WAKE);
+		if(SLR_Power.cold){
+			uint32_t l = now - SLR_Power.wake_us;
+			SLR_Power.latency_us = l;
+			SLR_Power.latency_sum_us += l;
+			if(l > SLR_Power.latency_max_us) SLR_Power.latency_max_us = l;
+			SLR_Power.colds++;
+		}
+	}
+	display_update();
+	/* meter off after the timeout, or for a long exposure, between two
+	 * reads of the sensor - masked, or the sensor interrupt could start a
+	 * read between the look at SLR_Meter.reading and the power down */
+	if(SLR_Meter.on && !SLR_Power.waiting
+	&& (((SLR_Release.state == RELEASE_IDLE) && (now - SLR_Power.active_us >= POWER_METER_US))
+	 || release_long())){
+		hal_irq_disable();
+		if(!SLR_Meter.reading) meter_stop();
+		hal_irq_enable();
+		if(!SLR_Meter.on) hal_led_green(0);
+	}
+	/* sleep, unless an interrupt came since the polls above */
+	hal_irq_disable();
+	if(!power_work()){
+		uint8_t deep = !power_busy();
+		SLR_Power.wakes[deep]++;
+		hal_sleep(deep);
+	}
+	hal_irq_enable();
+}
+
+#endif /* SLR_POWER_H */
@@ -0,0 +1,218 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    R E L E A S E   S E Q U E N C E
+ *    -------------------------------
+ *    What happens between the release button and the first curtain: lock
+ *    the exposure, solve Av/Tv for the mode, stop the EF lens down, raise
+ *    the mirror, fire the shutter - and, after the exposure, bring the
+ *    mirror down and open the lens again. The stop-down and the mirror
+ *    don't depend on each other, so both start at the lock and the shutter
+ *    fires when the slower one is done: the shutter lag is the longest
+ *    step, not the sum of them. Every stage is timestamped, and every
+ *    frame shot is queued for the frame log (slr_log.h). The exposure is
+ *    solved in 1/24 stops (slr_apex.h) and the shutter timed to the us of
+ *    that Tv; slower than 1 s it is timed on the RTC instead of the shutter
+ *    timer (slr_long.h): the meter time in the MT and AV modes, bulb in the
+ *    manual ones. In the flicker mode the press first samples the light
+ *    for its flicker (slr_flicker.h), and a fast speed fires on a peak of
+ *    it.
+ *
+ *    The modes at the release:
+ *      IS, MA - manual, Av and Tv as set by the user;
+ *      MT     - manual lens, Av as set on its ring, Tv from the meter;
+ *      AV     - aperture priority, the EF lens driven to the Av set;
+ *      TV     - shutter priority, the EF lens driven to the Av solved;
+ *      PR     - program, Av and Tv from the program for the lens.
+ */
+#ifndef SLR_RELEASE_H
+#define SLR_RELEASE_H
+
+#include "slr.h"
+#include "slr_hal.h"
+#include "slr_meter.h"
+#include "slr_lens.h"
+#include "slr_apex.h"
+#include "slr_shutter.h"
+#include "slr_log.h"
+#include "slr_long.h"
+#include "slr_flicker.h"
+
+typedef enum { RELEASE_IDLE = 0, RELEASE_LOCKING, RELEASE_PREPARING, RELEASE_EXPOSING, RELEASE_RETURNING} release_state_t;
+
+/* timestamps of the stages, hal_micros() */
+typedef enum { REL_PRESS = 0, /* release button                          */
+               REL_LOCK,      /* exposure locked, Av/Tv solved           */
+               REL_APERTURE,  /* lens stopped down (= REL_LOCK if no EF) */
+               REL_MIRROR,    /* mirror up and damped                    */
+               REL_FIRE,      /* shutter armed                           */
+               REL_OPEN,      /* first curtain released                  */
+               REL_CLOSED,    /* second curtain released                 */
+               REL_STAGES} release_stage_t;
+
+/* why the last press didn't make an exposure */
+typedef enum { RELEASE_OK = 0, RELEASE_BUSY, RELEASE_NO_SPEED, RELEASE_NO_APERTURE} release_error_t;
+
+typedef struct {
+	volatile release_state_t state;
+	volatile uint8_t mirror_up;   /* set by release_mirror_isr()          */
+	uint8_t  drive;               /* the EF lens is stopped down          */
+	int16_t  av, tv;              /* exposure of this release, APEX       */
+	uint32_t us;                  /* Tv >= 0: its time, us                */
+	uint8_t  error;               /* release_error_t                      */
+	uint32_t frame;               /* its log record, packed at the lock   */
+	uint32_t long_ms;             /* Tv < 0: its time, ms, 0 = bulb held  */
+	uint8_t  flicker;             /* fired on a flicker peak              */
+	volatile uint8_t let_go;      /* the button let go since the press    */
+	uint16_t done;                /* bit per stage timestamped            */
+	uint32_t at[REL_STAGES];
+} release_t;
+
+release_t SLR_Release;
+
+/* -- Functions ---------------------------------------------------------- */
+
+void release_stamp(uint8_t stage){
+	SLR_Release.at[stage] = hal_micros();
+	SLR_Release.done |= 1u << stage;
+}
+
+/* The time of an exposure slower than 1 s, ms: bulb - the preset of the
+ * bulb timer, or 0, open while held - or the one of the meter, through
+ * the reciprocity of the film.
+ */
+uint32_t release_long_ms(int16_t tv){
+	if(tv == APEX_BULB) return SLR_Long.preset_ms;
+	return long_tv_ms(long_reciprocity(tv, SLR_Long.film));
+}
+
+/* Exposure lock: the last settled reading and the Av/Tv of the mode,
+ * solved from one snapshot of the exposure state.
+ */
+uint8_t release_lock(void){
+	exposure_t x;
+	apex_t s;
+	apex_fault_t f;
+	TRACE_BEGIN(TR_LOCK);
+	if(!read_exposure()){ TRACE_END(TR_LOCK); return 0; }
+	slr_snapshot(&x);
+	TRACE_BEGIN(TR_SOLVE);
+	s = solveExposure(&x);
+	/* on a flicker peak the light is more than the mean: solved again */
+	SLR_Release.flicker = SLR_Flicker.on && (s.tv >= 0) && flicker_sync(apex_tv_us(s.tv));
+	if(SLR_Release.flicker){
+		x.ev8 += flicker_peak_ev8(apex_tv_us(s.tv));
+		s = solveExposure(&x);
+		SLR_Release.flicker = flicker_sync(apex_tv_us(s.tv));
+	}
+	f = apex_fault(x.mode, &s);
+	TRACE_END(TR_SOLVE);
+	SLR_Release.av = s.av;
+	SLR_Release.tv = s.tv;
+	SLR_Release.us = (s.tv >= 0) ? apex_tv_us(s.tv) : 0;
+	SLR_Release.drive = (x.lens == EOS) && SLR_Lens.valid && (x.mode >= AV);
+	SLR_Release.frame = log_pack(&x, s.av, s.tv);
+	SLR_Release.long_ms = (s.tv < 0) ? release_long_ms(s.tv) : 0;
+	release_stamp(REL_LOCK);
+	if(f == APEX_NO_SPEED){
+		SLR_Release.error = RELEASE_NO_SPEED;
+	}else if(f == APEX_NO_APERTURE){
+		SLR_Release.error = RELEASE_NO_APERTURE;
+	}else if(SLR_Release.drive && !lens_aperture(s.av)){
+		SLR_Release.error = RELEASE_NO_APERTURE;
+	}
+	TRACE_END(TR_LOCK);
+	return 1;
+}
+
+/* Starts the sequence - 0 if one is still running. */
+uint8_t release_press(void){
+	if(SLR_Release.state != RELEASE_IDLE){ SLR_Release.error = RELEASE_BUSY; return 0; }
+	SLR_Release.done = 0;
+	SLR_Release.error = RELEASE_OK;
+	SLR_Release.mirror_up = 0;
+	SLR_Release.let_go = 0;
+	release_stamp(REL_PRESS);
+	if(SLR_Flicker.on) flicker_start();
+	TRACE_BEGIN(TR_RELEASE);
+	SLR_Release.state = RELEASE_LOCKING;
+	return 1;
+}
+
+/* The release button let go: the end of a bulb exposure. Let go before
+ * the first curtain (mirror and stop-down time), it is kept for the
+ * start of the exposure, which then closes a tick after it opens.
+ */
+void release_let_go(void){
+	SLR_Release.let_go = 1;
+	if((SLR_Release.tv < 0) && (SLR_Release.state == RELEASE_EXPOSING) && SLR_Long.bulb) long_close();
+}
+
+/* 1 while a long exposure runs: the RTC times it, the MCU may sleep in
+ * Stop mode */
+uint8_t release_long(void){
+	return (SLR_Release.state == RELEASE_EXPOSING) && (SLR_Release.tv < 0) && long_busy();
+}
+
+/* mirror position switch interrupt: up (and damped) or down */
+void release_mirror_isr(uint8_t up){
+	SLR_Release.mirror_up = up;
+}
+
+/* Main loop side: moves the sequence on as its steps complete. */
+void release_poll(void){
+	switch(SLR_Release.state){
+	case RELEASE_LOCKING:
+		if(SLR_Flicker.on && !flicker_done()) return;   /* the burst, before the mirror goes */
+		if(!release_lock()) return;   /* no settled reading yet */
+		if(SLR_Release.error){ SLR_Release.state = RELEASE_IDLE; TRACE_END(TR_RELEASE); return; }
+		/* both steps start now, the shutter waits for the slower one */
+		hal_mirror(1);
+		if(!SLR_Release.drive) release_stamp(REL_APERTURE);
+		SLR_Release.state = RELEASE_PREPARING;
+		/* fall through */
+	case RELEASE_PREPARING:
+		if(!(SLR_Release.done & (1u << REL_APERTURE)) && !lens_busy()) release_stamp(REL_APERTURE);
+		if(!(SLR_Release.done & (1u << REL_MIRROR)) && SLR_Release.mirror_up) release_stamp(REL_MIRROR);
+		if((SLR_Release.done & ((1u << REL_APERTURE) | (1u << REL_MIRROR))) != ((1u << REL_APERTURE) | (1u << REL_MIRROR))) return;
+		if(SLR_Release.tv < 0){
+			if(!long_start(SLR_Release.long_ms)) return;
+			if(SLR_Release.let_go && SLR_Long.bulb) long_close();
+		}else if(!shutter_fire_us(SLR_Release.us, SLR_Release.flicker ? flicker_wait(SLR_Release.us) : 0)){
+			return;   /* previous exposure still running */
+		}
+		release_stamp(REL_FIRE);
+		TRACE_END(TR_RELEASE);
+		log_frame(SLR_Release.frame);
+		SLR_Release.state = RELEASE_EXPOSING;
+		if(SLR_Release.tv < 0) return;
+		/* the first curtain goes at a known timer tick */
+		SLR_Release.at[REL_OPEN] = SLR_Release.at[REL_FIRE] + (uint16_t)(SLR_Shutter.open_at - hal_tim_now());
+		SLR_Release.done |= 1u << REL_OPEN;
+		return;
+	case RELEASE_EXPOSING:
+		if(SLR_Release.tv < 0){
+			if(SLR_Long.state != LONG_DONE) return;
+			SLR_Release.at[REL_OPEN] = SLR_Long.open_us;
+			SLR_Release.done |= 1u << REL_OPEN;
+		}else if(SLR_Shutter.state != SHUTTER_DONE) return;
+		release_stamp(REL_CLOSED);
+		hal_mirror(0);
+		if(SLR_Release.drive) lens_open();
+		SLR_Release.state = RELEASE_RETURNING;
+		return;
+	case RELEASE_RETURNING:
+		if(SLR_Release.mirror_up || lens_busy()) return;
+		SLR_Release.state = RELEASE_IDLE;
+		return;
+	default:
+		return;
+	}
+}
+
+/* press to first curtain, in us - the shutter lag of the last release */
+uint32_t release_lag(void){
+	return SLR_Release.at[REL_OPEN] - SLR_Release.at[REL_PRESS];
+}
+
+#endif /* SLR_RELEASE_H */
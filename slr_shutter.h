@@ -0,0 +1,215 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    S H U T T E R   T I M I N G
+ *    ---------------------------
+ *    Non-blocking exposure scheduler, on the compare channels of a 1 MHz
+ *    hardware timer (see slr_hal.h). shutter_fire_us() only arms the timer
+ *    and returns; the curtains are released by the timer, so the CPU stays
+ *    free for metering and UI during the exposure.
+ *
+ *    A salvaged shutter never gives the nominal time: the curtains don't
+ *    travel alike, and at the fast speeds a few tens of us are a good part
+ *    of the exposure. shutter_fire_us() adds the correction of the speed
+ *    to the gap between the curtains, to the us; the corrections come from
+ *    the calibration (slr_calib.h), which times the light at the film gate
+ *    with a phototransistor at the whole stops of Tv_speed[], and are kept
+ *    in the data EEPROM. A time in between gets the correction of the
+ *    stops either side of it, in proportion.
+ */
+#ifndef SLR_SHUTTER_H
+#define SLR_SHUTTER_H
+
+#include "slr.h"
+#include "slr_hal.h"
+
+/** USER CONSTANTS - user settable.
+ *  Shutter_lead is the delay between shutter_fire_us() and the first curtain,
+ *  in timer ticks - enough to arm both channels before the first match.
+ *  Shutter_hw_edges is 1 if the curtain magnets are driven by the timer
+ *  compare outputs, 0 if they hang on plain GPIOs (then the edges wait for
+ *  the interrupt and carry its latency).
+ */
+const uint16_t Shutter_lead     = 100;
+const uint8_t  Shutter_hw_edges = 1;
+
+/* the correction table in the data EEPROM: SHUTTER_CAL_WORDS words of two
+ * int16_t, index 2i in the low half, then SHUTTER_CAL_MAGIC in the high
+ * half of the last word and the sum of the halves in its low half - an
+ * erased or broken table reads as no correction */
+#define SHUTTER_CAL_WORDS 8
+#ifndef SHUTTER_CAL_BASE
+#define SHUTTER_CAL_BASE  (HAL_EEPROM_WORDS - SHUTTER_CAL_WORDS - 1)  /* the top words, past the frame log */
+#endif
+#if SHUTTER_CAL_BASE + SHUTTER_CAL_WORDS >= HAL_EEPROM_WORDS
+#error "the shutter calibration table is past the end of the data EEPROM (HAL_EEPROM_WORDS)"
+#endif
+#define SHUTTER_CAL_MAGIC 0x5CA1u
+/* shortest gap a correction may leave between the curtains */
+#define SHUTTER_MIN_GAP   20
+
+/* the 16 bit timer can't wait more than that at once, longer speeds are
+ * chained in steps; the last step is never shorter than half of it.
+ */
+#define SHUTTER_STEP 0x8000u
+
+typedef enum { SHUTTER_IDLE = 0, SHUTTER_ARMED, SHUTTER_OPEN, SHUTTER_DONE} shutter_state_t;
+
+typedef struct {
+	volatile shutter_state_t state;
+	uint8_t  hw_edges;  /* curtains released by the timer outputs        */
+	uint16_t open_at;   /* timer tick of the first curtain               */
+	uint16_t close_at;  /* timer tick of the next second curtain compare */
+	uint32_t remaining; /* ticks still to chain after close_at           */
+	int16_t  corr[16];  /* us added to Tv_speed[] at the fire            */
+	/* the phototransistor at the film gate, when fitted */
+	volatile uint8_t  lit;      /* light on the gate                     */
+	volatile uint8_t  measured; /* an exposure timed, in gate_us         */
+	volatile uint32_t lit_us;   /* when the light came                   */
+	volatile uint32_t gate_us;  /* light to dark, us                     */
+} shutter_t;
+
+shutter_t SLR_Shutter;
+
+/* -- Functions ---------------------------------------------------------- */
+
+/* the halves of the table word w, and its check word */
+#define SHUTTER_CAL_WORD(c, w) ((uint32_t)(uint16_t)(c)[2 * (w)] | ((uint32_t)(uint16_t)(c)[2 * (w) + 1] << 16))
+
+uint32_t shutter_cal_check(const int16_t *corr){
+	uint16_t sum = 0;
+	uint8_t i;
+	for(i = 0; i < 16; i++) sum += (uint16_t)corr[i];
+	return (SHUTTER_CAL_MAGIC << 16) | sum;
+}
+
+/* reads the correction table from the data EEPROM - none if it isn't valid */
+void shutter_load(void){
+	uint8_t w;
+	for(w = 0; w < SHUTTER_CAL_WORDS; w++){
+		uint32_t x = hal_eeprom_read(SHUTTER_CAL_BASE + w);
+		SLR_Shutter.corr[2 * w]     = (int16_t)(x & 0xFFFF);
+		SLR_Shutter.corr[2 * w + 1] = (int16_t)(x >> 16);
+	}
+	if(hal_eeprom_read(SHUTTER_CAL_BASE + SHUTTER_CAL_WORDS) != shutter_cal_check(SLR_Shutter.corr))
+		for(w = 0; w < 16; w++) SLR_Shutter.corr[w] = 0;
+}
+
+void shutter_init(uint8_t hw_edges){
+	SLR_Shutter.state    = SHUTTER_IDLE;
+	SLR_Shutter.hw_edges = hw_edges;
+	SLR_Shutter.lit = SLR_Shutter.measured = 0;
+	shutter_load();
+}
+
+/* the next step of a chain with remaining ticks to go */
+uint32_t shutter_step(uint32_t remaining){
+	if(remaining > 2 * SHUTTER_STEP) return SHUTTER_STEP;
+	if(remaining > SHUTTER_STEP) return remaining >> 1;
+	return remaining;
+}
+
+/* arms the second curtain channel for the next step of the chain */
+void shutter_arm_close(void){
+	uint32_t step = shutter_step(SLR_Shutter.remaining);
+	SLR_Shutter.remaining -= step;
+	SLR_Shutter.close_at  += (uint16_t)step;
+	hal_tim_arm(1, SLR_Shutter.close_at, SLR_Shutter.hw_edges && (SLR_Shutter.remaining == 0));
+}
+
+/* Arms both curtains, gap ticks apart, the first one Shutter_lead + delay
+ * ticks from now. Both are scheduled from the same tick, so the exposure
+ * doesn't depend on when the interrupts run - which needs the first step
+ * of the second curtain inside the timer period too: a delay past
+ * 0xFFFF - Shutter_lead - that step is cut to it.
+ */
+uint8_t shutter_start(uint32_t gap, uint16_t delay){
+	uint32_t last = 0xFFFFu - Shutter_lead - shutter_step(gap);
+	if((SLR_Shutter.state == SHUTTER_ARMED) || (SLR_Shutter.state == SHUTTER_OPEN)) return 0;
+	if(delay > last) delay = (uint16_t)last;
+	TRACE_BEGIN(TR_SHUTTER_FIRE);
+	SLR_Shutter.state     = SHUTTER_ARMED;
+	SLR_Shutter.open_at   = hal_tim_now() + Shutter_lead + delay;
+	SLR_Shutter.close_at  = SLR_Shutter.open_at;
+	SLR_Shutter.remaining = gap;
+	hal_tim_arm(0, SLR_Shutter.open_at, SLR_Shutter.hw_edges);
+	shutter_arm_close();
+	TRACE_END(TR_SHUTTER_FIRE);
+	return 1;
+}
+
+/* Starts an exposure of us microseconds, corrected for this shutter, the
+ * first curtain delay us later than the lead (up to half the timer period
+ * at least, see shutter_start()), and returns at once - 1 if armed, 0 if
+ * the shutter is still busy or the time is zero or shorter than
+ * Tv_speed[Tv_max_speed].
+ */
+uint8_t shutter_fire_us(uint32_t us, uint16_t delay){
+	int32_t gap, c0;
+	uint32_t f;
+	uint8_t i;
+	if((us == 0) || (us < Tv_speed[Tv_max_speed])) return 0;
+	/* the calibrated speeds either side, Tv_speed[i - 1] < us <= Tv_speed[i],
+	 * or past 1 s the one of 1 s */
+	for(i = Tv_max_speed; (i < 14) && (Tv_speed[i] < us); i++);
+	gap = SLR_Shutter.corr[i];
+	if((i > Tv_max_speed) && (us < Tv_speed[i])){
+		/* 1/256ths of the way from Tv_speed[i - 1] */
+		c0 = SLR_Shutter.corr[i - 1];
+		f = ((us - Tv_speed[i - 1]) << 8) / (Tv_speed[i] - Tv_speed[i - 1]);
+		gap = c0 + (gap - c0) * (int32_t)f / 256;
+	}
+	gap += (int32_t)us;
+	if(gap < SHUTTER_MIN_GAP) gap = SHUTTER_MIN_GAP;
+	return shutter_start((uint32_t)gap, delay);
+}
+
+/* Starts an exposure of Tv_speed[tv], with its own correction, at once -
+ * 0 if busy, or for a speed error, a speed faster than Tv_max_speed, or
+ * bulb.
+ */
+uint8_t shutter_fire(uint8_t tv){
+	if((tv < Tv_max_speed) || (tv == 0) || (tv > 14)) return 0;
+	return shutter_fire_us(Tv_speed[tv], 0);
+}
+
+uint8_t shutter_busy(void){
+	return (SLR_Shutter.state == SHUTTER_ARMED) || (SLR_Shutter.state == SHUTTER_OPEN);
+}
+
+/* compare match interrupt of the shutter timer, channel ch */
+void shutter_timer_isr(uint8_t ch){
+	if(ch == 0){
+		if(!SLR_Shutter.hw_edges) hal_curtain_release(0);
+		hal_tim_disarm(0);
+		if(SLR_Shutter.state == SHUTTER_ARMED) SLR_Shutter.state = SHUTTER_OPEN;
+		return;
+	}
+	if(SLR_Shutter.remaining){
+		shutter_arm_close();
+		return;
+	}
+	if(!SLR_Shutter.hw_edges) hal_curtain_release(1);
+	hal_tim_disarm(1);
+	SLR_Shutter.state = SHUTTER_DONE;
+}
+
+/* Capture interrupt of the phototransistor, both edges: light is 1 when
+ * the first curtain uncovers the gate, 0 when the second one covers it.
+ * The capture is of the shutter timer.
+ */
+void shutter_light_isr(uint8_t light, uint16_t capture){
+	uint32_t t = hal_micros() - (uint16_t)(hal_tim_now() - capture);
+	if(light){
+		SLR_Shutter.lit_us = t;
+		SLR_Shutter.lit = 1;
+		return;
+	}
+	if(!SLR_Shutter.lit) return;
+	SLR_Shutter.lit = 0;
+	SLR_Shutter.gate_us = t - SLR_Shutter.lit_us;
+	SLR_BARRIER();
+	SLR_Shutter.measured = 1;
+}
+
+#endif /* SLR_SHUTTER_H */
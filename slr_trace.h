@@ -0,0 +1,178 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    T R A C E P O I N T S
+ *    ---------------------
+ *    Timestamped begin/end events around the steps of the camera logic,
+ *    to see where the time goes between the button and the shutter. Built
+ *    with -DSLR_TRACE only; otherwise every TRACE_*() is empty and costs
+ *    nothing. The timestamps are the DWT cycle counter on the Cortex-M3,
+ *    clock_gettime() on the host. Events go to a ring buffer that the
+ *    interrupts and the main loop write without locks; trace_dump() sends
+ *    the new ones over the UART as text, and host/trace_hist.c turns the
+ *    dumps into latency histograms per tracepoint.
+ */
+#ifndef SLR_TRACE_H
+#define SLR_TRACE_H
+
+#include <stdint.h>
+
+/* the tracepoints: id, name */
+#define TRACE_POINTS(X) \
+	X(TR_RELEASE,       "release: press to fire") \
+	X(TR_LOCK,          "release: exposure lock") \
+	X(TR_SOLVE,         "Av/Tv lookup") \
+	X(TR_READ_EXPOSURE, "read_exposure") \
+	X(TR_METER_SAMPLE,  "meter: lux + EV of a sample") \
+	X(TR_GETEV,         "getEV") \
+	X(TR_SHUTTER_FIRE,  "shutter_fire") \
+	X(TR_WAKE,          "half-press to first valid EV") \
+	X(TR_LOG,           "log: frame queued")
+
+#define TRACE_ID(id, name) id,
+typedef enum { TRACE_POINTS(TRACE_ID) TRACE_IDS} trace_id_t;
+#undef TRACE_ID
+
+#define TRACE_END_BIT 0x8000u
+
+#ifndef SLR_TRACE
+
+#define TRACE_INIT()      ((void)0)
+#define TRACE_BEGIN(id)   ((void)0)
+#define TRACE_END(id)     ((void)0)
+
+#else
+
+#include "slr_hal.h"
+
+#ifndef TRACE_RING
+#define TRACE_RING 128  /* events, power of two - 12 bytes each */
+#endif
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+/* DWT cycle counter, at the core clock */
+#ifndef TRACE_HZ
+#define TRACE_HZ 32000000u
+#endif
+#define TRACE_DEMCR    (*(volatile uint32_t *)0xE000EDFCu)
+#define TRACE_DWT_CTRL (*(volatile uint32_t *)0xE0001000u)
+#define TRACE_CYCCNT   (*(volatile uint32_t *)0xE0001004u)
+#define trace_now()    TRACE_CYCCNT
+#else
+#include <time.h>
+#define TRACE_HZ 1000000000u
+uint32_t trace_now(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t)t.tv_sec * 1000000000u + (uint32_t)t.tv_nsec;
+}
+#endif
+
+typedef struct {
+	uint32_t ts;            /* trace_now()                              */
+	uint16_t id;            /* trace_id_t, | TRACE_END_BIT for the end  */
+	uint16_t arg;
+	volatile uint32_t seq;  /* event number, written last: a slot whose
+	                           seq isn't the expected one is half written
+	                           or already overwritten                   */
+} trace_ev_t;
+
+typedef struct {
+	trace_ev_t ring[TRACE_RING];
+	uint32_t head;          /* events ever written, atomic increment    */
+	uint32_t tail;          /* events dumped                            */
+	uint32_t lost;          /* overwritten before they were dumped      */
+	char     tx[32];        /* the line the UART DMA is sending         */
+} trace_t;
+
+trace_t SLR_Trace;
+
+/* -- Functions ---------------------------------------------------------- */
+
+void trace_init(void){
+	uint32_t i;
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+	TRACE_DEMCR    |= 1u << 24;   /* TRCENA    */
+	TRACE_CYCCNT    = 0;
+	TRACE_DWT_CTRL |= 1u;         /* CYCCNTENA */
+#endif
+	for(i = 0; i < TRACE_RING; i++) SLR_Trace.ring[i].seq = i - TRACE_RING;
+	SLR_Trace.head = SLR_Trace.tail = SLR_Trace.lost = 0;
+}
+
+/* Records an event, from anywhere. The slot is reserved by an atomic
+ * increment (LDREX/STREX on the M3), so an interrupt tracing in the middle
+ * takes the next slot instead of tearing this one. The ring overwrites the
+ * oldest events.
+ */
+void trace_event(uint16_t id, uint16_t arg){
+	uint32_t n = __atomic_fetch_add(&SLR_Trace.head, 1, __ATOMIC_RELAXED);
+	trace_ev_t *e = &SLR_Trace.ring[n & (TRACE_RING - 1)];
+	e->seq = n - 1;     /* invalid while being written */
+	SLR_BARRIER();
+	e->ts  = trace_now();
+	e->id  = id;
+	e->arg = arg;
+	SLR_BARRIER();
+	e->seq = n;
+}
+
+/* appends the hex digits of v to p */
+char *trace_hex(char *p, uint32_t v, uint8_t digits){
+	while(digits--){
+		uint8_t d = (v >> (digits * 4)) & 0x0F;
+		*p++ = (d < 10) ? '0' + d : 'a' + d - 10;
+	}
+	return p;
+}
+
+/* the line buffer, once the UART has sent the last line out of it */
+char *trace_line(void){
+	while(hal_uart_busy());
+	return SLR_Trace.tx;
+}
+
+/* Sends the events written since the last dump over the UART, a line
+ * each: "T seq id arg ts" in hex, after a "H hz" header, and "E lost" at
+ * the end with the count of events overwritten before they could go.
+ * Every line waits for the one before to leave SLR_Trace.tx, and the
+ * dump returns with the UART done.
+ */
+void trace_dump(void){
+	char *p;
+	uint32_t head = __atomic_load_n(&SLR_Trace.head, __ATOMIC_ACQUIRE), n;
+
+	p = trace_line(); *p++ = 'H'; *p++ = ' '; p = trace_hex(p, TRACE_HZ, 8); *p++ = '\n';
+	hal_uart_write((const uint8_t *)SLR_Trace.tx, p - SLR_Trace.tx);
+	if(head - SLR_Trace.tail > TRACE_RING){
+		SLR_Trace.lost += head - SLR_Trace.tail - TRACE_RING;
+		SLR_Trace.tail = head - TRACE_RING;
+	}
+	for(n = SLR_Trace.tail; n != head; n++){
+		trace_ev_t *e = &SLR_Trace.ring[n & (TRACE_RING - 1)];
+		uint32_t seq = e->seq, ts, id, arg;
+		SLR_BARRIER();
+		ts = e->ts; id = e->id; arg = e->arg;
+		SLR_BARRIER();
+		if((seq != n) || (e->seq != n)){ SLR_Trace.lost++; continue; }
+		p = trace_line();
+		*p++ = 'T'; *p++ = ' '; p = trace_hex(p, n, 8);
+		*p++ = ' '; p = trace_hex(p, id, 4);
+		*p++ = ' '; p = trace_hex(p, arg, 4);
+		*p++ = ' '; p = trace_hex(p, ts, 8);
+		*p++ = '\n';
+		hal_uart_write((const uint8_t *)SLR_Trace.tx, p - SLR_Trace.tx);
+	}
+	SLR_Trace.tail = head;
+	p = trace_line(); *p++ = 'E'; *p++ = ' '; p = trace_hex(p, SLR_Trace.lost, 8); *p++ = '\n';
+	hal_uart_write((const uint8_t *)SLR_Trace.tx, p - SLR_Trace.tx);
+	trace_line();
+}
+
+#define TRACE_INIT()      trace_init()
+#define TRACE_BEGIN(id)   trace_event((id), 0)
+#define TRACE_END(id)     trace_event((id) | TRACE_END_BIT, 0)
+
+#endif /* SLR_TRACE */
+
+#endif /* SLR_TRACE_H */
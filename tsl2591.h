@@ -0,0 +1,102 @@
+/**  (c) Vasile Guta-Ciucur, funlw65@gmail.com, all rights reserved
+ *   Licensed under the MIT license (see the LICENSE file).
+ *
+ *    T S L 2 5 9 1   L I G H T   S E N S O R
+ *    ---------------------------------------
+ *    The parts of the Adafruit TSL2591 library the light meter needs,
+ *    ported to C - and to integer arithmetic, the STM32L1 has no FPU.
+ */
+#ifndef TSL2591_H
+#define TSL2591_H
+
+#include <stdint.h>
+
+/** sensor gain, as the AGAIN field of the CONTROL register (bits 5:4) */
+typedef enum { TSL2591_GAIN_LOW = 0, TSL2591_GAIN_MED, TSL2591_GAIN_HIGH, TSL2591_GAIN_MAX} tsl2591_gain_t;
+/** integration time, as the ATIME field of the CONTROL register: (code + 1) * 100ms */
+typedef enum { TSL2591_IT_100MS = 0, TSL2591_IT_200MS, TSL2591_IT_300MS,
+               TSL2591_IT_400MS, TSL2591_IT_500MS, TSL2591_IT_600MS} tsl2591_it_t;
+
+/** returned by tsl2591_calculateLux() when a channel is saturated */
+#define TSL2591_LUX_OVERFLOW   0xFFFFFFFFu
+#define TSL2591_LUX40_OVERFLOW 0xFFFFFFFFFFFFFFFFull
+
+/** the ADC top, 36863 counts for 100ms and 65535 for longer times */
+#define TSL2591_MAX_COUNT(it) (((it) == TSL2591_IT_100MS) ? 36863 : 65535)
+
+const uint16_t TSL2591_again[4]={1, 25, 428, 9876};
+
+/** Counts to lux factors, 408 * 256 * 65536 / (atime_ms * again), where
+ *  408 is the Adafruit LUX_DF and again is 1, 25, 428 or 9876 - the float
+ *  "cpl" of the Adafruit library, inverted and scaled once, here.
+ */
+const uint32_t TSL2591_lux_factor[4][6]={
+	{68451041, 34225521, 22817014, 17112760, 13690208, 11408507}, /* 1x    */
+	{ 2738042,  1369021,   912681,   684510,   547608,   456340}, /* 25x   */
+	{  159932,    79966,    53311,    39983,    31986,    26655}, /* 428x  */
+	{    6931,     3466,     2310,     1733,     1386,     1155}  /* 9876x */
+};
+
+/* Returns the lux value in 2^-40 lux units (Q24.40) for the full spectrum
+ * (ch0) and infrared (ch1) counts read with the given gain and integration
+ * time, or TSL2591_LUX40_OVERFLOW if the sensor is saturated. Same formula as
+ * Adafruit's calculateLux(): lux = (ch0 - ch1) * (1 - ch1 / ch0) / cpl.
+ * Nothing is thrown away, so a few counts at high gain still give the lux
+ * with all their precision.
+ */
+uint64_t tsl2591_calculateLux40(uint16_t ch0, uint16_t ch1, uint8_t gain, uint8_t it){
+	uint32_t d, q;
+	if(it > TSL2591_IT_600MS) it = TSL2591_IT_600MS;
+	if((ch0 >= TSL2591_MAX_COUNT(it)) || (ch1 >= TSL2591_MAX_COUNT(it))) return TSL2591_LUX40_OVERFLOW;
+	if((ch0 == 0) || (ch1 >= ch0)) return 0;
+	d = ch0 - ch1;
+	q = (d << 16) / ch0;            /* 1 - ch1 / ch0, in Q16            */
+	return (uint64_t)(d * q) * TSL2591_lux_factor[gain & 3][it];
+}
+
+/* The same in 1/256 lux units (Q24.8), or TSL2591_LUX_OVERFLOW */
+uint32_t tsl2591_calculateLux(uint16_t ch0, uint16_t ch1, uint8_t gain, uint8_t it){
+	uint64_t lux = tsl2591_calculateLux40(ch0, ch1, gain, it);
+	if(lux == TSL2591_LUX40_OVERFLOW) return TSL2591_LUX_OVERFLOW;
+	return (uint32_t)(lux >> 32);
+}
+
+/** Gain and integration time controller.
+ *  Called with the counts of the integration just read and the setting
+ *  they were taken with, it predicts the counts of every other setting
+ *  (they scale with again * atime) and picks the shortest integration time
+ *  that still gives TSL2591_MIN_COUNTS - at the highest gain that keeps
+ *  a quarter of the ADC range free for the light going up. A saturated
+ *  sample jumps to the least sensitive setting, a black one to the most
+ *  sensitive gain at 100ms, so the very next sample is already a good one.
+ *  Returns 1 if the setting in *gain and *it changed.
+ */
+#define TSL2591_MIN_COUNTS 256  /* 1/8 stop is ~11 counts, plus noise margin */
+
+uint8_t tsl2591_adapt(uint16_t ch0, uint16_t ch1, uint8_t *gain, uint8_t *it){
+	uint8_t  g = *gain & 3, t = (*it > TSL2591_IT_600MS) ? TSL2591_IT_600MS : *it;
+	uint8_t  ng = TSL2591_GAIN_LOW, nt;
+	uint32_t s = TSL2591_again[g] * (t + 1), c = 0;
+
+	if((ch0 >= TSL2591_MAX_COUNT(t)) || (ch1 >= TSL2591_MAX_COUNT(t))){
+		ng = TSL2591_GAIN_LOW; nt = TSL2591_IT_100MS;
+	}else if(ch0 == 0){
+		ng = TSL2591_GAIN_MAX; nt = TSL2591_IT_100MS;
+	}else{
+		for(nt = TSL2591_IT_100MS; nt <= TSL2591_IT_600MS; nt++){
+			uint32_t room = TSL2591_MAX_COUNT(nt) - (TSL2591_MAX_COUNT(nt) >> 2);
+			for(ng = TSL2591_GAIN_MAX; ; ng--){
+				c = ch0 * (TSL2591_again[ng] * (nt + 1)) / s;
+				if((c <= room) || (ng == TSL2591_GAIN_LOW)) break;
+			}
+			if(c >= TSL2591_MIN_COUNTS) break;
+		}
+		if(nt > TSL2591_IT_600MS) nt = TSL2591_IT_600MS; /* as sensitive as it gets */
+	}
+	if((ng == g) && (nt == t)) return 0;
+	*gain = ng;
+	*it = nt;
+	return 1;
+}
+
+#endif /* TSL2591_H */